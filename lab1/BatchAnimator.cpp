@@ -0,0 +1,175 @@
+#include "BatchAnimator.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace {
+
+//time on a path after looping, like osg::AnimationPath::getInterpolatedControlPoint
+double pathTime( double time, double first, double period, osg::AnimationPath::LoopMode loopMode ) {
+    if ( period <= 0.0 )
+        return first;
+
+    double cycles;
+    double fraction;
+    switch ( loopMode ) {
+    case osg::AnimationPath::SWING:
+        cycles = (time - first) / (period * 2.0);
+        fraction = cycles - std::floor(cycles);
+        if ( fraction > 0.5 )
+            fraction = 1.0 - fraction;
+        return first + fraction * 2.0 * period;
+    case osg::AnimationPath::LOOP:
+        cycles = (time - first) / period;
+        return first + (cycles - std::floor(cycles)) * period;
+    default:
+        return time;
+    }
+}
+
+osg::Vec4f slerp( const osg::Vec4f& from, osg::Vec4f to, float t ) {
+    //the shorter way round, q and -q are the same rotation
+    float cosine = from * to;
+    if ( cosine < 0.0f ) {
+        cosine = -cosine;
+        to = -to;
+    }
+
+    //nearly the same, a normalized lerp is exact enough and avoids dividing by a tiny sine
+    if ( cosine > 0.9995f ) {
+        osg::Vec4f result = from * (1.0f - t) + to * t;
+        result.normalize();
+        return result;
+    }
+
+    float angle = std::acos(cosine);
+    float sine = std::sin(angle);
+    return from * (std::sin((1.0f - t) * angle) / sine) + to * (std::sin(t * angle) / sine);
+}
+
+}
+
+BatchAnimator::BatchAnimator( unsigned int numThreads )
+    : _firstTime(DBL_MAX),
+      _pool(numThreads)
+{}
+
+unsigned int BatchAnimator::addPath( const osg::AnimationPath* path ) {
+    Path entry;
+    entry.first = _keyTimes.size();
+    entry.loopMode = path->getLoopMode();
+
+    const osg::AnimationPath::TimeControlPointMap& points = path->getTimeControlPointMap();
+    for ( osg::AnimationPath::TimeControlPointMap::const_iterator it = points.begin(); it != points.end(); ++it ) {
+        _keyTimes.push_back(it->first);
+        _keyPositions.push_back(it->second.getPosition());
+        _keyRotations.push_back(it->second.getRotation().asVec4());
+        _keyScales.push_back(it->second.getScale());
+    }
+
+    //a path with one point holds still, with none it stays at the origin
+    if ( points.empty() ) {
+        _keyTimes.push_back(0.0);
+        _keyPositions.push_back(osg::Vec3f());
+        _keyRotations.push_back(osg::Vec4f(0.0f, 0.0f, 0.0f, 1.0f));
+        _keyScales.push_back(osg::Vec3f(1.0f, 1.0f, 1.0f));
+    }
+    if ( points.size() < 2 ) {
+        _keyTimes.push_back(_keyTimes.back());
+        _keyPositions.push_back(_keyPositions.back());
+        _keyRotations.push_back(_keyRotations.back());
+        _keyScales.push_back(_keyScales.back());
+    }
+
+    entry.count = _keyTimes.size() - entry.first;
+    _paths.push_back(entry);
+    return _paths.size() - 1;
+}
+
+unsigned int BatchAnimator::addInstance( unsigned int path, osg::PositionAttitudeTransform* transform,
+                                         double timeOffset, double speed ) {
+    transform->setDataVariance(osg::Object::DYNAMIC);
+
+    _instancePaths.push_back(path);
+    _offsets.push_back(timeOffset);
+    _speeds.push_back(speed);
+    _keys.push_back(0);
+    _fractions.push_back(0.0f);
+    _positions.push_back(transform->getPosition());
+    _rotations.push_back(transform->getAttitude().asVec4());
+    _scales.push_back(transform->getScale());
+    _transforms.push_back(transform);
+    return _transforms.size() - 1;
+}
+
+void BatchAnimator::operator()( osg::Node* node, osg::NodeVisitor* nv ) {
+    if ( nv->getFrameStamp() ) {
+        double time = nv->getFrameStamp()->getSimulationTime();
+        if ( _firstTime == DBL_MAX )
+            _firstTime = time;
+        update(time - _firstTime);
+    }
+    traverse(node, nv);
+}
+
+void BatchAnimator::update( double time ) {
+    unsigned int count = _transforms.size();
+    if ( count <= BATCH_SIZE ) {
+        evaluate(0, count, time);
+    }
+    else {
+        for ( unsigned int begin = 0; begin < count; begin += BATCH_SIZE ) {
+            unsigned int end = std::min(begin + BATCH_SIZE, count);
+            _pool.run([this, begin, end, time]() { evaluate(begin, end, time); });
+        }
+        _pool.wait();
+    }
+
+    for ( unsigned int i = 0; i < count; ++i ) {
+        osg::PositionAttitudeTransform* transform = _transforms[i].get();
+        transform->setPosition(_positions[i]);
+        transform->setAttitude(osg::Quat(_rotations[i]));
+        transform->setScale(_scales[i]);
+    }
+}
+
+void BatchAnimator::evaluate( unsigned int begin, unsigned int end, double time ) {
+    //the keys around every instance's time
+    for ( unsigned int i = begin; i < end; ++i ) {
+        const Path& path = _paths[_instancePaths[i]];
+        const double* times = &_keyTimes[path.first];
+        unsigned int last = path.count - 1;
+
+        double t = pathTime((time * _speeds[i]) - _offsets[i], times[0], times[last] - times[0], path.loopMode);
+        t = std::max(times[0], std::min(times[last], t));
+
+        unsigned int key = _keys[i];
+        if ( t < times[key] || t > times[key + 1] ) {
+            if ( key + 2 <= last && t >= times[key + 1] && t <= times[key + 2] )
+                ++key;
+            else
+                key = unsigned(std::upper_bound(times + 1, times + last, t) - times) - 1;
+        }
+        _keys[i] = key;
+
+        double span = times[key + 1] - times[key];
+        _fractions[i] = span > 0.0 ? float((t - times[key]) / span) : 0.0f;
+    }
+
+    //every channel in its own loop over the instances
+    for ( unsigned int i = begin; i < end; ++i ) {
+        unsigned int key = _paths[_instancePaths[i]].first + _keys[i];
+        float f = _fractions[i];
+        _positions[i] = _keyPositions[key] * (1.0f - f) + _keyPositions[key + 1] * f;
+    }
+    for ( unsigned int i = begin; i < end; ++i ) {
+        unsigned int key = _paths[_instancePaths[i]].first + _keys[i];
+        float f = _fractions[i];
+        _scales[i] = _keyScales[key] * (1.0f - f) + _keyScales[key + 1] * f;
+    }
+    for ( unsigned int i = begin; i < end; ++i ) {
+        unsigned int key = _paths[_instancePaths[i]].first + _keys[i];
+        _rotations[i] = slerp(_keyRotations[key], _keyRotations[key + 1], _fractions[i]);
+    }
+}
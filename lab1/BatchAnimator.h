@@ -0,0 +1,88 @@
+#ifndef BATCHANIMATOR_H
+#define BATCHANIMATOR_H
+
+#include <osg/AnimationPath>
+#include <osg/NodeCallback>
+#include <osg/PositionAttitudeTransform>
+
+#include <vector>
+
+#include "ThreadPool.h"
+
+/*
+ * Animates many transforms along animation paths in one pass per frame.
+ *
+ * The control points of all paths are flattened into one array per channel:
+ * key times, positions, rotations and scales. Instances are kept the same way,
+ * one array each for path, time offset, speed, current key and the evaluated
+ * position, rotation and scale. Each instance remembers the key it was at, so
+ * finding the keys around its time is a step forward in the common case and a
+ * binary search only when time jumps.
+ *
+ * Installed as an update callback, it evaluates every instance with the
+ * frame's simulation time, counted from the first frame it sees like
+ * osg::AnimationPathCallback. Large counts are split into batches that run on a
+ * thread pool, then the results are written into the transforms on the
+ * calling thread, since their bounds dirty shared parents. Interpolation
+ * matches osg::AnimationPath: position and scale are linear, rotation is a
+ * slerp.
+ */
+class BatchAnimator : public osg::NodeCallback
+{
+public:
+    //instances evaluated per job
+    static const unsigned int BATCH_SIZE = 1024;
+
+    BatchAnimator( unsigned int numThreads = 0 );
+
+    //copy the control points of path, returns its index
+    unsigned int addPath( const osg::AnimationPath* path );
+
+    //move transform along a path, which also marks it dynamic so the optimizer leaves it alone
+    //the instance is at time * speed - timeOffset on its path
+    unsigned int addInstance( unsigned int path, osg::PositionAttitudeTransform* transform,
+                              double timeOffset = 0.0, double speed = 1.0 );
+
+    unsigned int getNumPaths() const { return _paths.size(); }
+    unsigned int getNumInstances() const { return _transforms.size(); }
+
+    //evaluate every instance at time and write the transforms
+    void update( double time );
+
+    virtual void operator()( osg::Node* node, osg::NodeVisitor* nv );
+
+protected:
+    virtual ~BatchAnimator() {}
+
+    struct Path {
+        unsigned int first; //first key
+        unsigned int count; //at least 2
+        osg::AnimationPath::LoopMode loopMode;
+    };
+
+    void evaluate( unsigned int begin, unsigned int end, double time );
+
+    std::vector<Path> _paths;
+
+    //keys of all paths
+    std::vector<double> _keyTimes;
+    std::vector<osg::Vec3f> _keyPositions;
+    std::vector<osg::Vec4f> _keyRotations;
+    std::vector<osg::Vec3f> _keyScales;
+
+    //instances
+    std::vector<unsigned int> _instancePaths;
+    std::vector<double> _offsets;
+    std::vector<double> _speeds;
+    std::vector<unsigned int> _keys; //relative to the path's first key
+    std::vector<float> _fractions;
+    std::vector<osg::Vec3f> _positions;
+    std::vector<osg::Vec4f> _rotations;
+    std::vector<osg::Vec3f> _scales;
+    std::vector< osg::ref_ptr<osg::PositionAttitudeTransform> > _transforms;
+
+    double _firstTime;
+    ThreadPool _pool;
+};
+
+#endif
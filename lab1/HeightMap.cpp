@@ -0,0 +1,138 @@
+#include "HeightMap.h"
+
+#include <osg/Notify>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+//dst[i] = src[i * stride] * scale + offset, the contiguous cases are vectorised
+void convertRow( const unsigned char* src, unsigned int stride, float* dst, unsigned int count, float scale, float offset ) {
+    unsigned int i = 0;
+#ifdef __SSE2__
+    if ( stride == 1 ) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128 s = _mm_set1_ps(scale);
+        const __m128 o = _mm_set1_ps(offset);
+        for ( ; i + 16 <= count; i += 16 ) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+            __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+            _mm_storeu_ps(dst + i,      _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), s), o));
+            _mm_storeu_ps(dst + i + 4,  _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), s), o));
+            _mm_storeu_ps(dst + i + 8,  _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), s), o));
+            _mm_storeu_ps(dst + i + 12, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), s), o));
+        }
+    }
+#endif
+    for ( ; i < count; ++i )
+        dst[i] = src[i * stride] * scale + offset;
+}
+
+void convertRow( const unsigned short* src, unsigned int stride, float* dst, unsigned int count, float scale, float offset ) {
+    unsigned int i = 0;
+#ifdef __SSE2__
+    if ( stride == 1 ) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128 s = _mm_set1_ps(scale);
+        const __m128 o = _mm_set1_ps(offset);
+        for ( ; i + 8 <= count; i += 8 ) {
+            __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            _mm_storeu_ps(dst + i,     _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero)), s), o));
+            _mm_storeu_ps(dst + i + 4, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(words, zero)), s), o));
+        }
+    }
+#endif
+    for ( ; i < count; ++i )
+        dst[i] = src[i * stride] * scale + offset;
+}
+
+void convertRow( const float* src, unsigned int stride, float* dst, unsigned int count, float scale, float offset ) {
+    unsigned int i = 0;
+#ifdef __SSE2__
+    if ( stride == 1 ) {
+        const __m128 s = _mm_set1_ps(scale);
+        const __m128 o = _mm_set1_ps(offset);
+        for ( ; i + 4 <= count; i += 4 )
+            _mm_storeu_ps(dst + i, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(src + i), s), o));
+    }
+#endif
+    for ( ; i < count; ++i )
+        dst[i] = src[i * stride] * scale + offset;
+}
+
+template<typename T>
+void convertRows( const osg::Image* image, unsigned int stride, float* heights, unsigned int numColumns,
+                  unsigned int firstRow, unsigned int lastRow, unsigned int count, float scale, float offset ) {
+    for ( unsigned int r = firstRow; r < lastRow; ++r ) {
+        const T* src = reinterpret_cast<const T*>(image->data(0, r));
+        convertRow(src, stride, heights + r * numColumns, count, scale, offset);
+    }
+}
+
+}
+
+bool setHeights( osg::HeightField* field, const osg::Image* heightMap, float scale, float offset, unsigned int numThreads ) {
+    if ( !field || !heightMap || !heightMap->data() ) {
+        osg::notify(osg::WARN) << "setHeights: no height map data" << std::endl;
+        return false;
+    }
+
+    //fold the integer normalisation into the scale
+    float valueScale = scale;
+    switch ( heightMap->getDataType() ) {
+    case GL_UNSIGNED_BYTE:  valueScale = scale / 255.0f;   break;
+    case GL_UNSIGNED_SHORT: valueScale = scale / 65535.0f; break;
+    case GL_FLOAT:          break;
+    default:
+        osg::notify(osg::WARN) << "setHeights: unsupported height map data type" << std::endl;
+        return false;
+    }
+
+    const unsigned int stride = osg::Image::computeNumComponents(heightMap->getPixelFormat());
+    const unsigned int numColumns = field->getNumColumns();
+    const unsigned int count = std::min(numColumns, (unsigned int) heightMap->s());
+    const unsigned int numRows = std::min(field->getNumRows(), (unsigned int) heightMap->t());
+    float* heights = &(*field->getFloatArray())[0];
+
+    //keep small maps on the calling thread, thread start up would dominate
+    if ( numThreads == 0 )
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    numThreads = std::max(1u, std::min(numThreads, numRows / 64));
+
+    const unsigned int band = (numRows + numThreads - 1) / numThreads;
+    std::vector<std::thread> workers;
+
+    for ( unsigned int t = 0; t < numThreads; ++t ) {
+        unsigned int firstRow = t * band;
+        unsigned int lastRow = std::min(numRows, firstRow + band);
+        if ( firstRow >= lastRow )
+            break;
+
+        switch ( heightMap->getDataType() ) {
+        case GL_UNSIGNED_BYTE:
+            workers.push_back(std::thread(convertRows<unsigned char>, heightMap, stride, heights, numColumns,
+                                          firstRow, lastRow, count, valueScale, offset));
+            break;
+        case GL_UNSIGNED_SHORT:
+            workers.push_back(std::thread(convertRows<unsigned short>, heightMap, stride, heights, numColumns,
+                                          firstRow, lastRow, count, valueScale, offset));
+            break;
+        default:
+            workers.push_back(std::thread(convertRows<float>, heightMap, stride, heights, numColumns,
+                                          firstRow, lastRow, count, valueScale, offset));
+            break;
+        }
+    }
+
+    for ( size_t t = 0; t < workers.size(); ++t )
+        workers[t].join();
+
+    return true;
+}
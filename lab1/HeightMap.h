@@ -0,0 +1,17 @@
+#ifndef HEIGHTMAP_H
+#define HEIGHTMAP_H
+
+#include <osg/Shape>
+#include <osg/Image>
+
+/*
+ * Bulk conversion of a height map image into the float array of a HeightField.
+ *
+ * Rows are converted in bands on several threads. 8 and 16 bit integer maps are
+ * normalised to [0,1] before scale and offset are applied, so the same scale
+ * works for both; float maps are used as they are. Only the first channel of
+ * multi channel images is read.
+ */
+bool setHeights( osg::HeightField* field, const osg::Image* heightMap, float scale, float offset = 0.0f, unsigned int numThreads = 0 );
+
+#endif
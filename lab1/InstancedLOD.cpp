@@ -0,0 +1,375 @@
+#include "InstancedLOD.h"
+
+#include <osg/Geode>
+#include <osg/Program>
+#include <osg/Shader>
+#include <osg/Transform>
+#include <osg/Uniform>
+#include <osg/observer_ptr>
+#include <osgUtil/CullVisitor>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+const unsigned int BATCH_SIZE = 64;
+const unsigned int MATRIX_UNIT = 1;
+
+const char* vertexSource =
+    "#version 120\n"
+    "#extension GL_EXT_gpu_shader4 : enable\n"
+    "#extension GL_EXT_draw_instanced : enable\n"
+    "uniform samplerBuffer instanceMatrices;\n"
+    "uniform mat4 localMatrix;\n"
+    "varying vec4 color;\n"
+    "varying vec2 texCoord;\n"
+    "\n"
+    "void addLight(int i, vec3 position, vec3 normal, inout vec4 ambient, inout vec4 diffuse, inout vec4 specular) {\n"
+    "    vec3 toLight = normalize(gl_LightSource[i].position.xyz);\n"
+    "    float attenuation = 1.0;\n"
+    "    if (gl_LightSource[i].position.w != 0.0) {\n"
+    "        vec3 offset = gl_LightSource[i].position.xyz - position;\n"
+    "        float distance = length(offset);\n"
+    "        toLight = offset / distance;\n"
+    "        attenuation = 1.0 / (gl_LightSource[i].constantAttenuation +\n"
+    "                             gl_LightSource[i].linearAttenuation * distance +\n"
+    "                             gl_LightSource[i].quadraticAttenuation * distance * distance);\n"
+    "        if (gl_LightSource[i].spotCutoff <= 90.0) {\n"
+    "            float spot = dot(-toLight, normalize(gl_LightSource[i].spotDirection));\n"
+    "            attenuation *= spot < gl_LightSource[i].spotCosCutoff ? 0.0 : pow(spot, gl_LightSource[i].spotExponent);\n"
+    "        }\n"
+    "    }\n"
+    "    float nDotL = max(dot(normal, toLight), 0.0);\n"
+    "    ambient += gl_LightSource[i].ambient * attenuation;\n"
+    "    diffuse += gl_LightSource[i].diffuse * nDotL * attenuation;\n"
+    "    if (nDotL > 0.0) {\n"
+    "        vec3 halfway = normalize(toLight + vec3(0.0, 0.0, 1.0));\n"
+    "        specular += gl_LightSource[i].specular * pow(max(dot(normal, halfway), 0.0), gl_FrontMaterial.shininess) * attenuation;\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "void main() {\n"
+    "    int texel = gl_InstanceID * 4;\n"
+    "    mat4 instance = mat4(texelFetchBuffer(instanceMatrices, texel),\n"
+    "                         texelFetchBuffer(instanceMatrices, texel + 1),\n"
+    "                         texelFetchBuffer(instanceMatrices, texel + 2),\n"
+    "                         texelFetchBuffer(instanceMatrices, texel + 3));\n"
+    "    mat4 modelView = gl_ModelViewMatrix * instance * localMatrix;\n"
+    "    vec4 position = modelView * gl_Vertex;\n"
+    "    vec3 normal = normalize(mat3(modelView) * gl_Normal);\n"
+    "\n"
+    "    vec4 ambient = vec4(0.0);\n"
+    "    vec4 diffuse = vec4(0.0);\n"
+    "    vec4 specular = vec4(0.0);\n"
+    "    for (int i = 0; i < 3; ++i)\n"
+    "        addLight(i, position.xyz, normal, ambient, diffuse, specular);\n"
+    "\n"
+    "    color = gl_FrontLightModelProduct.sceneColor + ambient * gl_FrontMaterial.ambient +\n"
+    "            diffuse * gl_FrontMaterial.diffuse + specular * gl_FrontMaterial.specular;\n"
+    "    color.a = gl_FrontMaterial.diffuse.a;\n"
+    "    texCoord = gl_MultiTexCoord0.xy;\n"
+    "    gl_Position = gl_ProjectionMatrix * position;\n"
+    "}\n";
+
+const char* fragmentSource =
+    "uniform sampler2D baseTexture;\n"
+    "uniform bool textured;\n"
+    "varying vec4 color;\n"
+    "varying vec2 texCoord;\n"
+    "\n"
+    "void main() {\n"
+    "    gl_FragColor = clamp(color, 0.0, 1.0);\n"
+    "    if (textured)\n"
+    "        gl_FragColor *= texture2D(baseTexture, texCoord);\n"
+    "}\n";
+
+//a geometry of a level with the transform and state above it
+struct FlatGeometry {
+    osg::ref_ptr<osg::Geometry> geometry;
+    osg::Matrix matrix;
+    osg::ref_ptr<osg::StateSet> stateSet;
+};
+
+//collects the geometries of a subgraph, merging the state sets along the way
+class Flattener : public osg::NodeVisitor
+{
+public:
+    Flattener( std::vector<FlatGeometry>& geometries )
+        : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN),
+          _geometries(geometries)
+    {
+        _matrices.push_back(osg::Matrix::identity());
+    }
+
+    virtual void apply( osg::Node& node ) {
+        pushState(node);
+        traverse(node);
+        popState(node);
+    }
+
+    virtual void apply( osg::Transform& transform ) {
+        osg::Matrix matrix = _matrices.back();
+        transform.computeLocalToWorldMatrix(matrix, this);
+        _matrices.push_back(matrix);
+        pushState(transform);
+        traverse(transform);
+        popState(transform);
+        _matrices.pop_back();
+    }
+
+    virtual void apply( osg::Geode& geode ) {
+        pushState(geode);
+        for ( unsigned int i = 0; i < geode.getNumDrawables(); ++i ) {
+            osg::Geometry* geometry = geode.getDrawable(i)->asGeometry();
+            if ( !geometry )
+                continue;
+
+            FlatGeometry flat;
+            flat.geometry = geometry;
+            flat.matrix = _matrices.back();
+            flat.stateSet = new osg::StateSet;
+            for ( size_t s = 0; s < _states.size(); ++s )
+                flat.stateSet->merge(*_states[s]);
+            _geometries.push_back(flat);
+        }
+        popState(geode);
+    }
+
+protected:
+    void pushState( osg::Node& node ) {
+        if ( node.getStateSet() )
+            _states.push_back(node.getStateSet());
+    }
+
+    void popState( osg::Node& node ) {
+        if ( node.getStateSet() )
+            _states.pop_back();
+    }
+
+    std::vector<FlatGeometry>& _geometries;
+    std::vector<osg::Matrix> _matrices;
+    std::vector<const osg::StateSet*> _states;
+};
+
+//the geometries are drawn all over the instances, so that is their bound
+class InstanceBound : public osg::Drawable::ComputeBoundingBoxCallback
+{
+public:
+    InstanceBound( osg::Node* instances ) : _instances(instances) {}
+
+    virtual osg::BoundingBox computeBound( const osg::Drawable& ) const {
+        osg::BoundingBox box;
+        osg::ref_ptr<osg::Node> instances;
+        if ( _instances.lock(instances) && instances->getBound().valid() )
+            box.expandBy(instances->getBound());
+        return box;
+    }
+
+protected:
+    osg::observer_ptr<osg::Node> _instances;
+};
+
+float maxScale( const osg::Matrix& matrix ) {
+    float scale2 = 0.0f;
+    for ( int row = 0; row < 3; ++row )
+        scale2 = std::max(scale2, float(osg::square(matrix(row, 0)) + osg::square(matrix(row, 1)) + osg::square(matrix(row, 2))));
+    return std::sqrt(scale2);
+}
+
+osg::BoundingSphere transformBound( const osg::BoundingSphere& bound, const osg::Matrix& matrix ) {
+    return osg::BoundingSphere(bound.center() * matrix, bound.radius() * maxScale(matrix));
+}
+
+bool hasTexture( const osg::StateSet* stateSet ) {
+    return stateSet && stateSet->getTextureAttribute(0, osg::StateAttribute::TEXTURE);
+}
+
+}
+
+InstancedLOD::InstancedLOD( osg::LOD* lod )
+    : _modelBound(lod->getBound()),
+      _modelCenter(lod->getCenter()),
+      _rangeMode(lod->getRangeMode()),
+      _batchesDirty(false)
+{
+    //the state of the LOD itself applies to every level, as it would above them
+    osg::StateSet* stateSet = getOrCreateStateSet();
+    if ( lod->getStateSet() )
+        stateSet->merge(*lod->getStateSet());
+
+    for ( unsigned int i = 0; i < lod->getNumChildren(); ++i )
+        addLevel(lod->getChild(i), lod->getMinRange(i), lod->getMaxRange(i), hasTexture(lod->getStateSet()));
+
+    osg::ref_ptr<osg::Program> program = new osg::Program;
+    program->addShader(new osg::Shader(osg::Shader::VERTEX, vertexSource));
+    program->addShader(new osg::Shader(osg::Shader::FRAGMENT, fragmentSource));
+
+    stateSet->setAttributeAndModes(program.get());
+    stateSet->addUniform(new osg::Uniform("instanceMatrices", int(MATRIX_UNIT)));
+    stateSet->addUniform(new osg::Uniform("baseTexture", 0));
+}
+
+void InstancedLOD::addLevel( osg::Node* node, float minRange, float maxRange, bool textured ) {
+    Level level;
+    level.minRange = minRange;
+    level.maxRange = maxRange;
+    level.count = 0;
+
+    //matrices of the visible copies, rewritten by every cull
+    level.buffer = new osg::Image;
+    level.buffer->setDataVariance(osg::Object::DYNAMIC);
+    level.texture = new osg::TextureBuffer(level.buffer.get());
+    level.texture->setInternalFormat(GL_RGBA32F_ARB);
+    level.texture->setDataVariance(osg::Object::DYNAMIC);
+
+    level.group = new osg::Group;
+    level.group->setCullingActive(false);
+    level.group->getOrCreateStateSet()->setTextureAttribute(MATRIX_UNIT, level.texture.get());
+    level.group->getOrCreateStateSet()->setDataVariance(osg::Object::DYNAMIC);
+
+    std::vector<FlatGeometry> geometries;
+    Flattener flattener(geometries);
+    node->accept(flattener);
+
+    osg::ref_ptr<InstanceBound> bound = new InstanceBound(this);
+    for ( size_t i = 0; i < geometries.size(); ++i ) {
+        //own primitive sets for the instance count, the arrays are shared with the model
+        osg::ref_ptr<osg::Geometry> geometry = new osg::Geometry(*geometries[i].geometry, osg::CopyOp::DEEP_COPY_PRIMITIVES);
+        geometry->setUseDisplayList(false);
+        geometry->setUseVertexBufferObjects(true);
+        geometry->setDataVariance(osg::Object::DYNAMIC);
+        geometry->setComputeBoundingBoxCallback(bound.get());
+
+        osg::ref_ptr<osg::Geode> geode = new osg::Geode;
+        geode->setCullingActive(false);
+        geode->addDrawable(geometry.get());
+        geode->setStateSet(geometries[i].stateSet.get());
+        geode->getStateSet()->addUniform(new osg::Uniform("localMatrix", osg::Matrixf(geometries[i].matrix)));
+        geode->getStateSet()->addUniform(new osg::Uniform("textured", textured || hasTexture(geode->getStateSet()) ||
+                                                                      hasTexture(geometry->getStateSet())));
+
+        level.group->addChild(geode.get());
+        level.geometries.push_back(geometry.get());
+    }
+
+    addChild(level.group.get());
+    _levels.push_back(level);
+}
+
+unsigned int InstancedLOD::addInstance( const osg::Matrix& matrix ) {
+    _matrices.push_back(matrix);
+    _bounds.push_back(transformBound(_modelBound, matrix));
+    _centers.push_back(_modelCenter * matrix);
+    _scales.push_back(maxScale(matrix));
+    dirtyInstances();
+    return _matrices.size() - 1;
+}
+
+void InstancedLOD::setInstance( unsigned int instance, const osg::Matrix& matrix ) {
+    _matrices[instance] = matrix;
+    _bounds[instance] = transformBound(_modelBound, matrix);
+    _centers[instance] = _modelCenter * matrix;
+    _scales[instance] = maxScale(matrix);
+    dirtyInstances();
+}
+
+void InstancedLOD::dirtyInstances() {
+    _batchesDirty = true;
+    dirtyBound();
+    for ( size_t l = 0; l < _levels.size(); ++l ) {
+        for ( size_t g = 0; g < _levels[l].geometries.size(); ++g )
+            _levels[l].geometries[g]->dirtyBound();
+    }
+}
+
+void InstancedLOD::updateBatches() {
+    _batchBounds.clear();
+    for ( size_t first = 0; first < _bounds.size(); first += BATCH_SIZE ) {
+        osg::BoundingSphere bound;
+        for ( size_t i = first; i < std::min(first + BATCH_SIZE, _bounds.size()); ++i )
+            bound.expandBy(_bounds[i]);
+        _batchBounds.push_back(bound);
+    }
+    _batchesDirty = false;
+}
+
+osg::BoundingSphere InstancedLOD::computeBound() const {
+    osg::BoundingSphere bound;
+    for ( size_t i = 0; i < _bounds.size(); ++i )
+        bound.expandBy(_bounds[i]);
+    return bound;
+}
+
+void InstancedLOD::traverse( osg::NodeVisitor& nv ) {
+    osgUtil::CullVisitor* cv = dynamic_cast<osgUtil::CullVisitor*>(&nv);
+    if ( !cv )
+        return;
+
+    if ( _batchesDirty )
+        updateBatches();
+
+    const unsigned int numInstances = _matrices.size();
+    for ( size_t l = 0; l < _levels.size(); ++l ) {
+        Level& level = _levels[l];
+        level.count = 0;
+        if ( level.buffer->s() < int(numInstances * 4) ) {
+            level.buffer->allocateImage(numInstances * 4, 1, 1, GL_RGBA, GL_FLOAT);
+            level.buffer->setInternalTextureFormat(GL_RGBA32F_ARB);
+        }
+    }
+
+    osg::Polytope& frustum = cv->getCurrentCullingSet().getFrustum();
+    const osg::Vec3 eye = cv->getEyeLocal();
+    const float lodScale = cv->getLODScale();
+
+    //whole batches first, single copies only where a batch straddles a plane
+    frustum.pushCurrentMask();
+    const osg::Polytope::ClippingMask outerMask = frustum.getResultMask();
+    for ( size_t b = 0; b < _batchBounds.size(); ++b ) {
+        frustum.setResultMask(outerMask);
+        if ( !frustum.contains(_batchBounds[b]) )
+            continue;
+
+        const osg::Polytope::ClippingMask batchMask = frustum.getResultMask();
+        const size_t last = std::min((b + 1) * BATCH_SIZE, _bounds.size());
+        for ( size_t i = b * BATCH_SIZE; i < last; ++i ) {
+            if ( batchMask != 0 ) {
+                frustum.setResultMask(batchMask);
+                if ( !frustum.contains(_bounds[i]) )
+                    continue;
+            }
+
+            //bucket the copy into the level its range selects, in the units osg::LOD would see below the copy's matrix
+            const float range = _rangeMode == osg::LOD::PIXEL_SIZE_ON_SCREEN ?
+                                cv->clampedPixelSize(_bounds[i]) / lodScale :
+                                (_centers[i] - eye).length() / _scales[i] * lodScale;
+            for ( size_t l = 0; l < _levels.size(); ++l ) {
+                Level& level = _levels[l];
+                if ( range >= level.minRange && range < level.maxRange ) {
+                    float* dst = reinterpret_cast<float*>(level.buffer->data()) + level.count * 16;
+                    std::memcpy(dst, _matrices[i].ptr(), 16 * sizeof(float));
+                    ++level.count;
+                    break;
+                }
+            }
+        }
+    }
+    frustum.popCurrentMask();
+
+    //one instanced draw per geometry and level
+    for ( size_t l = 0; l < _levels.size(); ++l ) {
+        Level& level = _levels[l];
+        if ( level.count == 0 )
+            continue;
+
+        level.buffer->dirty();
+        for ( size_t g = 0; g < level.geometries.size(); ++g ) {
+            osg::Geometry* geometry = level.geometries[g];
+            for ( unsigned int p = 0; p < geometry->getNumPrimitiveSets(); ++p )
+                geometry->getPrimitiveSet(p)->setNumInstances(level.count);
+        }
+        level.group->accept(nv);
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef INSTANCEDLOD_H
+#define INSTANCEDLOD_H
+
+#include <osg/Geometry>
+#include <osg/Group>
+#include <osg/LOD>
+#include <osg/TextureBuffer>
+
+#include <vector>
+
+/*
+ * Many copies of one LOD model drawn with hardware instancing.
+ *
+ * The levels of the LOD are flattened into one set of geometries each. The
+ * transforms of all copies live in one array. During cull the copies are
+ * tested against the frustum in batches of consecutive instances, then one at
+ * a time inside batches that straddle it. Each visible copy is sorted into
+ * the level its range selects, measured like osg::LOD does in the copy's own
+ * units and with the LOD's range mode and center. The matrices of each level
+ * are packed into a texture buffer and every geometry of the level is drawn
+ * once with that many instances. A vertex shader places and lights each copy,
+ * with fixed function style lighting for lights 0-2, and the texture on unit 0
+ * of the model's state is applied.
+ *
+ * Neighbouring copies should be added one after the other so that batches stay
+ * compact. The copies are for drawing only, other visitors do not see them,
+ * and a single camera is assumed since the level buffers are rewritten by every
+ * cull. A texture buffer holds at least 16384 matrices per level.
+ */
+class InstancedLOD : public osg::Group
+{
+public:
+    InstancedLOD( osg::LOD* lod );
+
+    unsigned int addInstance( const osg::Matrix& matrix );
+    void setInstance( unsigned int instance, const osg::Matrix& matrix );
+    unsigned int getNumInstances() const { return _matrices.size(); }
+
+    //copies drawn per level by the last cull
+    unsigned int getNumDrawn( unsigned int level ) const { return _levels[level].count; }
+
+    virtual void traverse( osg::NodeVisitor& nv );
+    virtual osg::BoundingSphere computeBound() const;
+
+protected:
+    virtual ~InstancedLOD() {}
+
+    struct Level {
+        osg::ref_ptr<osg::Group> group;
+        std::vector<osg::Geometry*> geometries;
+        osg::ref_ptr<osg::Image> buffer;
+        osg::ref_ptr<osg::TextureBuffer> texture;
+        float minRange;
+        float maxRange;
+        unsigned int count;
+    };
+
+    void addLevel( osg::Node* node, float minRange, float maxRange, bool textured );
+    void updateBatches();
+    void dirtyInstances();
+
+    std::vector<Level> _levels;
+    osg::BoundingSphere _modelBound;
+    osg::Vec3 _modelCenter;
+    osg::LOD::RangeMode _rangeMode;
+
+    std::vector<osg::Matrixf> _matrices;
+    std::vector<osg::BoundingSphere> _bounds;
+    std::vector<osg::Vec3> _centers; //of the LOD, where distances are measured from
+    std::vector<float> _scales;      //of the matrices, distances are in model units
+    std::vector<osg::BoundingSphere> _batchBounds;
+    bool _batchesDirty;
+};
+
+#endif
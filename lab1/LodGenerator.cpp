@@ -0,0 +1,340 @@
+#include "LodGenerator.h"
+#include "MeshCompactor.h"
+
+#include <osg/Geode>
+#include <osg/Math>
+#include <osg/Transform>
+#include <osg/TriangleFunctor>
+#include <osgUtil/Simplifier>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace {
+
+struct TriangleSink {
+    std::vector<osg::Vec3>* triangles;
+    osg::Matrix matrix;
+
+    void operator()( const osg::Vec3& v1, const osg::Vec3& v2, const osg::Vec3& v3 ) {
+        triangles->push_back(v1 * matrix);
+        triangles->push_back(v2 * matrix);
+        triangles->push_back(v3 * matrix);
+    }
+
+    void operator()( const osg::Vec3& v1, const osg::Vec3& v2, const osg::Vec3& v3, bool ) {
+        (*this)(v1, v2, v3);
+    }
+};
+
+//gathers the triangles of a subgraph in the coordinate system of its top node
+class TriangleCollector : public osg::NodeVisitor
+{
+public:
+    TriangleCollector( std::vector<osg::Vec3>& triangles )
+        : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN),
+          _triangles(triangles)
+    {
+        _matrices.push_back(osg::Matrix::identity());
+    }
+
+    virtual void apply( osg::Transform& transform ) {
+        osg::Matrix matrix = _matrices.back();
+        transform.computeLocalToWorldMatrix(matrix, this);
+        _matrices.push_back(matrix);
+        traverse(transform);
+        _matrices.pop_back();
+    }
+
+    virtual void apply( osg::Geode& geode ) {
+        for ( unsigned int i = 0; i < geode.getNumDrawables(); ++i ) {
+            osg::TriangleFunctor<TriangleSink> functor;
+            functor.triangles = &_triangles;
+            functor.matrix = _matrices.back();
+            geode.getDrawable(i)->accept(functor);
+        }
+    }
+
+protected:
+    std::vector<osg::Vec3>& _triangles;
+    std::vector<osg::Matrix> _matrices;
+};
+
+//closest point to p on triangle abc, from Ericson's Real-Time Collision Detection
+osg::Vec3 closestPoint( const osg::Vec3& p, const osg::Vec3& a, const osg::Vec3& b, const osg::Vec3& c ) {
+    osg::Vec3 ab = b - a;
+    osg::Vec3 ac = c - a;
+    osg::Vec3 ap = p - a;
+    float d1 = ab * ap;
+    float d2 = ac * ap;
+    if ( d1 <= 0.0f && d2 <= 0.0f )
+        return a;
+
+    osg::Vec3 bp = p - b;
+    float d3 = ab * bp;
+    float d4 = ac * bp;
+    if ( d3 >= 0.0f && d4 <= d3 )
+        return b;
+
+    float vc = d1 * d4 - d3 * d2;
+    if ( vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f )
+        return a + ab * (d1 / (d1 - d3));
+
+    osg::Vec3 cp = p - c;
+    float d5 = ab * cp;
+    float d6 = ac * cp;
+    if ( d6 >= 0.0f && d5 <= d6 )
+        return c;
+
+    float vb = d5 * d2 - d1 * d6;
+    if ( vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f )
+        return a + ac * (d2 / (d2 - d6));
+
+    float va = d3 * d6 - d5 * d4;
+    if ( va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f )
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+    float sum = va + vb + vc;
+    if ( sum <= 0.0f )
+        return a;
+    return a + ab * (vb / sum) + ac * (vc / sum);
+}
+
+int cellIndex( const int* dims, int x, int y, int z ) {
+    return (z * dims[1] + y) * dims[0] + x;
+}
+
+/*
+ * Largest distance from a vertex of one triangle soup to the surface of another,
+ * the one sided Hausdorff distance at the vertices. The surface triangles are
+ * binned in a uniform grid and searched in growing shells of cells around each
+ * vertex until no closer triangle can remain.
+ */
+float surfaceDistance( const std::vector<osg::Vec3>& from, const std::vector<osg::Vec3>& to ) {
+    osg::BoundingBox box;
+    for ( size_t i = 0; i < from.size(); ++i )
+        box.expandBy(from[i]);
+    for ( size_t i = 0; i < to.size(); ++i )
+        box.expandBy(to[i]);
+
+    if ( from.empty() )
+        return 0.0f;
+    if ( to.empty() )
+        return (box._max - box._min).length();
+
+    const unsigned int numTriangles = to.size() / 3;
+    const osg::Vec3 extent = box._max - box._min;
+    const float largest = std::max(extent.x(), std::max(extent.y(), extent.z()));
+    float cellSize = std::max(largest / std::max(1.0f, std::cbrt(float(numTriangles))), 1e-6f);
+
+    //the grid has to cover the box even where the cell count is capped
+    int dims[3];
+    for ( int axis = 0; axis < 3; ++axis )
+        dims[axis] = osg::clampBetween(int(std::ceil(extent[axis] / cellSize)), 1, 128);
+    for ( int axis = 0; axis < 3; ++axis )
+        cellSize = std::max(cellSize, extent[axis] / dims[axis]);
+
+    const osg::Vec3 origin = box._min;
+    const int numCells = dims[0] * dims[1] * dims[2];
+
+    int lo[3], hi[3];
+    std::vector<unsigned int> start(numCells + 1, 0);
+    std::vector<unsigned int> entries;
+
+    //count, then fill the triangles of every cell
+    for ( int pass = 0; pass < 2; ++pass ) {
+        for ( unsigned int t = 0; t < numTriangles; ++t ) {
+            osg::BoundingBox tb;
+            tb.expandBy(to[3 * t]);
+            tb.expandBy(to[3 * t + 1]);
+            tb.expandBy(to[3 * t + 2]);
+            for ( int axis = 0; axis < 3; ++axis ) {
+                lo[axis] = osg::clampBetween(int((tb._min[axis] - origin[axis]) / cellSize), 0, dims[axis] - 1);
+                hi[axis] = osg::clampBetween(int((tb._max[axis] - origin[axis]) / cellSize), 0, dims[axis] - 1);
+            }
+            for ( int z = lo[2]; z <= hi[2]; ++z )
+                for ( int y = lo[1]; y <= hi[1]; ++y )
+                    for ( int x = lo[0]; x <= hi[0]; ++x ) {
+                        int cell = cellIndex(dims, x, y, z);
+                        if ( pass == 0 )
+                            ++start[cell + 1];
+                        else
+                            entries[start[cell]++] = t;
+                    }
+        }
+
+        if ( pass == 0 ) {
+            for ( int cell = 0; cell < numCells; ++cell )
+                start[cell + 1] += start[cell];
+            entries.resize(start[numCells]);
+        }
+        else {
+            //filling advanced every start to the next cell
+            for ( int cell = numCells; cell > 0; --cell )
+                start[cell] = start[cell - 1];
+            start[0] = 0;
+        }
+    }
+
+    std::vector<unsigned int> visited(numTriangles, 0);
+    unsigned int stamp = 0;
+    const int maxShell = std::max(dims[0], std::max(dims[1], dims[2]));
+    float worst = 0.0f;
+
+    for ( size_t i = 0; i < from.size(); ++i ) {
+        const osg::Vec3& p = from[i];
+        int c[3];
+        for ( int axis = 0; axis < 3; ++axis )
+            c[axis] = osg::clampBetween(int((p[axis] - origin[axis]) / cellSize), 0, dims[axis] - 1);
+
+        ++stamp;
+        float best = FLT_MAX;
+        for ( int shell = 0; shell <= maxShell; ++shell ) {
+            for ( int z = std::max(c[2] - shell, 0); z <= std::min(c[2] + shell, dims[2] - 1); ++z )
+                for ( int y = std::max(c[1] - shell, 0); y <= std::min(c[1] + shell, dims[1] - 1); ++y )
+                    for ( int x = std::max(c[0] - shell, 0); x <= std::min(c[0] + shell, dims[0] - 1); ++x ) {
+                        if ( std::max(std::abs(x - c[0]), std::max(std::abs(y - c[1]), std::abs(z - c[2]))) != shell )
+                            continue;
+
+                        int cell = cellIndex(dims, x, y, z);
+                        for ( unsigned int e = start[cell]; e < start[cell + 1]; ++e ) {
+                            unsigned int t = entries[e];
+                            if ( visited[t] == stamp )
+                                continue;
+                            visited[t] = stamp;
+                            best = std::min(best, (closestPoint(p, to[3 * t], to[3 * t + 1], to[3 * t + 2]) - p).length2());
+                        }
+                    }
+
+            //everything outside this shell is at least shell cells away
+            if ( best <= osg::square(shell * cellSize) )
+                break;
+        }
+
+        worst = std::max(worst, best);
+    }
+    return std::sqrt(worst);
+}
+
+}
+
+LodGenerator::LodGenerator( unsigned int numThreads )
+    : _numLevels(3),
+      _targetError(0.005f),
+      _triangleBudget(0),
+      _pool(numThreads)
+{
+    setPixelError(1.0f);
+}
+
+void LodGenerator::setPixelError( float pixels, float fovy, float screenHeight ) {
+    //distance at which one model unit covers the given number of pixels
+    float radiansPerPixel = 2.0f * std::tan(osg::DegreesToRadians(fovy) * 0.5f) / screenHeight;
+    _rangePerError = 1.0f / (pixels * radiansPerPixel);
+}
+
+unsigned int LodGenerator::add( osg::Node* model, const std::string& name ) {
+    _models.push_back(Model());
+    Model& entry = _models.back();
+    entry.name = name.empty() ? model->getName() : name;
+    entry.original = model;
+    entry.radius = model->getBound().radius();
+    entry.levels.resize(_numLevels);
+
+    TriangleCollector collector(entry.triangles);
+    model->accept(collector);
+
+    Model* target = &entry;
+    for ( unsigned int level = 0; level < _numLevels; ++level )
+        _pool.run([this, target, level]() { simplify(*target, level); });
+
+    return _models.size() - 1;
+}
+
+void LodGenerator::simplify( Model& model, unsigned int level ) const {
+    Level& result = model.levels[level];
+    result.minRange = result.maxRange = 0.0f;
+
+    if ( level == 0 ) {
+        result.node = model.original;
+        result.numTriangles = model.triangles.size() / 3;
+        result.error = 0.0f;
+        return;
+    }
+
+    //the copy shares state with the original, the simplifier only touches geometry
+    osg::ref_ptr<osg::Node> copy = dynamic_cast<osg::Node*>(model.original->clone(
+            osg::CopyOp(osg::CopyOp::DEEP_COPY_NODES | osg::CopyOp::DEEP_COPY_DRAWABLES |
+                        osg::CopyOp::DEEP_COPY_ARRAYS | osg::CopyOp::DEEP_COPY_PRIMITIVES)));
+
+    //indexed triangles are reordered for the vertex cache below instead of stripped
+    osgUtil::Simplifier simplifier;
+    simplifier.setDoTriStrip(false);
+    if ( _triangleBudget > 0 ) {
+        //even steps in log scale from the original down to the budget
+        float total = std::max(model.triangles.size() / 3, size_t(1));
+        float budget = std::min(float(_triangleBudget) / total, 1.0f);
+        simplifier.setSampleRatio(std::pow(budget, float(level) / (_numLevels - 1)));
+    }
+    else {
+        //collapse edges until the next collapse would exceed the error
+        simplifier.setSampleRatio(0.0f);
+        simplifier.setMaximumError(_targetError * model.radius * float(1u << (level - 1)));
+    }
+    copy->accept(simplifier);
+    MeshCompactor::reorder(copy.get());
+
+    std::vector<osg::Vec3> triangles;
+    TriangleCollector collector(triangles);
+    copy->accept(collector);
+
+    result.node = copy;
+    result.numTriangles = triangles.size() / 3;
+    result.error = surfaceDistance(model.triangles, triangles);
+}
+
+void LodGenerator::buildLOD( Model& model ) const {
+    model.lod = new osg::LOD;
+    model.lod->setRangeMode(osg::LOD::DISTANCE_FROM_EYE_POINT);
+    model.lod->setName(model.name);
+
+    //switch to a level once its error is below the pixel error, coarser levels never switch in earlier
+    float error = 0.0f;
+    for ( size_t i = 0; i < model.levels.size(); ++i ) {
+        Level& level = model.levels[i];
+        error = std::max(error, level.error);
+        level.minRange = i == 0 ? 0.0f : error * _rangePerError;
+        level.maxRange = FLT_MAX;
+        if ( i > 0 )
+            model.levels[i - 1].maxRange = level.minRange;
+    }
+
+    for ( size_t i = 0; i < model.levels.size(); ++i )
+        model.lod->addChild(model.levels[i].node.get(), model.levels[i].minRange, model.levels[i].maxRange);
+}
+
+void LodGenerator::wait() {
+    _pool.wait();
+
+    for ( size_t i = 0; i < _models.size(); ++i ) {
+        if ( !_models[i].lod.valid() )
+            buildLOD(_models[i]);
+    }
+}
+
+void LodGenerator::report( std::ostream& out ) const {
+    for ( size_t i = 0; i < _models.size(); ++i ) {
+        const Model& model = _models[i];
+        out << "LOD chain of '" << model.name << "', radius " << model.radius << std::endl;
+        for ( size_t l = 0; l < model.levels.size(); ++l ) {
+            const Level& level = model.levels[l];
+            out << "  level " << l << ": " << level.numTriangles << " triangles, error " << level.error
+                << ", range " << level.minRange << " - ";
+            if ( level.maxRange < FLT_MAX )
+                out << level.maxRange << std::endl;
+            else
+                out << "inf" << std::endl;
+        }
+    }
+}
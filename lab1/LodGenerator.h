@@ -0,0 +1,85 @@
+#ifndef LODGENERATOR_H
+#define LODGENERATOR_H
+
+#include <osg/LOD>
+
+#include <algorithm>
+#include <deque>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "ThreadPool.h"
+
+/*
+ * Builds LOD chains for loaded models.
+ *
+ * Level 0 is the model itself. Every other level is simplified from a copy of
+ * it, either down to a geometric error or to a share of a triangle budget. All
+ * levels of all added models are simplified at the same time on a thread pool.
+ *
+ * The error of each level is measured after simplification as the largest
+ * distance from an original vertex to the simplified surface. The switch
+ * distances are then chosen so that this error stays below the pixel error on
+ * screen.
+ */
+class LodGenerator
+{
+public:
+    struct Level {
+        osg::ref_ptr<osg::Node> node;
+        unsigned int numTriangles;
+        float error;    //measured, in model units
+        float minRange;
+        float maxRange;
+    };
+
+    LodGenerator( unsigned int numThreads = 0 );
+
+    //levels including the original, at least 2
+    void setNumLevels( unsigned int numLevels ) { _numLevels = std::max(numLevels, 2u); }
+
+    //error of the first simplified level as a fraction of the bounding radius, it doubles for every level
+    void setTargetError( float fraction ) { _targetError = fraction; _triangleBudget = 0; }
+
+    //triangles of the coarsest level, the levels in between are spaced evenly in log scale
+    void setTriangleBudget( unsigned int triangles ) { _triangleBudget = triangles; }
+
+    //on screen tolerance the ranges are computed for
+    void setPixelError( float pixels, float fovy = 60.0f, float screenHeight = 1080.0f );
+
+    //queue the levels of model, returns its index
+    unsigned int add( osg::Node* model, const std::string& name = "" );
+
+    //block until every queued level is done and build the LOD nodes
+    void wait();
+
+    osg::LOD* getLOD( unsigned int model ) const { return _models[model].lod.get(); }
+    const std::vector<Level>& getLevels( unsigned int model ) const { return _models[model].levels; }
+
+    //triangle count, error and range of every level
+    void report( std::ostream& out ) const;
+
+protected:
+    struct Model {
+        std::string name;
+        osg::ref_ptr<osg::Node> original;
+        std::vector<osg::Vec3> triangles; //three vertices per triangle
+        float radius;
+        std::vector<Level> levels;
+        osg::ref_ptr<osg::LOD> lod;
+    };
+
+    void simplify( Model& model, unsigned int level ) const;
+    void buildLOD( Model& model ) const;
+
+    unsigned int _numLevels;
+    float _targetError;
+    unsigned int _triangleBudget;
+    float _rangePerError; //switch distance per model unit of error
+
+    std::deque<Model> _models;
+    ThreadPool _pool;
+};
+
+#endif
@@ -0,0 +1,140 @@
+#include "MeshCompactor.h"
+
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/TriangleIndexFunctor>
+#include <osgUtil/Optimizer>
+
+#include <algorithm>
+#include <climits>
+
+namespace {
+
+//post-transform cache of a typical GPU, replaced first in first out
+struct VertexCache {
+    static const unsigned int SIZE = 32;
+
+    unsigned int entries[SIZE];
+    unsigned int next;
+    unsigned int misses;
+    unsigned int triangles;
+
+    VertexCache() : next(0), misses(0), triangles(0) {
+        std::fill(entries, entries + SIZE, UINT_MAX);
+    }
+
+    void operator()( unsigned int a, unsigned int b, unsigned int c ) {
+        use(a);
+        use(b);
+        use(c);
+        ++triangles;
+    }
+
+    void use( unsigned int index ) {
+        if ( std::find(entries, entries + SIZE, index) != entries + SIZE )
+            return;
+        entries[next] = index;
+        next = (next + 1) % SIZE;
+        ++misses;
+    }
+};
+
+class StatsVisitor : public osg::NodeVisitor
+{
+public:
+    StatsVisitor( MeshCompactor::Stats& stats )
+        : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN),
+          _stats(stats)
+    {}
+
+    virtual void apply( osg::Geode& geode ) {
+        for ( unsigned int i = 0; i < geode.getNumDrawables(); ++i ) {
+            osg::Geometry* geometry = geode.getDrawable(i)->asGeometry();
+            if ( !geometry || !geometry->getVertexArray() )
+                continue;
+
+            osg::TriangleIndexFunctor<VertexCache> cache;
+            geometry->accept(cache);
+
+            ++_stats.geometries;
+            _stats.drawCalls += geometry->getNumPrimitiveSets();
+            _stats.vertices += geometry->getVertexArray()->getNumElements();
+            _stats.triangles += cache.triangles;
+            _stats.transformed += cache.misses;
+        }
+    }
+
+protected:
+    MeshCompactor::Stats& _stats;
+};
+
+//osg puts all arrays of a geometry without a buffer object into one new one
+class BufferVisitor : public osg::NodeVisitor
+{
+public:
+    BufferVisitor() : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN) {}
+
+    virtual void apply( osg::Geode& geode ) {
+        for ( unsigned int i = 0; i < geode.getNumDrawables(); ++i ) {
+            osg::Geometry* geometry = geode.getDrawable(i)->asGeometry();
+            if ( !geometry )
+                continue;
+            geometry->setUseDisplayList(false);
+            geometry->setUseVertexBufferObjects(true);
+        }
+    }
+};
+
+}
+
+void MeshCompactor::measure( osg::Node* node, Stats& stats ) {
+    if ( !node )
+        return;
+    StatsVisitor visitor(stats);
+    node->accept(visitor);
+}
+
+void MeshCompactor::compact( osg::Node* node, const std::string& name ) {
+    if ( !node )
+        return;
+
+    Model model;
+    model.name = name;
+    measure(node, model.before);
+
+    //merging needs shared, static state
+    osgUtil::Optimizer optimizer;
+    optimizer.optimize(node, osgUtil::Optimizer::SHARE_DUPLICATE_STATE |
+                             osgUtil::Optimizer::STATIC_OBJECT_DETECTION |
+                             osgUtil::Optimizer::CHECK_GEOMETRY |
+                             osgUtil::Optimizer::MERGE_GEODES |
+                             osgUtil::Optimizer::MERGE_GEOMETRY);
+    reorder(node);
+
+    measure(node, model.after);
+    _models.push_back(model);
+}
+
+void MeshCompactor::reorder( osg::Node* node ) {
+    //indexing comes before the two reorderings
+    osgUtil::Optimizer optimizer;
+    optimizer.optimize(node, osgUtil::Optimizer::INDEX_MESH |
+                             osgUtil::Optimizer::VERTEX_POSTTRANSFORM |
+                             osgUtil::Optimizer::VERTEX_PRETRANSFORM);
+
+    BufferVisitor buffers;
+    node->accept(buffers);
+}
+
+void MeshCompactor::report( std::ostream& out ) const {
+    for ( size_t i = 0; i < _models.size(); ++i ) {
+        const Model& model = _models[i];
+        out << "Compacted '" << model.name << "': "
+            << model.before.drawCalls << " -> " << model.after.drawCalls << " draw calls in "
+            << model.before.geometries << " -> " << model.after.geometries << " geometries, "
+            << model.before.vertices << " -> " << model.after.vertices << " vertices, "
+            << model.after.triangles << " triangles, "
+            << model.before.transformed << " -> " << model.after.transformed << " transformed (ACMR "
+            << model.before.acmr() << " -> " << model.after.acmr() << ")" << std::endl;
+    }
+}
@@ -0,0 +1,166 @@
+#include "SensorLines.h"
+
+#include <algorithm>
+
+namespace {
+
+const float NO_HIT = 2.0f;
+
+//collects the transforms of a subtree, including its top node
+class TransformCollector : public osg::NodeVisitor
+{
+public:
+    TransformCollector( std::vector< osg::ref_ptr<osg::Transform> >& transforms )
+        : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN),
+          _transforms(transforms) {}
+
+    virtual void apply( osg::Transform& transform ) {
+        _transforms.push_back(&transform);
+        traverse(transform);
+    }
+
+protected:
+    std::vector< osg::ref_ptr<osg::Transform> >& _transforms;
+};
+
+osg::Matrix localMatrix( const osg::Transform* transform ) {
+    osg::Matrix matrix;
+    transform->computeLocalToWorldMatrix(matrix, 0);
+    return matrix;
+}
+
+//true if the segment passes through the sphere
+bool segmentHitsSphere( const osg::Vec3& start, const osg::Vec3& end, const osg::BoundingSphere& sphere ) {
+    if ( !sphere.valid() )
+        return false;
+
+    osg::Vec3 dir = end - start;
+    float length2 = dir.length2();
+    float t = length2 > 0.0f ? ((sphere.center() - start) * dir) / length2 : 0.0f;
+    t = std::min(std::max(t, 0.0f), 1.0f);
+
+    osg::Vec3 closest = start + dir * t;
+    return (closest - sphere.center()).length2() <= sphere.radius() * sphere.radius();
+}
+
+}
+
+SensorLines::SensorLines( osg::Node::NodeMask traversalMask )
+    : _traversalMask(traversalMask),
+      _numRetested(0),
+      _group(new osgUtil::IntersectorGroup)
+{
+    _visitor.setIntersector(_group.get());
+    _visitor.setTraversalMask(_traversalMask);
+}
+
+unsigned int SensorLines::addLine( const osg::Vec3& start, const osg::Vec3& end ) {
+    _starts.push_back(start);
+    _ends.push_back(end);
+    _ratios.push_back(NO_HIT);
+
+    osg::ref_ptr<osgUtil::LineSegmentIntersector> intersector = new osgUtil::LineSegmentIntersector(start, end);
+    intersector->setIntersectionLimit(osgUtil::Intersector::LIMIT_NEAREST);
+    _intersectors.push_back(intersector);
+    _group->addIntersector(intersector.get());
+
+    //the cached hits do not cover the new line
+    dirty();
+    return _starts.size() - 1;
+}
+
+void SensorLines::dirty( osg::Node* child ) {
+    for ( size_t i = 0; i < _entries.size(); ++i ) {
+        if ( !child || _entries[i].node == child )
+            _entries[i].valid = false;
+    }
+}
+
+void SensorLines::rebuild( osg::Group* root ) {
+    std::vector<Entry> entries(root->getNumChildren());
+
+    //keep the cache of children that are still in place
+    for ( unsigned int i = 0; i < entries.size(); ++i ) {
+        if ( _root.get() == root && i < _entries.size() && _entries[i].node == root->getChild(i) )
+            std::swap(entries[i], _entries[i]);
+        else {
+            entries[i].node = root->getChild(i);
+            entries[i].valid = false;
+        }
+    }
+
+    _entries.swap(entries);
+    _root = root;
+}
+
+bool SensorLines::changed( const Entry& entry ) const {
+    if ( entry.nodeMask != entry.node->getNodeMask() )
+        return true;
+
+    const osg::BoundingSphere& bound = entry.node->getBound();
+    if ( bound.center() != entry.bound.center() || bound.radius() != entry.bound.radius() )
+        return true;
+
+    for ( size_t i = 0; i < entry.transforms.size(); ++i ) {
+        if ( localMatrix(entry.transforms[i].get()) != entry.matrices[i] )
+            return true;
+    }
+    return false;
+}
+
+void SensorLines::retest( Entry& entry ) {
+    //record the state the hits belong to
+    entry.nodeMask = entry.node->getNodeMask();
+    entry.bound = entry.node->getBound();
+
+    entry.transforms.clear();
+    TransformCollector collector(entry.transforms);
+    entry.node->accept(collector);
+
+    entry.matrices.resize(entry.transforms.size());
+    for ( size_t i = 0; i < entry.transforms.size(); ++i )
+        entry.matrices[i] = localMatrix(entry.transforms[i].get());
+
+    entry.ratios.assign(_starts.size(), NO_HIT);
+    entry.valid = true;
+
+    //lines that miss the bound cannot hit anything below it
+    bool anyNear = false;
+    for ( size_t i = 0; i < _starts.size(); ++i )
+        anyNear = anyNear || segmentHitsSphere(_starts[i], _ends[i], entry.bound);
+
+    if ( !anyNear || (entry.nodeMask & _traversalMask) == 0 )
+        return;
+
+    //one traversal for all lines
+    _group->reset();
+    _visitor.reset();
+    entry.node->accept(_visitor);
+
+    for ( size_t i = 0; i < _intersectors.size(); ++i ) {
+        if ( _intersectors[i]->containsIntersections() )
+            entry.ratios[i] = _intersectors[i]->getFirstIntersection().ratio;
+    }
+}
+
+void SensorLines::update( osg::Group* root ) {
+    if ( !root )
+        return;
+
+    if ( _root.get() != root || _entries.size() != root->getNumChildren() )
+        rebuild(root);
+
+    _numRetested = 0;
+    std::fill(_ratios.begin(), _ratios.end(), NO_HIT);
+
+    for ( size_t i = 0; i < _entries.size(); ++i ) {
+        Entry& entry = _entries[i];
+        if ( !entry.valid || changed(entry) ) {
+            retest(entry);
+            ++_numRetested;
+        }
+
+        for ( size_t l = 0; l < _ratios.size(); ++l )
+            _ratios[l] = std::min(_ratios[l], entry.ratios[l]);
+    }
+}
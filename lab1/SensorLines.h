@@ -0,0 +1,77 @@
+#ifndef SENSORLINES_H
+#define SENSORLINES_H
+
+#include <osg/Group>
+#include <osg/observer_ptr>
+#include <osg/Transform>
+#include <osgUtil/IntersectionVisitor>
+#include <osgUtil/LineSegmentIntersector>
+
+#include <vector>
+
+/*
+ * Constant line segments that are intersected against a scene incrementally.
+ *
+ * Every child of the root is a unit of caching. A child is only intersected
+ * again when its node mask, its bound or the matrix of a Transform inside it
+ * changed since the last update, otherwise the hits cached for it are reused.
+ * All lines are tested in one traversal of a changed child. Changes that keep
+ * all of these intact, such as editing vertices in place, must be reported
+ * with dirty().
+ */
+class SensorLines : public osg::Referenced
+{
+public:
+    SensorLines( osg::Node::NodeMask traversalMask = ~0u );
+
+    unsigned int addLine( const osg::Vec3& start, const osg::Vec3& end );
+    unsigned int getNumLines() const { return _starts.size(); }
+    const osg::Vec3& getStart( unsigned int line ) const { return _starts[line]; }
+    const osg::Vec3& getEnd( unsigned int line ) const { return _ends[line]; }
+
+    //re-test the children of root that changed, the child list is rebuilt when its size changes
+    void update( osg::Group* root );
+
+    //nearest hit over all children, ratio is the fraction of the line
+    bool hasHit( unsigned int line ) const { return _ratios[line] <= 1.0f; }
+    float getRatio( unsigned int line ) const { return _ratios[line]; }
+
+    //drop the cached hits of child, or of every child
+    void dirty( osg::Node* child = 0 );
+
+    //number of children intersected by the last update
+    unsigned int getNumRetested() const { return _numRetested; }
+
+protected:
+    virtual ~SensorLines() {}
+
+    struct Entry {
+        osg::ref_ptr<osg::Node> node;
+        osg::Node::NodeMask nodeMask;
+        osg::BoundingSphere bound;
+        std::vector< osg::ref_ptr<osg::Transform> > transforms;
+        std::vector<osg::Matrix> matrices;
+        std::vector<float> ratios; //per line, > 1 without a hit
+        bool valid;
+    };
+
+    void rebuild( osg::Group* root );
+    bool changed( const Entry& entry ) const;
+    void retest( Entry& entry );
+
+    osg::Node::NodeMask _traversalMask;
+    std::vector<osg::Vec3> _starts;
+    std::vector<osg::Vec3> _ends;
+    std::vector<float> _ratios;
+
+    osg::observer_ptr<osg::Group> _root;
+    std::vector<Entry> _entries;
+    unsigned int _numRetested;
+
+    //reused by every retest
+    std::vector< osg::ref_ptr<osgUtil::LineSegmentIntersector> > _intersectors;
+    osg::ref_ptr<osgUtil::IntersectorGroup> _group;
+    osgUtil::IntersectionVisitor _visitor;
+};
+
+#endif
@@ -0,0 +1,309 @@
+#include "Terrain.h"
+
+#include <osg/Geometry>
+#include <osg/Math>
+#include <osgUtil/CullVisitor>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+TerrainChunk::TerrainChunk()
+    : _geometricError(0.0f),
+      _pixelError(2.0f)
+{
+}
+
+TerrainChunk::TerrainChunk( const TerrainChunk& chunk, const osg::CopyOp& copyop )
+    : osg::Group(chunk, copyop),
+      _geometricError(chunk._geometricError),
+      _pixelError(chunk._pixelError),
+      _bb(chunk._bb)
+{
+}
+
+void TerrainChunk::setMesh( osg::Geode* mesh ) {
+    if ( getNumChildren() > 0 && getChild(0)->asGeode() )
+        setChild(0, mesh);
+    else
+        insertChild(0, mesh);
+}
+
+osg::Geode* TerrainChunk::getMesh() {
+    return getNumChildren() > 0 ? getChild(0)->asGeode() : NULL;
+}
+
+void TerrainChunk::addChunk( TerrainChunk* chunk ) {
+    addChild(chunk);
+}
+
+void TerrainChunk::traverse( osg::NodeVisitor& nv ) {
+    if ( getNumChildren() == 0 )
+        return;
+
+    //optimizer, compile and release visitors need every level
+    if ( nv.getTraversalMode() == osg::NodeVisitor::TRAVERSE_ALL_CHILDREN ) {
+        osg::Group::traverse(nv);
+        return;
+    }
+
+    bool refine = getNumChunks() > 0;
+
+    if ( refine && nv.getVisitorType() == osg::NodeVisitor::CULL_VISITOR ) {
+        osgUtil::CullVisitor* cv = static_cast<osgUtil::CullVisitor*>(&nv);
+
+        //distance from the eye to the closest point of the chunk
+        osg::Vec3 eye = cv->getEyeLocal();
+        osg::Vec3 closest( osg::clampBetween(eye.x(), _bb.xMin(), _bb.xMax()),
+                           osg::clampBetween(eye.y(), _bb.yMin(), _bb.yMax()),
+                           osg::clampBetween(eye.z(), _bb.zMin(), _bb.zMax()) );
+        float distance = (eye - closest).length() * cv->getLODScale();
+
+        //pixels covered by one unit at distance one
+        const osg::RefMatrix* projection = cv->getProjectionMatrix();
+        const osg::Viewport* viewport = cv->getViewport();
+        float pixelsPerUnit = 0.5f * (viewport ? viewport->height() : 1.0f) * (*projection)(1,1);
+
+        float screenError;
+        if ( (*projection)(3,3) != 0.0 ) //orthographic
+            screenError = _geometricError * pixelsPerUnit;
+        else if ( distance > 0.0f )
+            screenError = _geometricError * pixelsPerUnit / distance;
+        else
+            screenError = _pixelError + 1.0f;
+
+        refine = screenError > _pixelError;
+    }
+
+    if ( refine ) {
+        //other visitors (intersections etc) only see the full resolution leaves
+        for ( unsigned int i = 1; i < getNumChildren(); ++i )
+            _children[i]->accept(nv);
+    }
+    else {
+        _children[0]->accept(nv);
+    }
+}
+
+/***********************************************************************************************************
+*                                     BUILDER
+**********************************************************************************************************/
+
+namespace {
+
+struct ChunkRegion {
+    TerrainChunk* chunk;
+    unsigned int c0, r0, c1, r1;
+    unsigned int stride;
+};
+
+//sample indices from first to last with the given stride, last is always included
+std::vector<unsigned int> sampleIndices( unsigned int first, unsigned int last, unsigned int stride ) {
+    std::vector<unsigned int> indices;
+    for ( unsigned int i = first; i < last; i += stride )
+        indices.push_back(i);
+    indices.push_back(last);
+    return indices;
+}
+
+class ChunkBuilder
+{
+public:
+    ChunkBuilder( osg::HeightField* field, unsigned int chunkSize, float pixelError, bool skirtOuterEdges )
+        : _field(field),
+          _chunkSize(chunkSize),
+          _pixelError(pixelError),
+          _skirtOuterEdges(skirtOuterEdges),
+          _lastCol(field->getNumColumns() - 1),
+          _lastRow(field->getNumRows() - 1)
+    {
+    }
+
+    osg::ref_ptr<TerrainChunk> build() {
+        //smallest power of two stride that lets one chunk cover the whole field
+        unsigned int stride = 1;
+        while ( stride * _chunkSize < std::max(_lastCol, _lastRow) )
+            stride *= 2;
+
+        osg::ref_ptr<TerrainChunk> root = buildChunk(0, 0, stride);
+
+        //skirts only need to hide the largest error a neighbour can have
+        float skirtDepth = root->getGeometricError() + std::max(_field->getXInterval(), _field->getYInterval());
+        for ( size_t i = 0; i < _regions.size(); ++i )
+            _regions[i].chunk->setMesh(buildMesh(_regions[i], skirtDepth));
+
+        return root;
+    }
+
+private:
+    float height( unsigned int c, unsigned int r ) const {
+        return _field->getHeight(c, r);
+    }
+
+    TerrainChunk* buildChunk( unsigned int c0, unsigned int r0, unsigned int stride ) {
+        ChunkRegion region;
+        region.chunk = new TerrainChunk();
+        region.c0 = c0;
+        region.r0 = r0;
+        region.c1 = std::min(c0 + _chunkSize * stride, _lastCol);
+        region.r1 = std::min(r0 + _chunkSize * stride, _lastRow);
+        region.stride = stride;
+
+        region.chunk->setPixelError(_pixelError);
+        float error = computeError(region);
+
+        if ( stride > 1 ) {
+            unsigned int half = _chunkSize * stride / 2;
+            for ( unsigned int r = r0; r < region.r1; r += half ) {
+                for ( unsigned int c = c0; c < region.c1; c += half ) {
+                    TerrainChunk* child = buildChunk(c, r, stride / 2);
+                    region.chunk->addChunk(child);
+                    //keep errors monotonic so refinement never gets coarser
+                    error = std::max(error, child->getGeometricError());
+                }
+            }
+        }
+
+        region.chunk->setGeometricError(error);
+        _regions.push_back(region);
+        return region.chunk;
+    }
+
+    //max distance between the full resolution samples and the triangles of the chunk mesh
+    float computeError( const ChunkRegion& region ) const {
+        if ( region.stride == 1 )
+            return 0.0f;
+
+        std::vector<unsigned int> cols = sampleIndices(region.c0, region.c1, region.stride);
+        std::vector<unsigned int> rows = sampleIndices(region.r0, region.r1, region.stride);
+
+        float error = 0.0f;
+        for ( size_t j = 0; j + 1 < rows.size(); ++j ) {
+            for ( size_t i = 0; i + 1 < cols.size(); ++i ) {
+                unsigned int ca = cols[i], cb = cols[i + 1];
+                unsigned int ra = rows[j], rb = rows[j + 1];
+                float h00 = height(ca, ra), h10 = height(cb, ra);
+                float h01 = height(ca, rb), h11 = height(cb, rb);
+
+                for ( unsigned int r = ra; r <= rb; ++r ) {
+                    float v = float(r - ra) / float(rb - ra);
+                    for ( unsigned int c = ca; c <= cb; ++c ) {
+                        float u = float(c - ca) / float(cb - ca);
+                        //same diagonal split as buildMesh
+                        float h = ( u >= v ) ? h00 + u * (h10 - h00) + v * (h11 - h10)
+                                             : h00 + v * (h01 - h00) + u * (h11 - h01);
+                        error = std::max(error, std::fabs(h - height(c, r)));
+                    }
+                }
+            }
+        }
+        return error;
+    }
+
+    osg::Geode* buildMesh( const ChunkRegion& region, float skirtDepth ) {
+        std::vector<unsigned int> cols = sampleIndices(region.c0, region.c1, region.stride);
+        std::vector<unsigned int> rows = sampleIndices(region.r0, region.r1, region.stride);
+        const unsigned int nc = cols.size();
+        const unsigned int nr = rows.size();
+
+        osg::ref_ptr<osg::Vec3Array> vertices = new osg::Vec3Array();
+        osg::ref_ptr<osg::Vec3Array> normals = new osg::Vec3Array();
+        osg::ref_ptr<osg::Vec2Array> texcoords = new osg::Vec2Array();
+        const unsigned int maxVertices = nc * nr + 2 * (nc + nr);
+        vertices->reserve(maxVertices);
+        normals->reserve(maxVertices);
+        texcoords->reserve(maxVertices);
+
+        const osg::Vec3& origin = _field->getOrigin();
+        osg::BoundingBox bb;
+
+        for ( unsigned int j = 0; j < nr; ++j ) {
+            for ( unsigned int i = 0; i < nc; ++i ) {
+                unsigned int c = cols[i], r = rows[j];
+                osg::Vec3 v = origin + osg::Vec3(c * _field->getXInterval(), r * _field->getYInterval(), height(c, r));
+                vertices->push_back(v);
+                normals->push_back(_field->getNormal(c, r));
+                texcoords->push_back(osg::Vec2(float(c) / _lastCol, float(r) / _lastRow));
+                bb.expandBy(v);
+            }
+        }
+
+        bool useInts = maxVertices > 0xffff;
+        osg::ref_ptr<osg::DrawElements> triangles;
+        if ( useInts )
+            triangles = new osg::DrawElementsUInt(osg::PrimitiveSet::TRIANGLES);
+        else
+            triangles = new osg::DrawElementsUShort(osg::PrimitiveSet::TRIANGLES);
+        triangles->reserveElements((nc - 1) * (nr - 1) * 6 + 4 * (nc + nr) * 6);
+
+        for ( unsigned int j = 0; j + 1 < nr; ++j ) {
+            for ( unsigned int i = 0; i + 1 < nc; ++i ) {
+                unsigned int v00 = j * nc + i;
+                unsigned int v10 = v00 + 1;
+                unsigned int v01 = v00 + nc;
+                unsigned int v11 = v01 + 1;
+                triangles->addElement(v00); triangles->addElement(v10); triangles->addElement(v11);
+                triangles->addElement(v00); triangles->addElement(v11); triangles->addElement(v01);
+            }
+        }
+
+        //skirts along the borders that face another chunk
+        if ( _skirtOuterEdges || region.r0 > 0 )
+            addSkirt(*vertices, *normals, *texcoords, *triangles, 0, 1, nc, skirtDepth);
+        if ( _skirtOuterEdges || region.r1 < _lastRow )
+            addSkirt(*vertices, *normals, *texcoords, *triangles, (nr - 1) * nc, 1, nc, skirtDepth);
+        if ( _skirtOuterEdges || region.c0 > 0 )
+            addSkirt(*vertices, *normals, *texcoords, *triangles, 0, nc, nr, skirtDepth);
+        if ( _skirtOuterEdges || region.c1 < _lastCol )
+            addSkirt(*vertices, *normals, *texcoords, *triangles, nc - 1, nc, nr, skirtDepth);
+
+        osg::ref_ptr<osg::Geometry> geometry = new osg::Geometry();
+        geometry->setUseDisplayList(false);
+        geometry->setUseVertexBufferObjects(true);
+        geometry->setVertexArray(vertices);
+        geometry->setNormalArray(normals, osg::Array::BIND_PER_VERTEX);
+        geometry->setTexCoordArray(0, texcoords);
+        geometry->addPrimitiveSet(triangles);
+
+        osg::Geode* geode = new osg::Geode();
+        geode->addDrawable(geometry);
+
+        region.chunk->setBoundingBox(bb);
+        return geode;
+    }
+
+    //hang a vertical strip below count edge vertices starting at first
+    void addSkirt( osg::Vec3Array& vertices, osg::Vec3Array& normals, osg::Vec2Array& texcoords,
+                   osg::DrawElements& triangles, unsigned int first, unsigned int step,
+                   unsigned int count, float depth ) {
+        unsigned int base = vertices.size();
+        for ( unsigned int k = 0; k < count; ++k ) {
+            unsigned int top = first + k * step;
+            vertices.push_back(vertices[top] - osg::Vec3(0.0f, 0.0f, depth));
+            normals.push_back(normals[top]);
+            texcoords.push_back(texcoords[top]);
+        }
+        for ( unsigned int k = 0; k + 1 < count; ++k ) {
+            unsigned int a = first + k * step;
+            unsigned int b = a + step;
+            triangles.addElement(a); triangles.addElement(base + k); triangles.addElement(base + k + 1);
+            triangles.addElement(a); triangles.addElement(base + k + 1); triangles.addElement(b);
+        }
+    }
+
+    osg::HeightField* _field;
+    unsigned int _chunkSize;
+    float _pixelError;
+    bool _skirtOuterEdges;
+    unsigned int _lastCol;
+    unsigned int _lastRow;
+    std::vector<ChunkRegion> _regions;
+};
+
+}
+
+osg::ref_ptr<TerrainChunk> createTerrain( osg::HeightField* field, unsigned int chunkSize, float pixelError,
+                                          bool skirtOuterEdges ) {
+    ChunkBuilder builder(field, std::max(chunkSize, 2u), pixelError, skirtOuterEdges);
+    return builder.build();
+}
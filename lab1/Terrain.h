@@ -0,0 +1,59 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <osg/Group>
+#include <osg/Geode>
+#include <osg/Shape>
+#include <osg/BoundingBox>
+
+/*
+ * Chunked LOD terrain.
+ *
+ * The height field is split into a quadtree of chunks that all share the same
+ * vertex budget, a chunk covering a larger area simply samples the field with a
+ * larger stride (a geomipmap level). During cull the tree is refined until the
+ * projected geometric error of a chunk drops below a pixel tolerance. Every
+ * chunk carries a skirt along its borders so neighbouring chunks at different
+ * levels meet without cracks.
+ */
+class TerrainChunk : public osg::Group
+{
+public:
+    TerrainChunk();
+    TerrainChunk( const TerrainChunk& chunk, const osg::CopyOp& copyop = osg::CopyOp::SHALLOW_COPY );
+
+    META_Node( lab, TerrainChunk );
+
+    //the mesh is always child 0, refined chunks (if any) follow
+    void setMesh( osg::Geode* mesh );
+    osg::Geode* getMesh();
+    void addChunk( TerrainChunk* chunk );
+    unsigned int getNumChunks() const { return getNumChildren() > 0 ? getNumChildren() - 1 : 0; }
+
+    //max vertical distance between the mesh and the full resolution field
+    void setGeometricError( float error ) { _geometricError = error; }
+    float getGeometricError() const { return _geometricError; }
+
+    //screen space error (in pixels) that is accepted before refining
+    void setPixelError( float pixels ) { _pixelError = pixels; }
+    float getPixelError() const { return _pixelError; }
+
+    void setBoundingBox( const osg::BoundingBox& bb ) { _bb = bb; }
+    const osg::BoundingBox& getBoundingBox() const { return _bb; }
+
+    virtual void traverse( osg::NodeVisitor& nv );
+
+protected:
+    virtual ~TerrainChunk() {}
+
+    float _geometricError;
+    float _pixelError;
+    osg::BoundingBox _bb;
+};
+
+//build the chunk quadtree for a field, chunkSize is the number of cells along a chunk side.
+//skirtOuterEdges also hangs skirts on the field border, for fields that are tiles of a larger terrain
+osg::ref_ptr<TerrainChunk> createTerrain( osg::HeightField* field, unsigned int chunkSize = 64, float pixelError = 2.0f,
+                                          bool skirtOuterEdges = false );
+
+#endif
@@ -0,0 +1,233 @@
+#include "TerrainPager.h"
+#include "Terrain.h"
+
+#include <osg/Notify>
+#include <osgUtil/CullVisitor>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+RawTerrainSource::RawTerrainSource( const std::string& fileName, unsigned int numColumns, unsigned int numRows,
+                                    float scale, float offset )
+    : _fileName(fileName),
+      _numColumns(numColumns),
+      _numRows(numRows),
+      _scale(scale / 65535.0f),
+      _offset(offset)
+{
+}
+
+bool RawTerrainSource::read( osg::HeightField* field, unsigned int c0, unsigned int r0 ) const {
+    std::ifstream file(_fileName.c_str(), std::ios::in | std::ios::binary);
+    if ( !file )
+        return false;
+
+    const unsigned int numColumns = field->getNumColumns();
+    std::vector<unsigned char> row(numColumns * 2);
+    float* heights = &(*field->getFloatArray())[0];
+
+    for ( unsigned int r = 0; r < field->getNumRows(); ++r ) {
+        std::streamoff offset = (std::streamoff(r0 + r) * _numColumns + c0) * 2;
+        file.seekg(offset);
+        if ( !file.read(reinterpret_cast<char*>(&row[0]), row.size()) )
+            return false;
+
+        float* dst = heights + r * numColumns;
+        for ( unsigned int c = 0; c < numColumns; ++c )
+            dst[c] = (row[2 * c] | (row[2 * c + 1] << 8)) * _scale + _offset;
+    }
+    return true;
+}
+
+TerrainPager::TerrainPager( TerrainSource* source, const osg::Vec3& origin, float intervalX, float intervalY,
+                            unsigned int tileSize )
+    : _source(source),
+      _origin(origin),
+      _intervalX(intervalX),
+      _intervalY(intervalY),
+      _tileSize(std::max(tileSize, 2u)),
+      _loadRadius(1000.0f),
+      _memoryBudget(256 * 1024 * 1024),
+      _pixelError(2.0f),
+      _followCamera(true),
+      _done(false)
+{
+    _numTilesX = (source->getNumColumns() - 1 + _tileSize - 1) / _tileSize;
+    _numTilesY = (source->getNumRows() - 1 + _tileSize - 1) / _tileSize;
+
+    //heights plus position, normal and texcoord for the chunk pyramid (about 4/3 of a full level)
+    size_t samples = size_t(_tileSize + 1) * (_tileSize + 1);
+    _tileBytes = samples * sizeof(float) + samples * 4 / 3 * (2 * sizeof(osg::Vec3) + sizeof(osg::Vec2));
+
+    //tiles are swapped in during the update traversal
+    setNumChildrenRequiringUpdateTraversal(1);
+
+    //the tiles have no valid bound until they are loaded
+    setCullingActive(false);
+
+    _thread = std::thread(&TerrainPager::run, this);
+}
+
+TerrainPager::~TerrainPager() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _done = true;
+    }
+    _wake.notify_all();
+    _thread.join();
+}
+
+void TerrainPager::setFocus( const osg::Vec3& focus ) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _focus = focus;
+    _followCamera = false;
+}
+
+void TerrainPager::traverse( osg::NodeVisitor& nv ) {
+    if ( nv.getVisitorType() == osg::NodeVisitor::UPDATE_VISITOR ) {
+        updateTiles();
+    }
+    else if ( _followCamera && nv.getVisitorType() == osg::NodeVisitor::CULL_VISITOR ) {
+        osgUtil::CullVisitor* cv = static_cast<osgUtil::CullVisitor*>(&nv);
+        std::lock_guard<std::mutex> lock(_mutex);
+        _focus = cv->getEyeLocal();
+    }
+
+    osg::Group::traverse(nv);
+}
+
+float TerrainPager::distanceToTile( unsigned int key, const osg::Vec3& point ) const {
+    float x0 = _origin.x() + (key % _numTilesX) * _tileSize * _intervalX;
+    float y0 = _origin.y() + (key / _numTilesX) * _tileSize * _intervalY;
+    float dx = std::max(0.0f, std::max(x0 - point.x(), point.x() - (x0 + _tileSize * _intervalX)));
+    float dy = std::max(0.0f, std::max(y0 - point.y(), point.y() - (y0 + _tileSize * _intervalY)));
+    return std::sqrt(dx * dx + dy * dy);
+}
+
+void TerrainPager::updateTiles() {
+    std::vector<Tile> completed;
+    osg::Vec3 focus;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        completed.swap(_completed);
+        focus = _focus;
+    }
+
+    //nearest tiles inside the load radius that fit in the budget
+    std::vector<std::pair<float, unsigned int> > candidates;
+    int cx = int((focus.x() - _origin.x()) / (_tileSize * _intervalX));
+    int cy = int((focus.y() - _origin.y()) / (_tileSize * _intervalY));
+    int rx = int(_loadRadius / (_tileSize * _intervalX)) + 1;
+    int ry = int(_loadRadius / (_tileSize * _intervalY)) + 1;
+
+    for ( int ty = std::max(0, cy - ry); ty <= std::min(int(_numTilesY) - 1, cy + ry); ++ty ) {
+        for ( int tx = std::max(0, cx - rx); tx <= std::min(int(_numTilesX) - 1, cx + rx); ++tx ) {
+            unsigned int key = ty * _numTilesX + tx;
+            float distance = distanceToTile(key, focus);
+            if ( distance <= _loadRadius )
+                candidates.push_back(std::make_pair(distance, key));
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+    candidates.resize(std::min(candidates.size(), std::max<size_t>(1, _memoryBudget / _tileBytes)));
+
+    std::set<unsigned int> wanted;
+    for ( size_t i = 0; i < candidates.size(); ++i )
+        wanted.insert(candidates[i].second);
+
+    //swap in finished tiles that are still wanted
+    for ( size_t i = 0; i < completed.size(); ++i ) {
+        const Tile& tile = completed[i];
+        if ( !tile.node.valid() )
+            _failed.insert(tile.key);
+        if ( _pending.erase(tile.key) == 0 || !wanted.count(tile.key) || !tile.node.valid() )
+            continue;
+        _resident[tile.key] = tile.node;
+        addChild(tile.node.get());
+    }
+
+    //evict tiles that fell out of range or budget
+    for ( std::map<unsigned int, osg::ref_ptr<osg::Node> >::iterator it = _resident.begin(); it != _resident.end(); ) {
+        if ( wanted.count(it->first) ) {
+            ++it;
+            continue;
+        }
+        removeChild(it->second.get());
+        _resident.erase(it++);
+    }
+
+    for ( std::set<unsigned int>::iterator it = _pending.begin(); it != _pending.end(); ) {
+        if ( wanted.count(*it) )
+            ++it;
+        else
+            _pending.erase(it++);
+    }
+
+    //queue missing tiles, nearest first
+    std::vector<unsigned int> requests;
+    for ( size_t i = 0; i < candidates.size(); ++i ) {
+        unsigned int key = candidates[i].second;
+        if ( _resident.count(key) || _failed.count(key) )
+            continue;
+        _pending.insert(key);
+        requests.push_back(key);
+    }
+
+    {
+        //skip tiles the pager thread is already working on
+        std::lock_guard<std::mutex> lock(_mutex);
+        _requests.clear();
+        std::set<unsigned int> busy(_loading);
+        for ( size_t i = 0; i < _completed.size(); ++i )
+            busy.insert(_completed[i].key);
+        for ( size_t i = 0; i < requests.size(); ++i ) {
+            if ( !busy.count(requests[i]) )
+                _requests.push_back(requests[i]);
+        }
+    }
+    _wake.notify_one();
+}
+
+osg::ref_ptr<osg::Node> TerrainPager::loadTile( unsigned int key ) const {
+    unsigned int c0 = (key % _numTilesX) * _tileSize;
+    unsigned int r0 = (key / _numTilesX) * _tileSize;
+
+    //tiles share their border samples with the neighbours
+    osg::ref_ptr<osg::HeightField> field = new osg::HeightField();
+    field->allocate( std::min(_tileSize + 1, _source->getNumColumns() - c0),
+                     std::min(_tileSize + 1, _source->getNumRows() - r0) );
+    field->setXInterval(_intervalX);
+    field->setYInterval(_intervalY);
+    field->setOrigin(_origin + osg::Vec3(c0 * _intervalX, r0 * _intervalY, 0.0f));
+
+    if ( !_source->read(field.get(), c0, r0) ) {
+        osg::notify(osg::WARN) << "TerrainPager: failed to read tile " << key << std::endl;
+        return NULL;
+    }
+
+    return createTerrain(field.get(), 64, _pixelError, true).get();
+}
+
+void TerrainPager::run() {
+    while ( true ) {
+        unsigned int key;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wake.wait(lock, [this]{ return _done || !_requests.empty(); });
+            if ( _done )
+                return;
+            key = _requests.front();
+            _requests.erase(_requests.begin());
+            _loading.insert(key);
+        }
+
+        Tile tile;
+        tile.key = key;
+        tile.node = loadTile(key);
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _completed.push_back(tile);
+        _loading.erase(key);
+    }
+}
@@ -0,0 +1,126 @@
+#ifndef TERRAINPAGER_H
+#define TERRAINPAGER_H
+
+#include <osg/Group>
+#include <osg/Shape>
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+//source of height samples for paged terrain, read() is called from the pager thread
+class TerrainSource : public osg::Referenced
+{
+public:
+    virtual unsigned int getNumColumns() const = 0;
+    virtual unsigned int getNumRows() const = 0;
+
+    //fill field with the samples starting at column c0 and row r0
+    virtual bool read( osg::HeightField* field, unsigned int c0, unsigned int r0 ) const = 0;
+
+protected:
+    virtual ~TerrainSource() {}
+};
+
+//headerless row major little endian 16 bit samples, read a window at a time
+class RawTerrainSource : public TerrainSource
+{
+public:
+    RawTerrainSource( const std::string& fileName, unsigned int numColumns, unsigned int numRows,
+                      float scale, float offset = 0.0f );
+
+    virtual unsigned int getNumColumns() const { return _numColumns; }
+    virtual unsigned int getNumRows() const { return _numRows; }
+    virtual bool read( osg::HeightField* field, unsigned int c0, unsigned int r0 ) const;
+
+protected:
+    std::string _fileName;
+    unsigned int _numColumns;
+    unsigned int _numRows;
+    float _scale;
+    float _offset;
+};
+
+/*
+ * Out-of-core terrain.
+ *
+ * The source is split into square tiles and only the tiles within the load
+ * radius of the focus point are kept resident, nearest first and never more
+ * than the memory budget allows. Tiles are read and turned into chunked
+ * terrain (see Terrain.h) on a background thread; the update traversal only
+ * swaps finished tiles in and evicted tiles out, so drawing never waits on I/O.
+ *
+ * The focus follows the eye point of the last cull unless it is set
+ * explicitly, e.g. to the tracked head position.
+ */
+class TerrainPager : public osg::Group
+{
+public:
+    TerrainPager( TerrainSource* source, const osg::Vec3& origin, float intervalX, float intervalY,
+                  unsigned int tileSize = 256 );
+
+    void setLoadRadius( float radius ) { _loadRadius = radius; }
+    float getLoadRadius() const { return _loadRadius; }
+
+    void setMemoryBudget( size_t bytes ) { _memoryBudget = bytes; }
+    size_t getMemoryBudget() const { return _memoryBudget; }
+
+    void setPixelError( float pixels ) { _pixelError = pixels; }
+
+    //stop following the camera and page around this point (local coordinates)
+    void setFocus( const osg::Vec3& focus );
+    void setFollowCamera( bool follow ) { _followCamera = follow; }
+
+    unsigned int getNumResidentTiles() const { return _resident.size(); }
+
+    virtual void traverse( osg::NodeVisitor& nv );
+
+protected:
+    virtual ~TerrainPager();
+
+    struct Tile {
+        unsigned int key;
+        osg::ref_ptr<osg::Node> node;
+    };
+
+    void updateTiles();
+    float distanceToTile( unsigned int key, const osg::Vec3& point ) const;
+    osg::ref_ptr<osg::Node> loadTile( unsigned int key ) const;
+    void run();
+
+    osg::ref_ptr<TerrainSource> _source;
+    osg::Vec3 _origin;
+    float _intervalX;
+    float _intervalY;
+    unsigned int _tileSize;
+    unsigned int _numTilesX;
+    unsigned int _numTilesY;
+    float _loadRadius;
+    size_t _memoryBudget;
+    size_t _tileBytes;
+    float _pixelError;
+
+    //update thread only
+    std::map<unsigned int, osg::ref_ptr<osg::Node> > _resident;
+    std::set<unsigned int> _pending;
+    std::set<unsigned int> _failed; //not requested again
+
+    //shared with the cull and pager threads
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::vector<unsigned int> _requests;
+    std::vector<Tile> _completed;
+    std::set<unsigned int> _loading;
+    osg::Vec3 _focus;
+    std::atomic<bool> _followCamera;
+    bool _done;
+
+    std::thread _thread;
+};
+
+#endif
@@ -0,0 +1,162 @@
+#include "TerrainQuery.h"
+
+#include <osg/Math>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace {
+
+//clip the parameter range of p + t * d against [lo, hi]
+bool clipSlab( float p, float d, float lo, float hi, float& t0, float& t1 ) {
+    if ( d == 0.0f )
+        return p >= lo && p <= hi;
+
+    float ta = (lo - p) / d;
+    float tb = (hi - p) / d;
+    if ( ta > tb )
+        std::swap(ta, tb);
+
+    t0 = std::max(t0, ta);
+    t1 = std::min(t1, tb);
+    return t0 <= t1;
+}
+
+//Moller-Trumbore, t is the fraction along dir
+bool intersectTriangle( const osg::Vec3& start, const osg::Vec3& dir,
+                        const osg::Vec3& v0, const osg::Vec3& v1, const osg::Vec3& v2, float& t ) {
+    osg::Vec3 e1 = v1 - v0;
+    osg::Vec3 e2 = v2 - v0;
+    osg::Vec3 p = dir ^ e2;
+    float det = e1 * p;
+    if ( std::fabs(det) < 1e-12f )
+        return false;
+
+    float invDet = 1.0f / det;
+    osg::Vec3 s = start - v0;
+    float u = (s * p) * invDet;
+    if ( u < 0.0f || u > 1.0f )
+        return false;
+
+    osg::Vec3 q = s ^ e1;
+    float v = (dir * q) * invDet;
+    if ( v < 0.0f || u + v > 1.0f )
+        return false;
+
+    t = (e2 * q) * invDet;
+    return t >= 0.0f && t <= 1.0f;
+}
+
+}
+
+TerrainQuery::TerrainQuery( const osg::HeightField* field )
+    : _field(field),
+      _heights(&(*field->getFloatArray())[0]),
+      _numColumns(field->getNumColumns()),
+      _numRows(field->getNumRows()),
+      _origin(field->getOrigin()),
+      _intervalX(field->getXInterval()),
+      _intervalY(field->getYInterval())
+{
+    const float* last = _heights + _numColumns * _numRows;
+    _minHeight = *std::min_element(_heights, last);
+    _maxHeight = *std::max_element(_heights, last);
+}
+
+osg::Vec3 TerrainQuery::vertex( unsigned int c, unsigned int r ) const {
+    return _origin + osg::Vec3(c * _intervalX, r * _intervalY, height(c, r));
+}
+
+bool TerrainQuery::getHeight( float x, float y, float& h ) const {
+    float u = (x - _origin.x()) / _intervalX;
+    float v = (y - _origin.y()) / _intervalY;
+    if ( u < 0.0f || v < 0.0f || u > _numColumns - 1 || v > _numRows - 1 || _numColumns < 2 || _numRows < 2 )
+        return false;
+
+    unsigned int c = std::min((unsigned int) u, _numColumns - 2);
+    unsigned int r = std::min((unsigned int) v, _numRows - 2);
+    float fu = u - c;
+    float fv = v - r;
+
+    float h0 = height(c, r)     + fu * (height(c + 1, r)     - height(c, r));
+    float h1 = height(c, r + 1) + fu * (height(c + 1, r + 1) - height(c, r + 1));
+    h = _origin.z() + h0 + fv * (h1 - h0);
+    return true;
+}
+
+bool TerrainQuery::intersectCell( unsigned int c, unsigned int r, const osg::Vec3& start, const osg::Vec3& dir, float& t ) const {
+    osg::Vec3 v00 = vertex(c, r);
+    osg::Vec3 v10 = vertex(c + 1, r);
+    osg::Vec3 v01 = vertex(c, r + 1);
+    osg::Vec3 v11 = vertex(c + 1, r + 1);
+
+    float ta, tb;
+    bool a = intersectTriangle(start, dir, v00, v10, v11, ta);
+    bool b = intersectTriangle(start, dir, v00, v11, v01, tb);
+
+    if ( a && b )
+        t = std::min(ta, tb);
+    else if ( a )
+        t = ta;
+    else if ( b )
+        t = tb;
+    return a || b;
+}
+
+bool TerrainQuery::intersect( const osg::Vec3& start, const osg::Vec3& end, osg::Vec3& hit, float* ratio ) const {
+    if ( _numColumns < 2 || _numRows < 2 )
+        return false;
+
+    const osg::Vec3 dir = end - start;
+
+    //only walk the part of the segment that is above the grid and inside its height range
+    float t0 = 0.0f, t1 = 1.0f;
+    if ( !clipSlab(start.x(), dir.x(), _origin.x(), _origin.x() + (_numColumns - 1) * _intervalX, t0, t1) ||
+         !clipSlab(start.y(), dir.y(), _origin.y(), _origin.y() + (_numRows - 1) * _intervalY, t0, t1) ||
+         !clipSlab(start.z(), dir.z(), _origin.z() + _minHeight, _origin.z() + _maxHeight, t0, t1) )
+        return false;
+
+    //walk the cells in grid space
+    const float u0 = (start.x() - _origin.x()) / _intervalX;
+    const float v0 = (start.y() - _origin.y()) / _intervalY;
+    const float du = dir.x() / _intervalX;
+    const float dv = dir.y() / _intervalY;
+
+    int c = osg::clampBetween(int(std::floor(u0 + du * t0)), 0, int(_numColumns) - 2);
+    int r = osg::clampBetween(int(std::floor(v0 + dv * t0)), 0, int(_numRows) - 2);
+
+    const int stepC = du > 0.0f ? 1 : -1;
+    const int stepR = dv > 0.0f ? 1 : -1;
+    float nextC = du > 0.0f ? (c + 1 - u0) / du : du < 0.0f ? (c - u0) / du : FLT_MAX;
+    float nextR = dv > 0.0f ? (r + 1 - v0) / dv : dv < 0.0f ? (r - v0) / dv : FLT_MAX;
+    const float deltaC = du != 0.0f ? std::fabs(1.0f / du) : FLT_MAX;
+    const float deltaR = dv != 0.0f ? std::fabs(1.0f / dv) : FLT_MAX;
+
+    while ( true ) {
+        float t;
+        if ( intersectCell(c, r, start, dir, t) ) {
+            hit = start + dir * t;
+            if ( ratio )
+                *ratio = t;
+            return true;
+        }
+
+        if ( nextC < nextR ) {
+            if ( nextC > t1 )
+                break;
+            c += stepC;
+            nextC += deltaC;
+        }
+        else {
+            if ( nextR > t1 )
+                break;
+            r += stepR;
+            nextR += deltaR;
+        }
+
+        if ( c < 0 || r < 0 || c > int(_numColumns) - 2 || r > int(_numRows) - 2 )
+            break;
+    }
+    return false;
+}
@@ -0,0 +1,45 @@
+#ifndef TERRAINQUERY_H
+#define TERRAINQUERY_H
+
+#include <osg/Referenced>
+#include <osg/ref_ptr>
+#include <osg/Shape>
+
+/*
+ * Direct queries against a HeightField, without going through the scene graph.
+ *
+ * Heights are looked up bilinearly in constant time. Segments are marched
+ * through the grid cell by cell (a 2D DDA) and tested exactly against the two
+ * triangles of each cell they cross, using the same diagonal as the terrain
+ * mesh in Terrain.cpp, so the first cell with a hit holds the nearest hit.
+ */
+class TerrainQuery : public osg::Referenced
+{
+public:
+    TerrainQuery( const osg::HeightField* field );
+
+    //bilinear height below world x,y, false outside the field
+    bool getHeight( float x, float y, float& height ) const;
+
+    //nearest intersection along start->end, ratio is the fraction of the segment
+    bool intersect( const osg::Vec3& start, const osg::Vec3& end, osg::Vec3& hit, float* ratio = 0 ) const;
+
+protected:
+    virtual ~TerrainQuery() {}
+
+    float height( unsigned int c, unsigned int r ) const { return _heights[r * _numColumns + c]; }
+    osg::Vec3 vertex( unsigned int c, unsigned int r ) const;
+    bool intersectCell( unsigned int c, unsigned int r, const osg::Vec3& start, const osg::Vec3& dir, float& t ) const;
+
+    osg::ref_ptr<const osg::HeightField> _field;
+    const float* _heights;
+    unsigned int _numColumns;
+    unsigned int _numRows;
+    osg::Vec3 _origin;
+    float _intervalX;
+    float _intervalY;
+    float _minHeight;
+    float _maxHeight;
+};
+
+#endif
@@ -0,0 +1,533 @@
+#include "TextureCache.h"
+
+#include <osg/Geode>
+#include <osg/Notify>
+#include <osg/Texture2D>
+#include <osg/Timer>
+#include <osgDB/FileUtils>
+#include <osgDB/FileNameUtils>
+#include <osgDB/ReadFile>
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <vector>
+
+namespace {
+
+//bumped whenever filtering or compression changes so that old entries are not read
+const uint32_t FORMAT_VERSION = 1;
+const char MAGIC[4] = { 'T', 'X', 'B', 'C' };
+
+struct CacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;
+    uint32_t size;
+};
+
+//64 bit FNV-1a
+const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+const uint64_t FNV_PRIME = 1099511628211ULL;
+
+uint64_t hashBytes( uint64_t hash, const void* data, size_t size ) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for ( size_t i = 0; i < size; ++i ) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+//files and pixels hash into separate keys, both change with the format
+uint64_t startHash( const char* kind ) {
+    uint64_t hash = hashBytes(FNV_OFFSET, &FORMAT_VERSION, sizeof(FORMAT_VERSION));
+    return hashBytes(hash, kind, std::char_traits<char>::length(kind));
+}
+
+unsigned int bytesPerBlock( uint32_t format ) {
+    return format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16;
+}
+
+//size of the whole chain, with the offset of every level after the first as osg keeps them
+unsigned int layoutChain( unsigned int width, unsigned int height, unsigned int blockBytes, osg::Image::MipmapDataType* offsets ) {
+    unsigned int size = 0;
+    for ( ;; ) {
+        size += ((width + 3) / 4) * ((height + 3) / 4) * blockBytes;
+        if ( width == 1 && height == 1 )
+            return size;
+        width = std::max(1u, width / 2);
+        height = std::max(1u, height / 2);
+        if ( offsets )
+            offsets->push_back(size);
+    }
+}
+
+uint64_t rgbaChainBytes( unsigned int width, unsigned int height ) {
+    uint64_t size = 0;
+    for ( ;; ) {
+        size += uint64_t(width) * height * 4;
+        if ( width == 1 && height == 1 )
+            return size;
+        width = std::max(1u, width / 2);
+        height = std::max(1u, height / 2);
+    }
+}
+
+bool isHandled( GLenum pixelFormat ) {
+    switch ( pixelFormat ) {
+    case GL_LUMINANCE:
+    case GL_ALPHA:
+    case GL_LUMINANCE_ALPHA:
+    case GL_RGB:
+    case GL_BGR:
+    case GL_RGBA:
+    case GL_BGRA:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void toRGBA( const unsigned char* src, GLenum pixelFormat, unsigned int count, unsigned char* dst ) {
+    for ( unsigned int i = 0; i < count; ++i, dst += 4 ) {
+        switch ( pixelFormat ) {
+        case GL_LUMINANCE:
+            dst[0] = dst[1] = dst[2] = src[i]; dst[3] = 255;
+            break;
+        case GL_ALPHA:
+            dst[0] = dst[1] = dst[2] = 255; dst[3] = src[i];
+            break;
+        case GL_LUMINANCE_ALPHA:
+            dst[0] = dst[1] = dst[2] = src[i * 2]; dst[3] = src[i * 2 + 1];
+            break;
+        case GL_RGB:
+            dst[0] = src[i * 3]; dst[1] = src[i * 3 + 1]; dst[2] = src[i * 3 + 2]; dst[3] = 255;
+            break;
+        case GL_BGR:
+            dst[0] = src[i * 3 + 2]; dst[1] = src[i * 3 + 1]; dst[2] = src[i * 3]; dst[3] = 255;
+            break;
+        case GL_RGBA:
+            dst[0] = src[i * 4]; dst[1] = src[i * 4 + 1]; dst[2] = src[i * 4 + 2]; dst[3] = src[i * 4 + 3];
+            break;
+        case GL_BGRA:
+            dst[0] = src[i * 4 + 2]; dst[1] = src[i * 4 + 1]; dst[2] = src[i * 4]; dst[3] = src[i * 4 + 3];
+            break;
+        }
+    }
+}
+
+//rows [first, last) of the next level, each pixel the mean of up to 2x2 pixels above it
+void downsampleRows( const unsigned char* src, unsigned int width, unsigned int height,
+                     unsigned char* dst, unsigned int first, unsigned int last ) {
+    const unsigned int dstWidth = std::max(1u, width / 2);
+    for ( unsigned int y = first; y < last; ++y ) {
+        const unsigned char* row0 = src + 2 * y * width * 4;
+        const unsigned char* row1 = src + std::min(2 * y + 1, height - 1) * width * 4;
+        for ( unsigned int x = 0; x < dstWidth; ++x ) {
+            const unsigned int x0 = 2 * x * 4;
+            const unsigned int x1 = std::min(2 * x + 1, width - 1) * 4;
+            for ( unsigned int c = 0; c < 4; ++c )
+                dst[(y * dstWidth + x) * 4 + c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4;
+        }
+    }
+}
+
+unsigned short pack565( const unsigned char* color ) {
+    return ((color[0] * 31 + 127) / 255) << 11 | ((color[1] * 63 + 127) / 255) << 5 | ((color[2] * 31 + 127) / 255);
+}
+
+void unpack565( unsigned short value, int* color ) {
+    const int r = value >> 11, g = (value >> 5) & 63, b = value & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+//BC1 colour block: the end points are the pixels furthest apart along the principal axis
+void encodeColors( const unsigned char* block, unsigned char* out ) {
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+    for ( unsigned int i = 0; i < 16; ++i )
+        for ( unsigned int c = 0; c < 3; ++c )
+            mean[c] += block[i * 4 + c] / 16.0f;
+
+    float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    for ( unsigned int i = 0; i < 16; ++i ) {
+        const float r = block[i * 4] - mean[0], g = block[i * 4 + 1] - mean[1], b = block[i * 4 + 2] - mean[2];
+        cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+        cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+    }
+
+    //a few power iterations are enough to pick the end points
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for ( unsigned int k = 0; k < 4; ++k ) {
+        const float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        const float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        const float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+        const float m = std::max(std::abs(x), std::max(std::abs(y), std::abs(z)));
+        if ( m <= 0.0f )
+            break;
+        axis[0] = x / m; axis[1] = y / m; axis[2] = z / m;
+    }
+
+    unsigned int lo = 0, hi = 0;
+    float minDot = 0.0f, maxDot = 0.0f;
+    for ( unsigned int i = 0; i < 16; ++i ) {
+        const float d = block[i * 4] * axis[0] + block[i * 4 + 1] * axis[1] + block[i * 4 + 2] * axis[2];
+        if ( i == 0 || d < minDot ) { minDot = d; lo = i; }
+        if ( i == 0 || d > maxDot ) { maxDot = d; hi = i; }
+    }
+
+    //the first end point has to be the larger for four colours
+    unsigned short a = pack565(block + hi * 4), b = pack565(block + lo * 4);
+    if ( a < b )
+        std::swap(a, b);
+
+    uint32_t indices = 0;
+    if ( a != b ) {
+        int palette[4][3];
+        unpack565(a, palette[0]);
+        unpack565(b, palette[1]);
+        for ( unsigned int c = 0; c < 3; ++c ) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for ( unsigned int i = 0; i < 16; ++i ) {
+            unsigned int best = 0;
+            int bestDistance = INT_MAX;
+            for ( unsigned int j = 0; j < 4; ++j ) {
+                const int r = block[i * 4] - palette[j][0], g = block[i * 4 + 1] - palette[j][1], b = block[i * 4 + 2] - palette[j][2];
+                const int distance = r * r + g * g + b * b;
+                if ( distance < bestDistance ) {
+                    bestDistance = distance;
+                    best = j;
+                }
+            }
+            indices |= best << (2 * i);
+        }
+    }
+
+    out[0] = a & 0xff; out[1] = a >> 8;
+    out[2] = b & 0xff; out[3] = b >> 8;
+    for ( unsigned int k = 0; k < 4; ++k )
+        out[4 + k] = (indices >> (8 * k)) & 0xff;
+}
+
+//BC3 alpha block with eight interpolated values between the extremes
+void encodeAlpha( const unsigned char* block, unsigned char* out ) {
+    int lo = 255, hi = 0;
+    for ( unsigned int i = 0; i < 16; ++i ) {
+        lo = std::min(lo, int(block[i * 4 + 3]));
+        hi = std::max(hi, int(block[i * 4 + 3]));
+    }
+
+    uint64_t indices = 0;
+    if ( hi > lo ) {
+        int palette[8] = { hi, lo };
+        for ( unsigned int j = 2; j < 8; ++j )
+            palette[j] = ((8 - j) * hi + (j - 1) * lo) / 7;
+        for ( unsigned int i = 0; i < 16; ++i ) {
+            unsigned int best = 0;
+            for ( unsigned int j = 1; j < 8; ++j )
+                if ( std::abs(block[i * 4 + 3] - palette[j]) < std::abs(block[i * 4 + 3] - palette[best]) )
+                    best = j;
+            indices |= uint64_t(best) << (3 * i);
+        }
+    }
+
+    out[0] = hi;
+    out[1] = lo;
+    for ( unsigned int k = 0; k < 6; ++k )
+        out[2 + k] = (indices >> (8 * k)) & 0xff;
+}
+
+//block rows [first, last) of a level, edge pixels repeat into partial blocks
+void compressRows( const unsigned char* pixels, unsigned int width, unsigned int height, bool alpha,
+                   unsigned char* out, unsigned int first, unsigned int last ) {
+    const unsigned int blocksPerRow = (width + 3) / 4;
+    const unsigned int blockBytes = alpha ? 16 : 8;
+    unsigned char block[64];
+    for ( unsigned int by = first; by < last; ++by ) {
+        for ( unsigned int bx = 0; bx < blocksPerRow; ++bx ) {
+            for ( unsigned int py = 0; py < 4; ++py ) {
+                const unsigned int y = std::min(by * 4 + py, height - 1);
+                for ( unsigned int px = 0; px < 4; ++px ) {
+                    const unsigned int x = std::min(bx * 4 + px, width - 1);
+                    std::copy(pixels + (y * width + x) * 4, pixels + (y * width + x) * 4 + 4, block + (py * 4 + px) * 4);
+                }
+            }
+            unsigned char* dst = out + (by * blocksPerRow + bx) * blockBytes;
+            if ( alpha ) {
+                encodeAlpha(block, dst);
+                dst += 8;
+            }
+            encodeColors(block, dst);
+        }
+    }
+}
+
+//the 2D textures in the state sets of a scene
+class TextureVisitor : public osg::NodeVisitor
+{
+public:
+    TextureVisitor() : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN) {}
+
+    virtual void apply( osg::Node& node ) {
+        collect(node.getStateSet());
+        traverse(node);
+    }
+
+    virtual void apply( osg::Geode& geode ) {
+        collect(geode.getStateSet());
+        for ( unsigned int i = 0; i < geode.getNumDrawables(); ++i )
+            collect(geode.getDrawable(i)->getStateSet());
+    }
+
+    std::set<osg::Texture2D*> textures;
+
+protected:
+    void collect( osg::StateSet* stateSet ) {
+        if ( !stateSet )
+            return;
+        for ( unsigned int unit = 0; unit < stateSet->getNumTextureAttributeLists(); ++unit ) {
+            osg::Texture2D* texture = dynamic_cast<osg::Texture2D*>(stateSet->getTextureAttribute(unit, osg::StateAttribute::TEXTURE));
+            if ( texture && texture->getImage() )
+                textures.insert(texture);
+        }
+    }
+};
+
+}
+
+TextureCache::TextureCache( const std::string& directory, unsigned int numThreads )
+    : _directory(directory),
+      _pool(numThreads)
+{}
+
+osg::ref_ptr<osg::Image> TextureCache::readImage( const std::string& fileName ) {
+    std::string path = osgDB::findDataFile(fileName);
+    std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+    if ( path.empty() || !file ) {
+        osg::notify(osg::WARN) << "TextureCache: cannot find '" << fileName << "'" << std::endl;
+        return 0;
+    }
+
+    //the file is hashed as it is, it is only decoded on a miss
+    std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    uint64_t hash = hashBytes(startHash("file"), bytes.data(), bytes.size());
+
+    osg::ref_ptr<osg::Image> image = readCache(cachePath(hash));
+    if ( image.valid() ) {
+        ++_stats.hits;
+    } else {
+        osg::ref_ptr<osg::Image> source = osgDB::readImageFile(path);
+        if ( !source.valid() )
+            return 0;
+        image = store(hash, source.get());
+        if ( !image.valid() )
+            return source;
+    }
+    image->setFileName(fileName);
+    count(image.get());
+    return image;
+}
+
+void TextureCache::compressTextures( osg::Node* node ) {
+    if ( !node )
+        return;
+
+    TextureVisitor visitor;
+    node->accept(visitor);
+
+    //images shared by several textures are done once
+    std::map< const osg::Image*, osg::ref_ptr<osg::Image> > done;
+    for ( std::set<osg::Texture2D*>::iterator i = visitor.textures.begin(); i != visitor.textures.end(); ++i ) {
+        const osg::Image* source = (*i)->getImage();
+        if ( source->isCompressed() )
+            continue;
+
+        if ( done.find(source) == done.end() ) {
+            osg::ref_ptr<osg::Image> image;
+            if ( isHandled(source->getPixelFormat()) && source->getDataType() == GL_UNSIGNED_BYTE ) {
+                uint32_t shape[4] = { uint32_t(source->s()), uint32_t(source->t()), source->getPixelFormat(), source->getDataType() };
+                uint64_t hash = hashBytes(startHash("pixels"), shape, sizeof(shape));
+                for ( int y = 0; y < source->t(); ++y )
+                    hash = hashBytes(hash, source->data(0, y), source->getRowSizeInBytes());
+
+                image = readCache(cachePath(hash));
+                if ( image.valid() )
+                    ++_stats.hits;
+                else
+                    image = store(hash, source);
+            } else {
+                ++_stats.skipped;
+            }
+            if ( image.valid() ) {
+                image->setFileName(source->getFileName());
+                count(image.get());
+            }
+            done[source] = image;
+        }
+
+        if ( done[source].valid() )
+            (*i)->setImage(done[source].get());
+    }
+}
+
+osg::ref_ptr<osg::Image> TextureCache::compress( const osg::Image* image ) {
+    if ( !image || image->isCompressed() || image->getDataType() != GL_UNSIGNED_BYTE ||
+         !isHandled(image->getPixelFormat()) || image->s() < 1 || image->t() < 1 || image->r() != 1 )
+        return 0;
+
+    unsigned int width = image->s();
+    unsigned int height = image->t();
+    const GLenum pixelFormat = image->getPixelFormat();
+    std::vector<unsigned char> pixels(width * height * 4);
+    forRows(height, [&]( unsigned int first, unsigned int last ) {
+        for ( unsigned int y = first; y < last; ++y )
+            toRGBA(image->data(0, y), pixelFormat, width, &pixels[y * width * 4]);
+    });
+
+    bool alpha = false;
+    for ( size_t i = 3; i < pixels.size() && !alpha; i += 4 )
+        alpha = pixels[i] != 255;
+    const GLenum format = alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+
+    osg::Image::MipmapDataType offsets;
+    const unsigned int size = layoutChain(width, height, bytesPerBlock(format), &offsets);
+    unsigned char* data = new unsigned char[size];
+
+    //each level is compressed, then filtered into the next
+    unsigned char* level = data;
+    for ( ;; ) {
+        forRows((height + 3) / 4, [&]( unsigned int first, unsigned int last ) {
+            compressRows(&pixels[0], width, height, alpha, level, first, last);
+        });
+        level += ((width + 3) / 4) * ((height + 3) / 4) * bytesPerBlock(format);
+        if ( width == 1 && height == 1 )
+            break;
+
+        std::vector<unsigned char> next(std::max(1u, width / 2) * std::max(1u, height / 2) * 4);
+        forRows(std::max(1u, height / 2), [&]( unsigned int first, unsigned int last ) {
+            downsampleRows(&pixels[0], width, height, &next[0], first, last);
+        });
+        pixels.swap(next);
+        width = std::max(1u, width / 2);
+        height = std::max(1u, height / 2);
+    }
+
+    osg::ref_ptr<osg::Image> compressed = new osg::Image;
+    compressed->setImage(image->s(), image->t(), 1, format, format, GL_UNSIGNED_BYTE, data, osg::Image::USE_NEW_DELETE);
+    compressed->setMipmapLevels(offsets);
+    return compressed;
+}
+
+void TextureCache::report( std::ostream& out ) const {
+    out << "Texture cache '" << _directory << "'" << std::endl
+        << "  " << _stats.hits << " read, " << _stats.compressed << " compressed in " << _stats.seconds << " s, "
+        << _stats.skipped << " left as they were" << std::endl
+        << "  " << _stats.residentBytes / 1024 << " KB with mipmaps, "
+        << _stats.rgbaBytes / 1024 << " KB as RGBA" << std::endl;
+}
+
+osg::ref_ptr<osg::Image> TextureCache::store( uint64_t hash, const osg::Image* source ) {
+    osg::Timer_t start = osg::Timer::instance()->tick();
+    osg::ref_ptr<osg::Image> image = compress(source);
+    if ( !image.valid() ) {
+        ++_stats.skipped;
+        return 0;
+    }
+    ++_stats.compressed;
+    _stats.seconds += osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+
+    //a failed write only costs the next run another compression
+    if ( !writeCache(cachePath(hash), image.get()) )
+        osg::notify(osg::WARN) << "TextureCache: cannot write to '" << _directory << "'" << std::endl;
+    return image;
+}
+
+std::string TextureCache::cachePath( uint64_t hash ) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.txbc", static_cast<unsigned long long>(hash));
+    return osgDB::concatPaths(_directory, name);
+}
+
+osg::ref_ptr<osg::Image> TextureCache::readCache( const std::string& path ) const {
+    std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+    if ( !file )
+        return 0;
+
+    //anything that does not add up is a miss and gets overwritten
+    CacheHeader header;
+    if ( !file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+         !std::equal(MAGIC, MAGIC + 4, header.magic) || header.version != FORMAT_VERSION ||
+         (header.format != GL_COMPRESSED_RGB_S3TC_DXT1_EXT && header.format != GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) ||
+         header.width == 0 || header.height == 0 || header.width > 65536 || header.height > 65536 )
+        return 0;
+
+    osg::Image::MipmapDataType offsets;
+    if ( header.size != layoutChain(header.width, header.height, bytesPerBlock(header.format), &offsets) )
+        return 0;
+
+    unsigned char* data = new unsigned char[header.size];
+    if ( !file.read(reinterpret_cast<char*>(data), header.size) ) {
+        delete[] data;
+        return 0;
+    }
+
+    osg::ref_ptr<osg::Image> image = new osg::Image;
+    image->setImage(header.width, header.height, 1, header.format, header.format, GL_UNSIGNED_BYTE, data, osg::Image::USE_NEW_DELETE);
+    image->setMipmapLevels(offsets);
+    return image;
+}
+
+bool TextureCache::writeCache( const std::string& path, const osg::Image* image ) const {
+    osgDB::makeDirectory(_directory);
+
+    CacheHeader header;
+    std::copy(MAGIC, MAGIC + 4, header.magic);
+    header.version = FORMAT_VERSION;
+    header.width = image->s();
+    header.height = image->t();
+    header.format = image->getPixelFormat();
+    header.size = layoutChain(header.width, header.height, bytesPerBlock(header.format), 0);
+
+    //written beside the entry and renamed, so a run that stops halfway leaves no broken entry
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+        if ( !file.write(reinterpret_cast<const char*>(&header), sizeof(header)) ||
+             !file.write(reinterpret_cast<const char*>(image->data()), header.size) )
+            return false;
+    }
+    std::remove(path.c_str());
+    return std::rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+void TextureCache::count( const osg::Image* image ) {
+    _stats.residentBytes += layoutChain(image->s(), image->t(), bytesPerBlock(image->getPixelFormat()), 0);
+    _stats.rgbaBytes += rgbaChainBytes(image->s(), image->t());
+}
+
+void TextureCache::forRows( unsigned int numRows, const std::function<void(unsigned int, unsigned int)>& job ) {
+    //small levels are not worth the hand-off, the rest go in a few chunks per thread
+    const unsigned int numChunks = std::min(numRows / 8, _pool.getNumThreads() * 4);
+    if ( numChunks <= 1 ) {
+        job(0, numRows);
+        return;
+    }
+    for ( unsigned int i = 0; i < numChunks; ++i ) {
+        const unsigned int first = numRows * i / numChunks;
+        const unsigned int last = numRows * (i + 1) / numChunks;
+        _pool.run([&job, first, last]() { job(first, last); });
+    }
+    _pool.wait();
+}
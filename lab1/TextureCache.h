@@ -0,0 +1,78 @@
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include <osg/Image>
+#include <osg/Node>
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+
+#include "ThreadPool.h"
+
+/*
+ * Block compressed textures with a full mip chain, built once and then read
+ * from a cache on disk.
+ *
+ * An image is converted to RGBA, box filtered down to 1x1 and every level is
+ * compressed in 4x4 blocks: BC1 (DXT1) when it is opaque, BC3 (DXT5) when any
+ * pixel is transparent. Filtering and compression are split over the rows of
+ * each level and run on the worker threads, without a GL context. The result
+ * is stored in the cache directory under a hash of its source, the bytes of the
+ * file for images read by name and the pixels for images that came with a
+ * model, so an edited source gets a new entry instead of a stale one. Later
+ * runs read the compressed chain directly, without decoding the source or
+ * building mipmaps in the driver.
+ *
+ * Only 8 bit luminance, alpha, RGB and RGBA images and their BGR orders are
+ * compressed, others are used as they are. The cache files are in the byte
+ * order of the machine that wrote them.
+ */
+class TextureCache
+{
+public:
+    //0 starts one thread per core
+    TextureCache( const std::string& directory = "texture_cache", unsigned int numThreads = 0 );
+
+    //the compressed image of a file, null if it could not be read
+    osg::ref_ptr<osg::Image> readImage( const std::string& fileName );
+
+    //swap the images of the 2D textures below node for compressed ones, nothing for null
+    void compressTextures( osg::Node* node );
+
+    //a compressed mip chain of image, null if its format is not handled
+    osg::ref_ptr<osg::Image> compress( const osg::Image* image );
+
+    //hits and misses, time spent compressing and the memory saved
+    void report( std::ostream& out ) const;
+
+protected:
+    struct Stats {
+        unsigned int hits;
+        unsigned int compressed;
+        unsigned int skipped;    //formats that are not handled
+        double seconds;          //compressing misses
+        uint64_t rgbaBytes;      //the same chains uncompressed
+        uint64_t residentBytes;
+
+        Stats() : hits(0), compressed(0), skipped(0), seconds(0.0), rgbaBytes(0), residentBytes(0) {}
+    };
+
+    //compress a miss and write it to the cache under the hash of its source
+    osg::ref_ptr<osg::Image> store( uint64_t hash, const osg::Image* source );
+
+    std::string cachePath( uint64_t hash ) const;
+    osg::ref_ptr<osg::Image> readCache( const std::string& path ) const;
+    bool writeCache( const std::string& path, const osg::Image* image ) const;
+    void count( const osg::Image* image );
+
+    //job(first, last) over [0, numRows) in chunks on the pool, returns when all are done
+    void forRows( unsigned int numRows, const std::function<void(unsigned int, unsigned int)>& job );
+
+    std::string _directory;
+    ThreadPool _pool;
+    Stats _stats;
+};
+
+#endif
@@ -0,0 +1,62 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool( unsigned int numThreads )
+    : _busy(0),
+      _done(false)
+{
+    if ( numThreads == 0 )
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    for ( unsigned int i = 0; i < numThreads; ++i )
+        _threads.push_back(std::thread(&ThreadPool::work, this));
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _done = true;
+    }
+    _wake.notify_all();
+
+    for ( size_t i = 0; i < _threads.size(); ++i )
+        _threads[i].join();
+}
+
+void ThreadPool::run( const std::function<void()>& job ) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _jobs.push_back(job);
+    }
+    _wake.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while ( !_jobs.empty() || _busy > 0 )
+        _idle.wait(lock);
+}
+
+void ThreadPool::work() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while ( true ) {
+        while ( _jobs.empty() && !_done )
+            _wake.wait(lock);
+
+        if ( _jobs.empty() )
+            return;
+
+        std::function<void()> job = _jobs.front();
+        _jobs.pop_front();
+        ++_busy;
+
+        lock.unlock();
+        job();
+        lock.lock();
+
+        --_busy;
+        if ( _jobs.empty() && _busy == 0 )
+            _idle.notify_all();
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//fixed set of worker threads that run queued jobs in order of submission
+class ThreadPool
+{
+public:
+    //0 starts one thread per core
+    ThreadPool( unsigned int numThreads = 0 );
+    //finishes the queued jobs first
+    ~ThreadPool();
+
+    void run( const std::function<void()>& job );
+
+    //block until every queued job has finished
+    void wait();
+
+    unsigned int getNumThreads() const { return _threads.size(); }
+
+protected:
+    void work();
+
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _idle;
+    std::deque< std::function<void()> > _jobs;
+    unsigned int _busy;
+    bool _done;
+
+    std::vector<std::thread> _threads;
+};
+
+#endif
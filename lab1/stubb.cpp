@@ -10,17 +10,41 @@
 #include <osg/ShapeDrawable>
 #include <osg/CopyOp>
 #include <osgUtil/IntersectVisitor>
+#include <osg/ArgumentParser>
+#include <osg/Notify>
+
+#include <cmath>
+
+#include "Terrain.h"
+#include "HeightMap.h"
+#include "TerrainPager.h"
+#include "TerrainQuery.h"
+#include "SensorLines.h"
+#include "LodGenerator.h"
+#include "InstancedLOD.h"
+#include "MeshCompactor.h"
+#include "BatchAnimator.h"
+#include "TextureCache.h"
 
 osg::AnimationPath::ControlPoint createPoint(osg::Vec3 position, osg::Vec3 scale);
-osg::ref_ptr<osg::Geode> createGround( int dimX, int dimY, float intervalX, float intervalY );
+osg::ref_ptr<osg::Node> createGround( int dimX, int dimY, float intervalX, float intervalY, TextureCache& textureCache );
 osg::ref_ptr<osg::HeightField> createHeightField( int dimX, int dimY, float intervalX, float intervalY  );
-void setHeights ( osg::ref_ptr<osg::HeightField> field, osg::ref_ptr<osg::Image> heightMap );
-osg::ref_ptr<osg::Texture2D> addTexture();
-void addPathTo( osg::ref_ptr<osg::PositionAttitudeTransform> nodeTransform);
+osg::ref_ptr<osg::Node> createPagedGround( const std::string& fileName, unsigned int columns, unsigned int rows, float scale, float intervalX, float intervalY, TextureCache& textureCache );
+osg::ref_ptr<osg::Texture2D> addTexture( TextureCache& textureCache );
+osg::ref_ptr<osg::AnimationPath> createGliderPath();
 void addPoints( osg::ref_ptr<osg::AnimationPath> path );
 void addLight(osg::ref_ptr<osg::LightSource> lightSource, int lightNum, osg::Vec4 position, osg::Vec4 diffuse, osg::Vec4 ambient, osg::StateSet *r_state);
 
-osg::ref_ptr<osg::LightSource> lightSource3 = new osg::LightSource();/*
+osg::ref_ptr<osg::LightSource> lightSource3 = new osg::LightSource();
+
+//ground that is queried directly instead of through the intersection visitor
+osg::ref_ptr<TerrainQuery> groundQuery;
+const osg::Node::NodeMask INTERSECT_MASK = 0x1;
+
+//lines tested against the rest of the scene, only children that moved are tested again
+osg::ref_ptr<SensorLines> sensorLines = new SensorLines( INTERSECT_MASK ); //the ground is masked out, see groundQuery
+
+/*
 
 class IntersectRef : public osg::Referenced {
 
@@ -51,17 +75,20 @@ protected:
 class IntersectCallback : public osg::NodeCallback
 {
 public:
+    IntersectCallback() : groundTested(false), hitGround(false) {}
+
     virtual void operator() ( osg::Node* node, osg::NodeVisitor* nodeVisit )
     {
-        osg::Vec3 lineOne (-200, 0, 50);
-        osg::Vec3 lineTwo (200, 0, 50);
+        sensorLines->update( node->asGroup() );
 
-        osg::ref_ptr<osgUtil::LineSegmentIntersector> lineIntersector =
-                new osgUtil::LineSegmentIntersector(lineOne, lineTwo);
-        osgUtil::IntersectionVisitor visitor( lineIntersector.get() );
-        node->accept( visitor );
+        //the ground never moves, test it once
+        if ( !groundTested && sensorLines->getNumLines() > 0 ) {
+            osg::Vec3 groundHit;
+            hitGround = groundQuery.valid() && groundQuery->intersect( sensorLines->getStart(0), sensorLines->getEnd(0), groundHit );
+            groundTested = true;
+        }
 
-        if(lineIntersector->containsIntersections()){
+        if(sensorLines->hasHit(0) || hitGround){
             lightSource3->getLight()->setDiffuse( osg::Vec4(1.0f, 0.2f, 0.2f,1.0f) );
             lightSource3->getLight()->setAmbient( osg::Vec4( 0.3f, 0.05f, 0.05f, 1.0f));
         }
@@ -85,11 +112,20 @@ public:
         lineIntersector->reset();
         traverse(node, nodeVisit); */
     }
+
+protected:
+    bool groundTested;
+    bool hitGround;
 };
 
 
 int main(int argc, char *argv[]) {
 
+    //terrain tiles are built on the pager thread
+    osg::Referenced::setThreadSafeReferenceCounting(true);
+
+    osg::ArgumentParser arguments(&argc, argv);
+
     osg::ref_ptr<osg::Group> root = new osg::Group;
 
 #if 1
@@ -117,6 +153,7 @@ int main(int argc, char *argv[]) {
 
     //root->addChild(lineGeode);
 
+    sensorLines->addLine(line_p0, line_p1);
     root->setUpdateCallback(new IntersectCallback);
 
     /// ---
@@ -132,42 +169,78 @@ int main(int argc, char *argv[]) {
     const float INTX = 1.0f;
     const float INTY = 1.0f;
 
-    //create ground plane
-    osg::ref_ptr<osg::Geode> groundGeode = createGround( DIMX, DIMY, INTX, INTY ); //create the ground
-    root->addChild(groundGeode); //add ground to root
+    //create ground plane, or page a large raw 16 bit terrain with --terrain <file> <columns> <rows>
+    std::string terrainFile;
+    unsigned int terrainColumns = 0, terrainRows = 0;
+    float terrainScale = 255.0f / 12.0f;
+    arguments.read("--terrain-scale", terrainScale);
+
+    //block compressed textures with mipmaps, built on the first run and read from disk after that
+    TextureCache textureCache;
+
+    osg::ref_ptr<osg::Node> groundNode;
+    if ( arguments.read("--terrain", terrainFile, terrainColumns, terrainRows) )
+        groundNode = createPagedGround( terrainFile, terrainColumns, terrainRows, terrainScale, INTX, INTY, textureCache );
+    else
+        groundNode = createGround( DIMX, DIMY, INTX, INTY, textureCache ); //create the ground
+    root->addChild(groundNode); //add ground to root
 
     //define model
     osg::ref_ptr<osg::Node> gliderNode = osgDB::readNodeFile("cessna.osg");
+    //merge, index and cache order the imported models before anything copies them
+    MeshCompactor compactor;
+    compactor.compact(gliderNode, "cessna.osg");
+    textureCache.compressTextures(gliderNode);
     osg::ref_ptr<osg::PositionAttitudeTransform> gliderNodeTransform =
             new osg::PositionAttitudeTransform();
     gliderNodeTransform->addChild(gliderNode);
     gliderNodeTransform->setScale(osg::Vec3(5, 5, 5));
 
-    addPathTo(gliderNodeTransform);
+    //every animated transform is evaluated in one batch per frame, after the intersection test like the callbacks before
+    osg::ref_ptr<BatchAnimator> animator = new BatchAnimator();
+    root->addUpdateCallback(animator);
+    osg::ref_ptr<osg::AnimationPath> gliderPath = createGliderPath();
+    unsigned int gliderPathIndex = animator->addPath(gliderPath);
+    animator->addInstance(gliderPathIndex, gliderNodeTransform);
     //add to root
     root->addChild(gliderNodeTransform);
 
+    //more gliders with --gliders <count>, in lanes beside the first and spread out along the path
+    unsigned int gliderCount = 0;
+    if ( arguments.read("--gliders", gliderCount) && gliderCount > 1 ) {
+        unsigned int lanes = (unsigned int) std::ceil(std::sqrt(float(gliderCount - 1)));
+        unsigned int perLane = (gliderCount - 2) / lanes + 1;
+        std::vector< osg::ref_ptr<osg::MatrixTransform> > laneTransforms;
+        for ( unsigned int i = 0; i < lanes; ++i ) {
+            laneTransforms.push_back(new osg::MatrixTransform(osg::Matrix::translate((i + 1) * 12.0f, 0.0f, 0.0f)));
+            laneTransforms.back()->setDataVariance(osg::Object::DYNAMIC); //kept apart by the optimizer
+            root->addChild(laneTransforms.back());
+        }
+        for ( unsigned int i = 0; i + 1 < gliderCount; ++i ) {
+            osg::ref_ptr<osg::PositionAttitudeTransform> glider = new osg::PositionAttitudeTransform();
+            glider->addChild(gliderNode);
+            laneTransforms[i % lanes]->addChild(glider);
+            animator->addInstance(gliderPathIndex, glider, gliderPath->getPeriod() * (i / lanes) / perLane);
+        }
+    }
+
     //create dupTruck with LOD
     osg::ref_ptr<osg::Node> dumpTruck = osgDB::readNodeFile("dumptruck.osg");
-
-    //use LODs
-    osgUtil::Simplifier simple(0.53);
-    simple.setMaximumLength(2.0f);
-
-    osg::ref_ptr<osg::Node> dumpTruckLower =
-            dynamic_cast<osg::Node*>(dumpTruck->clone(osg::CopyOp::DEEP_COPY_ALL));
-    dumpTruckLower->accept(simple);
-
-    osg::ref_ptr<osg::Node> dumpTruckLowest =
-            dynamic_cast<osg::Node*>(dumpTruck->clone(osg::CopyOp::DEEP_COPY_ALL));
-    simple.setSampleRatio(0.1f);
-    dumpTruckLowest->accept(simple);
-
-    osg::ref_ptr<osg::LOD> dumpTruckLOD = new osg::LOD();
-    dumpTruckLOD->setRangeMode( osg::LOD::DISTANCE_FROM_EYE_POINT );
-    dumpTruckLOD->addChild(dumpTruck, 0,200);
-    dumpTruckLOD->addChild(dumpTruckLower, 201,500);
-    dumpTruckLOD->addChild(dumpTruckLowest,501,10000);
+    compactor.compact(dumpTruck, "dumptruck.osg");
+    textureCache.compressTextures(dumpTruck);
+    compactor.report(osg::notify(osg::NOTICE));
+    textureCache.report(osg::notify(osg::NOTICE));
+
+    //use LODs, simplified on worker threads until the error would show as more than a pixel
+    LodGenerator lodGenerator;
+    lodGenerator.setNumLevels(3);
+    lodGenerator.setTargetError(0.005f);
+    lodGenerator.setPixelError(1.0f, 60.0f);
+    unsigned int dumpTruckLevels = lodGenerator.add(dumpTruck, "dumptruck.osg");
+    lodGenerator.wait();
+    lodGenerator.report(osg::notify(osg::NOTICE));
+
+    osg::ref_ptr<osg::LOD> dumpTruckLOD = lodGenerator.getLOD(dumpTruckLevels);
 
     osg::ref_ptr<osg::PositionAttitudeTransform> dumpTruckTransform =
             new osg::PositionAttitudeTransform();
@@ -178,6 +251,28 @@ int main(int argc, char *argv[]) {
     //add to root
     root->addChild(dumpTruckTransform);
 
+    //a fleet of trucks on the ground with --fleet <count>, drawn instanced from the same LOD chain
+    unsigned int fleetSize = 0;
+    if ( arguments.read("--fleet", fleetSize) && fleetSize > 0 ) {
+        osg::ref_ptr<InstancedLOD> fleet = new InstancedLOD(dumpTruckLOD);
+
+        //row by row so that neighbours end up in the same batch
+        unsigned int side = (unsigned int) std::ceil(std::sqrt(float(fleetSize)));
+        float spacing = (DIMX - 16) * INTX / side;
+        for ( unsigned int i = 0; i < fleetSize; ++i ) {
+            float x = (i % side + 0.5f) * spacing - (DIMX - 16) * INTX * 0.5f;
+            float y = (i / side + 0.5f) * spacing - (DIMY - 16) * INTY * 0.5f;
+            float z = 0.0f;
+            if ( groundQuery.valid() )
+                groundQuery->getHeight(x, y, z);
+
+            fleet->addInstance( osg::Matrix::scale(1.5, 1.5, 1.5) *
+                                osg::Matrix::rotate(osg::DegreesToRadians(float(i * 37 % 360)), osg::Z_AXIS) *
+                                osg::Matrix::translate(x, y, z) );
+        }
+        root->addChild(fleet);
+    }
+
 
     osg::StateSet *root_state = root->getOrCreateStateSet();
 
@@ -265,20 +360,36 @@ int main(int argc, char *argv[]) {
 **********************************************************************************************************/
 
 
-osg::ref_ptr<osg::Geode> createGround(int dimX, int dimY, float intervalX, float intervalY) {
+osg::ref_ptr<osg::Node> createGround(int dimX, int dimY, float intervalX, float intervalY, TextureCache& textureCache) {
     //create field
     osg::ref_ptr<osg::HeightField> field = createHeightField( dimX, dimY, intervalX, intervalY );
 
     //add texture to field
-    osg::ref_ptr<osg::Texture2D> groundTexture = addTexture();
+    osg::ref_ptr<osg::Texture2D> groundTexture = addTexture( textureCache );
+
+    //split the field into chunks that are refined by screen space error
+    osg::ref_ptr<TerrainChunk> terrain = createTerrain( field, 64, 2.0f );
+    terrain->getOrCreateStateSet()->setTextureAttributeAndModes(0, groundTexture);
+
+    //picks against the ground march the field instead of the chunk meshes
+    groundQuery = new TerrainQuery( field );
+    terrain->setNodeMask( ~INTERSECT_MASK );
 
-    //add ground with texture to scene
-    osg::ref_ptr<osg::Geode> groundGeode = new osg::Geode();
-    groundGeode->addDrawable(new osg::ShapeDrawable(field));
-    groundGeode->getOrCreateStateSet()->setTextureAttributeAndModes(0, groundTexture);
+    return terrain;
 
-    return groundGeode;
+}
+
+osg::ref_ptr<osg::Node> createPagedGround( const std::string& fileName, unsigned int columns, unsigned int rows, float scale, float intervalX, float intervalY, TextureCache& textureCache ) {
+    osg::ref_ptr<RawTerrainSource> source = new RawTerrainSource( fileName, columns, rows, scale );
 
+    //centre the terrain like the height map ground
+    osg::Vec3 origin( -float(columns / 2) * intervalX, -float(rows / 2) * intervalY, 0.0f );
+    osg::ref_ptr<TerrainPager> pager = new TerrainPager( source, origin, intervalX, intervalY, 256 );
+    pager->setLoadRadius( 2000.0f );
+    pager->setMemoryBudget( 512 * 1024 * 1024 );
+    pager->getOrCreateStateSet()->setTextureAttributeAndModes(0, addTexture( textureCache ));
+
+    return pager;
 }
 
 osg::ref_ptr<osg::HeightField> createHeightField( int dimX, int dimY, float intervalX, float intervalY ) {
@@ -294,16 +405,17 @@ osg::ref_ptr<osg::HeightField> createHeightField( int dimX, int dimY, float inte
     field->setYInterval( intervalY );
     field->setOrigin(osg::Vec3(-(dimX / 2), -(dimY / 2), 0.0f));
 
-    setHeights(field, heightMap);
+    //a full scale pixel is 255/12 units high
+    setHeights(field, heightMap, 255.0f / 12.0f);
 
     return field;
 }
 
 
-osg::ref_ptr<osg::Texture2D> addTexture(){
+osg::ref_ptr<osg::Texture2D> addTexture( TextureCache& textureCache ){
 
     //set ground texture
-    osg::ref_ptr<osg::Texture2D> groundTexture  = new osg::Texture2D(osgDB::readImageFile("ground.png"));
+    osg::ref_ptr<osg::Texture2D> groundTexture  = new osg::Texture2D(textureCache.readImage("ground.png"));
 
 //wrapping of texture
     groundTexture->setWrap(osg::Texture::WRAP_S, osg::Texture::REPEAT);
@@ -314,17 +426,7 @@ osg::ref_ptr<osg::Texture2D> addTexture(){
 }
 
 
-void setHeights ( osg::ref_ptr<osg::HeightField> field, osg::ref_ptr<osg::Image> heightMap ){
-    //set the Height at each point
-    for (unsigned int r = 0; r < field->getNumRows(); r++) {
-        for (unsigned int c = 0; c < field->getNumColumns(); c++) {
-            float heightMapVal = ((float) *heightMap->data(c, r) / 12);
-            field->setHeight(c, r, heightMapVal);
-        }
-    }
-}
-
-void addPathTo( osg::ref_ptr<osg::PositionAttitudeTransform> nodeTransform) {
+osg::ref_ptr<osg::AnimationPath> createGliderPath() {
 
     //set animation path
     osg::ref_ptr<osg::AnimationPath> gliderPath = new osg::AnimationPath();
@@ -335,10 +437,7 @@ void addPathTo( osg::ref_ptr<osg::PositionAttitudeTransform> nodeTransform) {
     //set loop-mode
     gliderPath->setLoopMode(osg::AnimationPath::LOOP);
 
-    osg::ref_ptr<osg::AnimationPathCallback> glidercb =
-            new osg::AnimationPathCallback(gliderPath);
-
-    nodeTransform->setUpdateCallback(glidercb);
+    return gliderPath;
 }
 
 void addPoints( osg::ref_ptr<osg::AnimationPath> path ){
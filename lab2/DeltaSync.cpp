@@ -0,0 +1,354 @@
+#include "DeltaSync.h"
+
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+const unsigned char FLAG_KEYFRAME = 1;
+const unsigned char FIELD_END = 0xFF;
+
+const unsigned char POSE_COMPACT = 0;
+const unsigned char POSE_FULL = 1;
+
+const float RIGID_EPSILON = 1e-3f;
+const float QUAT_SCALE = 32767.0f * 1.41421356f; //the three smallest components are within +-1/sqrt(2)
+
+template <class T>
+void append(std::vector<unsigned char>& out, const T& value) {
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+  out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+bool isRigid(const glm::mat4& m) {
+  const glm::vec3 x(m[0]), y(m[1]), z(m[2]);
+  return std::fabs(glm::length(x) - 1.0f) < RIGID_EPSILON &&
+         std::fabs(glm::length(y) - 1.0f) < RIGID_EPSILON &&
+         std::fabs(glm::length(z) - 1.0f) < RIGID_EPSILON &&
+         std::fabs(glm::dot(x, y)) < RIGID_EPSILON &&
+         std::fabs(glm::dot(y, z)) < RIGID_EPSILON &&
+         std::fabs(glm::dot(z, x)) < RIGID_EPSILON &&
+         glm::dot(glm::cross(x, y), z) > 0.0f &&
+         m[0][3] == 0.0f && m[1][3] == 0.0f && m[2][3] == 0.0f && m[3][3] == 1.0f;
+}
+
+void encodePose(const glm::mat4& m, std::vector<unsigned char>& out) {
+  if (!isRigid(m)) {
+    out.push_back(POSE_FULL);
+    append(out, m);
+    return;
+  }
+
+  out.push_back(POSE_COMPACT);
+  append(out, glm::vec3(m[3]));
+
+  //smallest three: drop the largest component, its sign is made positive as q and -q are the same rotation
+  const glm::quat q = glm::quat_cast(glm::mat3(m));
+  float c[4] = { q.x, q.y, q.z, q.w };
+  unsigned char largest = 0;
+  for (unsigned char i = 1; i < 4; ++i) {
+    if (std::fabs(c[i]) > std::fabs(c[largest]))
+      largest = i;
+  }
+  const float sign = c[largest] < 0.0f ? -1.0f : 1.0f;
+
+  out.push_back(largest);
+  for (unsigned char i = 0; i < 4; ++i) {
+    if (i == largest)
+      continue;
+    const float value = std::max(-32767.0f, std::min(32767.0f, sign * c[i] * QUAT_SCALE));
+    append(out, static_cast<short>(std::floor(value + 0.5f)));
+  }
+}
+
+}
+
+/***********************************************************************************************************
+*                                     ENCODER
+**********************************************************************************************************/
+
+DeltaEncoder::DeltaEncoder(unsigned int keyframeInterval)
+  : mKeyframeInterval(keyframeInterval),
+    mFramesToKeyframe(0),
+    mKeyframe(false) {
+}
+
+void DeltaEncoder::begin() {
+  mKeyframe = mFramesToKeyframe == 0;
+  mFramesToKeyframe = mKeyframe ? mKeyframeInterval : mFramesToKeyframe - 1;
+
+  mBuffer.clear();
+  mBuffer.push_back(mKeyframe ? FLAG_KEYFRAME : 0);
+}
+
+const std::vector<unsigned char>& DeltaEncoder::end() {
+  mBuffer.push_back(FIELD_END);
+  return mBuffer;
+}
+
+DeltaEncoder::Record& DeltaEncoder::record(unsigned char field, unsigned int index) {
+  if (mRecords.size() <= field)
+    mRecords.resize(field + 1);
+  if (mRecords[field].size() <= index)
+    mRecords[field].resize(index + 1);
+  return mRecords[field][index];
+}
+
+void DeltaEncoder::writeField(unsigned char field, bool force) {
+  //the scratch holds the encoded value, it is only written if it differs from the last sent one
+  Record& last = record(field);
+  if (!force && !mKeyframe && last.valid && last.bytes == mScratch)
+    return;
+
+  last.bytes = mScratch;
+  last.valid = true;
+  mBuffer.push_back(field);
+  mBuffer.insert(mBuffer.end(), mScratch.begin(), mScratch.end());
+}
+
+void DeltaEncoder::writeDouble(unsigned char field, double value) {
+  mScratch.clear();
+  append(mScratch, value);
+  writeField(field);
+}
+
+void DeltaEncoder::writeBool(unsigned char field, bool value) {
+  mScratch.clear();
+  mScratch.push_back(value ? 1 : 0);
+  writeField(field);
+}
+
+void DeltaEncoder::writeString(unsigned char field, const std::string& value) {
+  mScratch.clear();
+  append(mScratch, static_cast<unsigned int>(value.size()));
+  mScratch.insert(mScratch.end(), value.begin(), value.end());
+  writeField(field);
+}
+
+void DeltaEncoder::writeBools(unsigned char field, const std::vector<bool>& values) {
+  mScratch.clear();
+  append(mScratch, static_cast<unsigned short>(values.size()));
+  mScratch.resize(mScratch.size() + (values.size() + 7) / 8, 0);
+  for (size_t i = 0; i < values.size(); ++i) {
+    if (values[i])
+      mScratch[sizeof(unsigned short) + i / 8] |= 1 << (i % 8);
+  }
+  writeField(field);
+}
+
+void DeltaEncoder::writeBits(unsigned char field, uint64_t bits, unsigned int numBits, bool force) {
+  mScratch.clear();
+  for (unsigned int i = 0; i < numBits; i += 8)
+    mScratch.push_back(static_cast<unsigned char>(bits >> i));
+  writeField(field, force);
+}
+
+void DeltaEncoder::writeFloats(unsigned char field, const std::vector<float>& values) {
+  mScratch.clear();
+  append(mScratch, static_cast<unsigned short>(values.size()));
+  if (!values.empty()) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&values[0]);
+    mScratch.insert(mScratch.end(), bytes, bytes + values.size() * sizeof(float));
+  }
+  writeField(field);
+}
+
+void DeltaEncoder::writeBytes(unsigned char field, const std::vector<unsigned char>& values) {
+  mScratch.clear();
+  append(mScratch, static_cast<unsigned short>(values.size()));
+  mScratch.insert(mScratch.end(), values.begin(), values.end());
+  writeField(field);
+}
+
+void DeltaEncoder::writePoses(unsigned char field, const std::vector<glm::mat4>& poses) {
+  //record 0 holds the count, a new count sends every pose
+  const unsigned short count = poses.size();
+  mScratch.clear();
+  append(mScratch, count);
+  Record& last = record(field);
+  const bool all = mKeyframe || !last.valid || last.bytes != mScratch;
+  last.bytes = mScratch;
+  last.valid = true;
+
+  mChanged.assign((count + 7) / 8, 0);
+  bool changed = all;
+  for (unsigned short i = 0; i < count; ++i) {
+    mScratch.clear();
+    encodePose(poses[i], mScratch);
+    Record& pose = record(field, i + 1);
+    if (!all && pose.valid && pose.bytes == mScratch)
+      continue;
+
+    pose.bytes = mScratch;
+    pose.valid = true;
+    mChanged[i / 8] |= 1 << (i % 8);
+    changed = true;
+  }
+
+  if (!changed)
+    return;
+
+  mBuffer.push_back(field);
+  append(mBuffer, count);
+  mBuffer.insert(mBuffer.end(), mChanged.begin(), mChanged.end());
+  for (unsigned short i = 0; i < count; ++i) {
+    if (mChanged[i / 8] & (1 << (i % 8))) {
+      const std::vector<unsigned char>& bytes = mRecords[field][i + 1].bytes;
+      mBuffer.insert(mBuffer.end(), bytes.begin(), bytes.end());
+    }
+  }
+}
+
+/***********************************************************************************************************
+*                                     DECODER
+**********************************************************************************************************/
+
+DeltaDecoder::DeltaDecoder()
+  : mData(NULL),
+    mSize(0),
+    mPos(0),
+    mKeyframe(false) {
+}
+
+bool DeltaDecoder::begin(const std::vector<unsigned char>& buffer) {
+  return begin(buffer.empty() ? NULL : &buffer[0], buffer.size());
+}
+
+bool DeltaDecoder::begin(const unsigned char* data, size_t size) {
+  mData = data;
+  mSize = size;
+  mPos = 1;
+  if (size < 2) {
+    mPos = size;
+    return false;
+  }
+  mKeyframe = (data[0] & FLAG_KEYFRAME) != 0;
+  return true;
+}
+
+bool DeltaDecoder::next(unsigned char field) {
+  if (!mData || mPos >= mSize || mData[mPos] != field)
+    return false;
+  ++mPos;
+  return true;
+}
+
+bool DeltaDecoder::read(void* data, size_t size) {
+  if (mPos + size > mSize) {
+    mPos = mSize; //truncated, ignore the rest of the frame
+    return false;
+  }
+  std::memcpy(data, mData + mPos, size);
+  mPos += size;
+  return true;
+}
+
+bool DeltaDecoder::readDouble(unsigned char field, double& value) {
+  return next(field) && read(&value, sizeof(double));
+}
+
+bool DeltaDecoder::readBool(unsigned char field, bool& value) {
+  unsigned char byte;
+  if (!next(field) || !read(&byte, 1))
+    return false;
+  value = byte != 0;
+  return true;
+}
+
+bool DeltaDecoder::readString(unsigned char field, std::string& value) {
+  unsigned int size;
+  if (!next(field) || !read(&size, sizeof(size)) || mPos + size > mSize)
+    return false;
+  value.assign(reinterpret_cast<const char*>(mData + mPos), size);
+  mPos += size;
+  return true;
+}
+
+bool DeltaDecoder::readBools(unsigned char field, std::vector<bool>& values) {
+  unsigned short count;
+  if (!next(field) || !read(&count, sizeof(count)) || mPos + (count + 7) / 8 > mSize)
+    return false;
+  values.resize(count);
+  for (unsigned short i = 0; i < count; ++i)
+    values[i] = (mData[mPos + i / 8] & (1 << (i % 8))) != 0;
+  mPos += (count + 7) / 8;
+  return true;
+}
+
+bool DeltaDecoder::readBits(unsigned char field, uint64_t& bits, unsigned int numBits) {
+  const unsigned int numBytes = (numBits + 7) / 8;
+  if (!next(field) || mPos + numBytes > mSize)
+    return false;
+  bits = 0;
+  for (unsigned int i = 0; i < numBytes; ++i)
+    bits |= static_cast<uint64_t>(mData[mPos + i]) << (8 * i);
+  mPos += numBytes;
+  return true;
+}
+
+bool DeltaDecoder::readFloats(unsigned char field, std::vector<float>& values) {
+  unsigned short count;
+  if (!next(field) || !read(&count, sizeof(count)) || mPos + count * sizeof(float) > mSize)
+    return false;
+  values.resize(count);
+  return count == 0 || read(&values[0], count * sizeof(float));
+}
+
+bool DeltaDecoder::readBytes(unsigned char field, std::vector<unsigned char>& values) {
+  unsigned short count;
+  if (!next(field) || !read(&count, sizeof(count)) || mPos + count > mSize)
+    return false;
+  values.assign(mData + mPos, mData + mPos + count);
+  mPos += count;
+  return true;
+}
+
+bool DeltaDecoder::readPoses(unsigned char field, std::vector<glm::mat4>& poses) {
+  unsigned short count;
+  if (!next(field) || !read(&count, sizeof(count)))
+    return false;
+
+  const size_t mask = mPos;
+  mPos += (count + 7) / 8;
+  if (mPos > mSize)
+    return false;
+
+  poses.resize(count, glm::mat4(1.0f));
+  for (unsigned short i = 0; i < count; ++i) {
+    if (!(mData[mask + i / 8] & (1 << (i % 8))))
+      continue;
+
+    unsigned char type;
+    if (!read(&type, 1))
+      return false;
+
+    if (type == POSE_FULL) {
+      if (!read(&poses[i], sizeof(glm::mat4)))
+        return false;
+      continue;
+    }
+
+    glm::vec3 position;
+    unsigned char largest;
+    short packed[3];
+    if (!read(&position, sizeof(position)) || !read(&largest, 1) || !read(packed, sizeof(packed)) || largest > 3)
+      return false;
+
+    float c[4];
+    float sum = 0.0f;
+    for (unsigned char k = 0, j = 0; k < 4; ++k) {
+      if (k == largest)
+        continue;
+      c[k] = packed[j++] / QUAT_SCALE;
+      sum += c[k] * c[k];
+    }
+    c[largest] = std::sqrt(std::max(0.0f, 1.0f - sum));
+
+    poses[i] = glm::mat4_cast(glm::quat(c[3], c[0], c[1], c[2]));
+    poses[i][3] = glm::vec4(position, 1.0f);
+  }
+  return true;
+}
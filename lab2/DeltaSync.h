@@ -0,0 +1,103 @@
+#ifndef DELTASYNC_H
+#define DELTASYNC_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Delta encoding of the state the master shares with the cluster.
+ *
+ * The encoder remembers what it sent last for every field and only writes the
+ * fields that changed since, each prefixed with its id. Every keyframe interval
+ * all fields are written regardless so that a node can recover from any state.
+ * SGCT delivers every frame to every node in order before the next one is
+ * encoded, so the last sent frame is also the last acknowledged one.
+ *
+ * Poses are written as a position and a quaternion with its largest component
+ * dropped and the other three in 16 bits each, 19 bytes instead of 64. Poses
+ * that are not rigid, like scaled tracker transforms, fall back to 16 floats.
+ * Only the poses of a vector that changed are written. Bits are written in as
+ * few bytes as their count takes, the count itself is not sent.
+ *
+ * The decoder is called with the same fields in the same order and leaves the
+ * value alone when a field is not in the frame.
+ */
+class DeltaEncoder
+{
+public:
+  DeltaEncoder(unsigned int keyframeInterval = 60);
+
+  void setKeyframeInterval(unsigned int frames) { mKeyframeInterval = frames; }
+  //the next frame is written in full
+  void forceKeyframe() { mFramesToKeyframe = 0; }
+
+  void begin();
+  void writeDouble(unsigned char field, double value);
+  void writeBool(unsigned char field, bool value);
+  void writeString(unsigned char field, const std::string& value);
+  void writeBools(unsigned char field, const std::vector<bool>& values);
+  //force writes the bits even if they are the ones sent last
+  void writeBits(unsigned char field, uint64_t bits, unsigned int numBits, bool force = false);
+  void writeFloats(unsigned char field, const std::vector<float>& values);
+  void writeBytes(unsigned char field, const std::vector<unsigned char>& values);
+  void writePoses(unsigned char field, const std::vector<glm::mat4>& poses);
+  const std::vector<unsigned char>& end();
+
+  bool isKeyframe() const { return mKeyframe; }
+
+private:
+  //the encoding of a field or of one pose, compared with the last sent one
+  struct Record {
+    std::vector<unsigned char> bytes;
+    bool valid;
+    Record() : valid(false) {}
+  };
+
+  Record& record(unsigned char field, unsigned int index = 0);
+  void writeField(unsigned char field, bool force = false);
+
+  unsigned int mKeyframeInterval;
+  unsigned int mFramesToKeyframe;
+  bool mKeyframe;
+
+  std::vector<unsigned char> mBuffer;
+  std::vector<unsigned char> mScratch;
+  std::vector<std::vector<Record> > mRecords;
+  std::vector<unsigned char> mChanged;
+};
+
+class DeltaDecoder
+{
+public:
+  DeltaDecoder();
+
+  //start reading a frame, false if it is malformed, the data must outlive the reads
+  bool begin(const std::vector<unsigned char>& buffer);
+  bool begin(const unsigned char* data, size_t size);
+
+  //each returns true if the field was in the frame and value was updated
+  bool readDouble(unsigned char field, double& value);
+  bool readBool(unsigned char field, bool& value);
+  bool readString(unsigned char field, std::string& value);
+  bool readBools(unsigned char field, std::vector<bool>& values);
+  bool readBits(unsigned char field, uint64_t& bits, unsigned int numBits);
+  bool readFloats(unsigned char field, std::vector<float>& values);
+  bool readBytes(unsigned char field, std::vector<unsigned char>& values);
+  bool readPoses(unsigned char field, std::vector<glm::mat4>& poses);
+
+  bool isKeyframe() const { return mKeyframe; }
+
+private:
+  bool next(unsigned char field);
+  bool read(void* data, size_t size);
+
+  const unsigned char* mData;
+  size_t mSize;
+  size_t mPos;
+  bool mKeyframe;
+};
+
+#endif
@@ -0,0 +1,102 @@
+#include "DynamicGeometry.h"
+
+#include <algorithm>
+
+namespace {
+
+//only the vertices that are drawn count, the rest of the capacity holds stale data
+class DrawnBound : public osg::Drawable::ComputeBoundingBoxCallback
+{
+public:
+  virtual osg::BoundingBox computeBound(const osg::Drawable& drawable) const {
+    const DynamicGeometry& geometry = static_cast<const DynamicGeometry&>(drawable);
+    const osg::Vec3Array* vertices = static_cast<const osg::Vec3Array*>(geometry.getVertexArray());
+
+    osg::BoundingBox box;
+    for (unsigned int i = 0; i < geometry.getNumVertices(); ++i)
+      box.expandBy((*vertices)[i]);
+    return box;
+  }
+};
+
+}
+
+DynamicGeometry::DynamicGeometry(GLenum mode, unsigned int capacity)
+  : mVertices(new osg::Vec3Array(capacity)),
+    mColors(new osg::Vec4Array(capacity)),
+    mDrawArrays(new osg::DrawArrays(mode, 0, 0)),
+    mCount(0),
+    mDirtyFirst(capacity),
+    mDirtyLast(0),
+    mVerticesDirty(false),
+    mColorsDirty(false) {
+  //the arrays keep their size for the life of the geometry, so uploads never resize the buffers
+  mVertices->setDataVariance(osg::Object::DYNAMIC);
+  mColors->setDataVariance(osg::Object::DYNAMIC);
+  std::fill(mColors->begin(), mColors->end(), osg::Vec4(1.0f, 1.0f, 1.0f, 1.0f));
+
+  setDataVariance(osg::Object::DYNAMIC);
+  setUseDisplayList(false);
+  setUseVertexBufferObjects(true);
+
+  setVertexArray(mVertices.get());
+  setColorArray(mColors.get(), osg::Array::BIND_PER_VERTEX);
+  addPrimitiveSet(mDrawArrays.get());
+  setComputeBoundingBoxCallback(new DrawnBound());
+}
+
+void DynamicGeometry::setNumVertices(unsigned int count) {
+  mCount = std::min(count, getCapacity());
+}
+
+void DynamicGeometry::setVertex(unsigned int index, const osg::Vec3& vertex) {
+  if (index >= getCapacity() || (*mVertices)[index] == vertex)
+    return;
+
+  (*mVertices)[index] = vertex;
+  mVerticesDirty = true;
+  markDirty(index);
+}
+
+void DynamicGeometry::setColor(unsigned int index, const osg::Vec4& color) {
+  if (index >= getCapacity() || (*mColors)[index] == color)
+    return;
+
+  (*mColors)[index] = color;
+  mColorsDirty = true;
+  markDirty(index);
+}
+
+void DynamicGeometry::setColor(const osg::Vec4& color) {
+  for (unsigned int i = 0; i < getCapacity(); ++i)
+    setColor(i, color);
+}
+
+void DynamicGeometry::markDirty(unsigned int index) {
+  mDirtyFirst = std::min(mDirtyFirst, index);
+  mDirtyLast = std::max(mDirtyLast, index + 1);
+}
+
+void DynamicGeometry::commit() {
+  if ((unsigned int)mDrawArrays->getCount() != mCount) {
+    mDrawArrays->setCount(mCount);
+    mDrawArrays->dirty();
+    dirtyBound();
+  }
+
+  if (mDirtyFirst >= mDirtyLast)
+    return;
+
+  //the arrays are sent with glBufferSubData into their existing buffers
+  if (mVerticesDirty) {
+    mVertices->dirty();
+    dirtyBound();
+  }
+  if (mColorsDirty)
+    mColors->dirty();
+
+  mDirtyFirst = getCapacity();
+  mDirtyLast = 0;
+  mVerticesDirty = false;
+  mColorsDirty = false;
+}
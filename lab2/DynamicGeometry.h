@@ -0,0 +1,54 @@
+#ifndef DYNAMICGEOMETRY_H
+#define DYNAMICGEOMETRY_H
+
+#include <osg/Geometry>
+
+/*
+ * Geometry that is rewritten every frame without allocating.
+ *
+ * The vertex and color arrays are allocated once with room for a fixed number
+ * of vertices and drawn from vertex buffer objects, never from a display list.
+ * Vertices are written in place and the range that changed is tracked. commit()
+ * sets how many vertices are drawn and only marks the arrays for upload when
+ * something changed, so the buffers are updated in place and idle frames send
+ * nothing to the GPU.
+ */
+class DynamicGeometry : public osg::Geometry
+{
+public:
+  DynamicGeometry(GLenum mode, unsigned int capacity);
+
+  unsigned int getCapacity() const { return mVertices->size(); }
+
+  //vertices drawn after the next commit, clamped to the capacity
+  void setNumVertices(unsigned int count);
+  unsigned int getNumVertices() const { return mCount; }
+
+  void setVertex(unsigned int index, const osg::Vec3& vertex);
+  void setColor(unsigned int index, const osg::Vec4& color);
+  //same color for every vertex
+  void setColor(const osg::Vec4& color);
+
+  //first changed vertex and one past the last since the last commit, empty when first >= last
+  unsigned int getDirtyFirst() const { return mDirtyFirst; }
+  unsigned int getDirtyLast() const { return mDirtyLast; }
+
+  //hand this frame's changes to the buffers
+  void commit();
+
+protected:
+  virtual ~DynamicGeometry() {}
+
+  void markDirty(unsigned int index);
+
+  osg::ref_ptr<osg::Vec3Array> mVertices;
+  osg::ref_ptr<osg::Vec4Array> mColors;
+  osg::ref_ptr<osg::DrawArrays> mDrawArrays;
+  unsigned int mCount;
+  unsigned int mDirtyFirst;
+  unsigned int mDirtyLast;
+  bool mVerticesDirty;
+  bool mColorsDirty;
+};
+
+#endif
@@ -0,0 +1,79 @@
+#include "Highlighter.h"
+
+#include <osg/Material>
+#include <osgUtil/CullVisitor>
+
+#include <algorithm>
+
+/*
+ * Cull callback on a model, other visitors pass through untouched.
+ */
+class Highlighter::HighlightCallback : public osg::NodeCallback
+{
+public:
+  HighlightCallback(const osg::ref_ptr<osg::StateSet>* stateSets)
+    : mStateSets(stateSets),
+      mHighlight(HIGHLIGHT_IDLE) {
+  }
+
+  virtual void operator()(osg::Node* node, osg::NodeVisitor* nv) {
+    osgUtil::CullVisitor* cv = mHighlight == HIGHLIGHT_IDLE ? NULL : dynamic_cast<osgUtil::CullVisitor*>(nv);
+    if (cv)
+      cv->pushStateSet(mStateSets[mHighlight].get());
+    traverse(node, nv);
+    if (cv)
+      cv->popStateSet();
+  }
+
+  const osg::ref_ptr<osg::StateSet>* mStateSets;
+  Highlight mHighlight;
+};
+
+Highlighter::Highlighter(PickBvh& pickBvh)
+  : mPickBvh(pickBvh) {
+  for (unsigned int i = HIGHLIGHT_HOVER; i < NUM_HIGHLIGHTS; ++i) {
+    mStateSets[i] = new osg::StateSet();
+    mStateSets[i]->setAttributeAndModes(new osg::Material(), osg::StateAttribute::OVERRIDE);
+  }
+  setColor(HIGHLIGHT_HOVER, osg::Vec4(1.0f, 1.0f, 0.0f, 1.0f));
+  setColor(HIGHLIGHT_SELECTED, osg::Vec4(0.0f, 1.0f, 0.0f, 1.0f));
+}
+
+Highlighter::~Highlighter() {
+  for (unsigned int i = 0; i < mCallbacks.size(); ++i)
+    mPickBvh.getObject(i)->removeCullCallback(mCallbacks[i].get());
+}
+
+void Highlighter::setColor(Highlight highlight, const osg::Vec4& color) {
+  if (highlight == HIGHLIGHT_IDLE)
+    return;
+  osg::Material* material = static_cast<osg::Material*>(mStateSets[highlight]->getAttribute(osg::StateAttribute::MATERIAL));
+  material->setAmbient(osg::Material::FRONT_AND_BACK, color);
+  material->setDiffuse(osg::Material::FRONT_AND_BACK, color);
+}
+
+void Highlighter::attach() {
+  for (unsigned int i = mCallbacks.size(); i < mPickBvh.getNumObjects(); ++i) {
+    mCallbacks.push_back(new HighlightCallback(mStateSets));
+    mPickBvh.getObject(i)->addCullCallback(mCallbacks.back().get());
+  }
+}
+
+void Highlighter::set(unsigned int object, Highlight highlight) {
+  Highlight& current = mCallbacks[object]->mHighlight;
+  if (current == HIGHLIGHT_IDLE && highlight != HIGHLIGHT_IDLE)
+    mHighlighted.push_back(object);
+  else if (current != HIGHLIGHT_IDLE && highlight == HIGHLIGHT_IDLE)
+    mHighlighted.erase(std::find(mHighlighted.begin(), mHighlighted.end(), object));
+  current = highlight;
+}
+
+Highlighter::Highlight Highlighter::get(unsigned int object) const {
+  return mCallbacks[object]->mHighlight;
+}
+
+void Highlighter::clear() {
+  for (size_t i = 0; i < mHighlighted.size(); ++i)
+    mCallbacks[mHighlighted[i]]->mHighlight = HIGHLIGHT_IDLE;
+  mHighlighted.clear();
+}
@@ -0,0 +1,53 @@
+#ifndef HIGHLIGHTER_H
+#define HIGHLIGHTER_H
+
+#include <osg/NodeCallback>
+#include <osg/StateSet>
+
+#include "PickBvh.h"
+
+#include <vector>
+
+/*
+ * Hover and selection highlighting that never changes the models' own state.
+ *
+ * Every highlight but idle has one StateSet, made up front and shared by all
+ * models, that overrides the material. Each model in the PickBvh gets a cull
+ * callback that pushes the StateSet of its highlight around its subgraph, so
+ * changing a highlight is a single write, with no allocation and no attribute
+ * added or removed. The render graph only ever sees the same few StateSets,
+ * so its sorting stays the same from frame to frame.
+ *
+ * The cull reads the highlights, so they must only change while nothing is
+ * culled.
+ */
+class Highlighter
+{
+public:
+  enum Highlight { HIGHLIGHT_IDLE = 0, HIGHLIGHT_HOVER, HIGHLIGHT_SELECTED, NUM_HIGHLIGHTS };
+
+  Highlighter(PickBvh& pickBvh);
+  ~Highlighter();
+
+  //ambient and diffuse of a highlight, idle shows the model as it is
+  void setColor(Highlight highlight, const osg::Vec4& color);
+
+  //give the objects added to the PickBvh since the last call their callbacks
+  void attach();
+
+  //objects are PickBvh indices, attached ones only
+  void set(unsigned int object, Highlight highlight);
+  Highlight get(unsigned int object) const;
+  //every object back to idle
+  void clear();
+
+private:
+  class HighlightCallback;
+
+  PickBvh& mPickBvh;
+  osg::ref_ptr<osg::StateSet> mStateSets[NUM_HIGHLIGHTS];
+  std::vector< osg::ref_ptr<HighlightCallback> > mCallbacks; //per object
+  std::vector<unsigned int> mHighlighted; //the objects that are not idle
+};
+
+#endif
@@ -0,0 +1,159 @@
+#include "Interaction.h"
+#include "Logger.h"
+#include "TrackerState.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+
+Interaction::Interaction(SelectableRegistry& selectables)
+  : mSelectables(selectables),
+    mHighlighter(selectables.getPickBvh()),
+    mSelectedObject(0),
+    mHasHit(false),
+    mWandStart(0, -1, 0),
+    mWandEnd(0, 0, 0),
+    mWandMatrix(1.0f),
+    mWandStartPos(0.0f),
+    mWandStartMat(1.0f),
+    mTouched(false),
+    mMoving(false),
+    mPoint(false),
+    mCrosshair(false),
+    mScale(0) {
+}
+
+void Interaction::readInput(const TrackerState& tracker, unsigned int wandPose, unsigned int headPose, Input& input) {
+  input.hasWand = tracker.getNumPoses() > wandPose;
+  input.hasHead = tracker.getNumPoses() > headPose;
+  if (input.hasWand)
+    input.wand = tracker.getPose(wandPose);
+  if (input.hasHead)
+    input.head = tracker.getPose(headPose);
+  input.numButtons = std::min(tracker.getNumButtons(), MAX_BUTTONS);
+  for (unsigned int i = 0; i < input.numButtons; i++)
+    input.buttons[i] = tracker.getButton(i);
+}
+
+void Interaction::update(const Input& input) {
+  mPoint = false;
+  mCrosshair = false;
+
+  //Update position if button is pressed
+  if (input.numButtons > 0) {
+    if (input.button(1)) {
+      //point mode
+      mPoint = true;
+      mMoving = true;
+    }
+    else if (input.button(0)) {
+      //crosshair mode
+      mCrosshair = true;
+      mMoving = true;
+    }
+    else if (input.button(2)) {
+      //Selection of model, 4 and 5 scale it
+      mTouched = true;
+      if (input.button(4))
+        mScale = 1;
+      else if (input.button(5))
+        mScale = -1;
+      else
+        mScale = 0;
+    }
+    else {
+      mScale = 0;
+      mTouched = false;
+      mMoving = false;
+    }
+  }
+
+  //wand ray, one meter long
+  if (input.hasWand) {
+    const glm::vec3 start = glm::vec3(input.wand * glm::vec4(0, 0, 0, 1));
+    const glm::vec3 end = start + glm::mat3(input.wand) * glm::vec3(0, 0, -1);
+    mWandStart = osg::Vec3d(start.x, start.y, start.z);
+    mWandEnd = osg::Vec3d(end.x, end.y, end.z);
+  }
+
+  //movement - only if we have a head to move ;)
+  if (input.hasHead) {
+    if (!mMoving) {
+      //store initial position of wand for deadzone calculation
+      mWandStartPos = glm::vec3(mWandMatrix * glm::vec4(0, 0, 0, 1));
+    }
+
+    mWandMatrix = input.wand;
+    const glm::vec3 wandPosition = glm::vec3(mWandMatrix * glm::vec4(0, 0, 0, 1));
+    const glm::vec3 headPosition = glm::vec3(input.head * glm::vec4(0, 0, 0, 1));
+
+    //user sets speed, deadzone is 10 cm from original position
+    float speedFactor = (glm::length(mWandStartPos - wandPosition) < 0.1 ? 0 : glm::length(mWandStartPos - wandPosition) / 50);
+
+    //if we pull the control towards us it should go backwards
+    const int direction = (glm::length(mWandStartPos - headPosition) > glm::length(wandPosition - headPosition)) ? -1 : 1;
+    speedFactor *= direction;
+
+    //Move the world in the opposite direction for the movement effect
+    if (mPoint && mSceneTransform.valid()) {
+      const glm::vec3 translation = glm::mat3(mWandMatrix) * glm::vec3(0, 0, -1) * speedFactor;
+      mSceneTransform->postMult(osg::Matrix::translate(-osg::Vec3(translation.x, translation.y, translation.z)));
+    }
+    else if (mCrosshair && mSceneTransform.valid()) {
+      const glm::vec3 translation = glm::normalize(headPosition - wandPosition) * speedFactor;
+      mSceneTransform->postMult(osg::Matrix::translate(osg::Vec3(translation.x, translation.y, translation.z)));
+    }
+  }
+
+  if (!mTouched) {
+    //Save wand matrix for manipulation
+    mWandStartMat = mWandMatrix;
+  }
+}
+
+void Interaction::pick() {
+  //check the pickable models for intersection, only their boxes are refitted
+  mSelectables.getPickBvh().refit();
+  mHasHit = mSelectables.getPickBvh().intersect(mWandStart, mWandEnd, mHit);
+}
+
+void Interaction::apply() {
+  //models added since the last frame get their highlight callbacks
+  mHighlighter.attach();
+
+  if (!mSelected && mHasHit) {
+    //get intersection, store it and do something with the object
+    mSelectedObject = mSelectables.resolve(mHit);
+    mSelected = mSelectables.getNode(mSelectedObject);
+    LOG_DEBUG("Picked '%s' at %.3f along the wand", mSelected->getName().c_str(), mHit.ratio);
+    mHighlighter.set(mSelectedObject, Highlighter::HIGHLIGHT_HOVER);
+  }
+  else if (mTouched && mSelected) {
+    //object is touched -> highlight it
+    mHighlighter.set(mSelectedObject, Highlighter::HIGHLIGHT_SELECTED);
+
+    //difference between starting wand orientation and current pos to determine the transformation
+    const glm::mat4 diff = mWandStartMat;
+    const glm::mat4 diffInv = glm::inverse(mWandMatrix);
+
+    //objects registered without a transform only highlight
+    osg::MatrixTransform* transform = mSelectables.getTransform(mSelectedObject);
+
+    if (transform && mScale != 0) {
+      const float scaleVal = 0.05f;
+      const float scale = 1 - (scaleVal * mScale);
+
+      transform->postMult(osg::Matrix::scale(scale, scale, scale));
+    }
+    else if (transform) {
+      transform->postMult(osg::Matrix(glm::value_ptr(glm::inverse(diff * diffInv))));
+    }
+    mWandStartMat = mWandMatrix;
+  }
+  else if (!mHasHit) {
+    if (mSelected)
+      LOG_DEBUG("Released '%s'", mSelected->getName().c_str());
+    mHighlighter.clear();
+    mSelected = NULL;
+  }
+}
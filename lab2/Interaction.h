@@ -0,0 +1,93 @@
+#ifndef INTERACTION_H
+#define INTERACTION_H
+
+#include <osg/MatrixTransform>
+#include <osg/Node>
+
+#include <glm/glm.hpp>
+
+#include "Highlighter.h"
+#include "SelectableRegistry.h"
+
+class TrackerState;
+
+/*
+ * Wand interaction with the scene.
+ *
+ * The buttons pick a mode: button 1 flies along the wand, button 0 flies
+ * along the line from the head to the wand, button 2 grabs the model under the
+ * wand and turns it with the wand, or scales it while button 4 or 5 is held.
+ * Models are picked with the wand ray among the objects of a
+ * SelectableRegistry, and grabbing moves the transform registered with the
+ * object. The model under the wand is highlighted for hover, and again while
+ * it is grabbed.
+ *
+ * Nothing here knows about SGCT or a window, the input is handed in every
+ * frame, so the same code runs in the application and in the benchmark.
+ */
+class Interaction
+{
+public:
+  static const unsigned int MAX_BUTTONS = 8;
+
+  struct Input {
+    bool hasWand;
+    bool hasHead;
+    glm::mat4 wand;
+    glm::mat4 head;
+    unsigned int numButtons;
+    bool buttons[MAX_BUTTONS];
+
+    Input() : hasWand(false), hasHead(false), wand(1.0f), head(1.0f), numButtons(0) {}
+    bool button(unsigned int index) const { return index < numButtons && buttons[index]; }
+  };
+
+  //the input in the synced tracker state, with the wand and head at these poses
+  static void readInput(const TrackerState& tracker, unsigned int wandPose, unsigned int headPose, Input& input);
+
+  Interaction(SelectableRegistry& selectables);
+
+  //the transform that navigation moves
+  void setSceneTransform(osg::MatrixTransform* transform) { mSceneTransform = transform; }
+
+  //buttons, wand ray and navigation
+  void update(const Input& input);
+  //pick along the wand ray, only reads the scene so it may run while the scene is culled and drawn
+  void pick();
+  //highlight and manipulate the model the last pick found
+  void apply();
+  //both, one after the other
+  void intersect() { pick(); apply(); }
+
+  //grab without buttons, for the keyboard
+  void setTouched(bool touched) { mTouched = touched; }
+  bool isTouched() const { return mTouched; }
+
+  const osg::Vec3d& getWandStart() const { return mWandStart; }
+  const osg::Vec3d& getWandEnd() const { return mWandEnd; }
+  osg::Node* getSelected() const { return mSelected.get(); }
+  Highlighter& getHighlighter() { return mHighlighter; }
+
+private:
+  SelectableRegistry& mSelectables;
+  Highlighter mHighlighter;
+  osg::ref_ptr<osg::MatrixTransform> mSceneTransform;
+  osg::ref_ptr<osg::Node> mSelected;
+  unsigned int mSelectedObject;
+  PickBvh::Hit mHit;
+  bool mHasHit;
+
+  osg::Vec3d mWandStart;
+  osg::Vec3d mWandEnd;
+  glm::mat4 mWandMatrix;
+  glm::vec3 mWandStartPos;  //where a flight started, for the deadzone and speed
+  glm::mat4 mWandStartMat;  //wand when the last manipulation step was applied
+
+  bool mTouched;
+  bool mMoving;
+  bool mPoint;
+  bool mCrosshair;
+  int mScale;
+};
+
+#endif
@@ -0,0 +1,162 @@
+#include "Logger.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstring>
+
+namespace {
+
+const char* LEVEL_NAMES[] = { "error", "warning", "info", "debug" };
+const unsigned int DRAIN_INTERVAL_MS = 10;
+
+}
+
+std::atomic<int> Logger::sLevel(LOG_LEVEL_INFO);
+
+Logger& Logger::instance() {
+  static Logger logger;
+  return logger;
+}
+
+bool Logger::parseLevel(const std::string& name, LogLevel& level) {
+  for (int i = LOG_LEVEL_ERROR; i <= LOG_LEVEL_DEBUG; ++i) {
+    if (name == LEVEL_NAMES[i]) {
+      level = static_cast<LogLevel>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+const char* Logger::levelName(LogLevel level) {
+  return LEVEL_NAMES[level];
+}
+
+Logger::Logger()
+  : mStart(std::chrono::steady_clock::now()),
+    mDropped(0),
+    mConsole(true),
+    mFile(NULL),
+    mSink(NULL),
+    mStop(false) {
+  mWriter = std::thread(&Logger::run, this);
+}
+
+Logger::~Logger() {
+  stop();
+  if (mFile)
+    std::fclose(mFile);
+  //the rings stay with their threads until the process ends
+}
+
+void Logger::setConsole(bool console) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  mConsole = console;
+}
+
+bool Logger::setFile(const std::string& fileName) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (mFile)
+    std::fclose(mFile);
+  mFile = fileName.empty() ? NULL : std::fopen(fileName.c_str(), "a");
+  return fileName.empty() || mFile != NULL;
+}
+
+void Logger::setSink(Sink sink) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  mSink = sink;
+}
+
+Logger::Ring* Logger::threadRing() {
+  static thread_local Ring* ring = NULL;
+  if (!ring) {
+    ring = new Ring();
+    std::lock_guard<std::mutex> lock(mMutex);
+    mRings.push_back(ring);
+  }
+  return ring;
+}
+
+void Logger::log(LogLevel level, const char* format, ...) {
+  Ring* ring = threadRing();
+  const unsigned int head = ring->head.load(std::memory_order_relaxed);
+  if (head - ring->tail.load(std::memory_order_acquire) >= RING_SIZE) {
+    ring->dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  Message& message = ring->messages[head & (RING_SIZE - 1)];
+  message.time = std::chrono::duration<double>(std::chrono::steady_clock::now() - mStart).count();
+  message.level = level;
+
+  va_list args;
+  va_start(args, format);
+  const int length = std::vsnprintf(message.text, MESSAGE_SIZE, format, args);
+  va_end(args);
+
+  const size_t end = std::min<size_t>(std::max(length, 0), MESSAGE_SIZE - 1);
+  if (end > 0 && message.text[end - 1] == '\n')
+    message.text[end - 1] = '\0';
+
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+void Logger::flush() {
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  for (size_t r = 0; r < mRings.size(); ++r) {
+    Ring* ring = mRings[r];
+    const unsigned int head = ring->head.load(std::memory_order_acquire);
+    unsigned int tail = ring->tail.load(std::memory_order_relaxed);
+    for (; tail != head; ++tail)
+      mBatch.push_back(ring->messages[tail & (RING_SIZE - 1)]);
+    ring->tail.store(tail, std::memory_order_release);
+    mDropped += ring->dropped.exchange(0, std::memory_order_relaxed);
+  }
+
+  //each ring is in order already, this interleaves the threads
+  std::stable_sort(mBatch.begin(), mBatch.end(), [](const Message& a, const Message& b) { return a.time < b.time; });
+  for (size_t i = 0; i < mBatch.size(); ++i)
+    write(mBatch[i]);
+
+  if (mFile && !mBatch.empty())
+    std::fflush(mFile);
+  if (mConsole && !mBatch.empty())
+    std::fflush(stdout);
+  mBatch.clear();
+}
+
+unsigned long long Logger::getNumDropped() const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mDropped;
+}
+
+void Logger::stop() {
+  mStop.store(true);
+  if (mWriter.joinable())
+    mWriter.join();
+  flush();
+}
+
+void Logger::run() {
+  unsigned long long reported = 0;
+  while (!mStop.load()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(DRAIN_INTERVAL_MS));
+    flush();
+
+    const unsigned long long dropped = getNumDropped();
+    if (dropped != reported) {
+      LOG_WARNING("%llu log messages dropped, the rings were full", dropped - reported);
+      reported = dropped;
+    }
+  }
+}
+
+void Logger::write(const Message& message) {
+  if (mConsole)
+    std::printf("[%9.3f] %s: %s\n", message.time, LEVEL_NAMES[message.level], message.text);
+  if (mFile)
+    std::fprintf(mFile, "[%9.3f] %s: %s\n", message.time, LEVEL_NAMES[message.level], message.text);
+  if (mSink)
+    mSink(message.level, message.text);
+}
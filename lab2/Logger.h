@@ -0,0 +1,122 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Asynchronous logging.
+ *
+ * The LOG_ macros format a message into a ring buffer owned by the calling
+ * thread and return, a background writer drains the rings every few
+ * milliseconds to the console, a file and/or a sink such as
+ * sgct::MessageHandler. Logging never waits for I/O or takes a lock, only
+ * the first message of a new thread does. A message that finds its ring
+ * full is dropped and counted instead.
+ *
+ * Levels above LOG_COMPILE_LEVEL are compiled out, debug messages are in
+ * debug builds only unless it is defined otherwise. A level that is compiled
+ * in but disabled at runtime costs one relaxed load and a compare.
+ *
+ * Messages are single lines, a trailing newline is dropped. Messages of
+ * different threads are written in the order they were logged, to within
+ * the drain interval.
+ */
+enum LogLevel { LOG_LEVEL_ERROR = 0, LOG_LEVEL_WARNING, LOG_LEVEL_INFO, LOG_LEVEL_DEBUG };
+
+#ifndef LOG_COMPILE_LEVEL
+#ifdef NDEBUG
+#define LOG_COMPILE_LEVEL LOG_LEVEL_INFO
+#else
+#define LOG_COMPILE_LEVEL LOG_LEVEL_DEBUG
+#endif
+#endif
+
+#define LOG_AT(level, ...) \
+  do { if ((level) <= LOG_COMPILE_LEVEL && Logger::isEnabled(level)) Logger::instance().log((level), __VA_ARGS__); } while (0)
+
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_WARNING(...) LOG_AT(LOG_LEVEL_WARNING, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+class Logger
+{
+public:
+  static const unsigned int RING_SIZE = 256;    //messages per thread, a power of two
+  static const unsigned int MESSAGE_SIZE = 240; //longer messages are cut
+
+  //gets every message without a newline, on the writer thread
+  typedef void (*Sink)(LogLevel level, const char* message);
+
+  static Logger& instance();
+
+  static bool isEnabled(LogLevel level) { return level <= sLevel.load(std::memory_order_relaxed); }
+  static void setLevel(LogLevel level) { sLevel.store(level, std::memory_order_relaxed); }
+  static LogLevel getLevel() { return static_cast<LogLevel>(sLevel.load(std::memory_order_relaxed)); }
+  //error, warning, info or debug, false if name is none of them
+  static bool parseLevel(const std::string& name, LogLevel& level);
+  static const char* levelName(LogLevel level);
+
+  //on by default
+  void setConsole(bool console);
+  //append to a file as well, an empty name closes it
+  bool setFile(const std::string& fileName);
+  void setSink(Sink sink);
+
+  void log(LogLevel level, const char* format, ...)
+#if defined(__GNUC__)
+    __attribute__((format(printf, 3, 4)))
+#endif
+    ;
+
+  //write everything logged so far now
+  void flush();
+  //flush and stop the writer, anything logged later waits for the next flush()
+  void stop();
+
+  unsigned long long getNumDropped() const;
+
+private:
+  struct Message {
+    double time;
+    LogLevel level;
+    char text[MESSAGE_SIZE];
+  };
+
+  //one producer, the owning thread, and one consumer, whoever drains under mMutex
+  struct Ring {
+    Message messages[RING_SIZE];
+    std::atomic<unsigned int> head;
+    std::atomic<unsigned int> tail;
+    std::atomic<unsigned int> dropped;
+  };
+
+  Logger();
+  ~Logger();
+  Ring* threadRing();
+  void run();
+  void write(const Message& message);
+
+  static std::atomic<int> sLevel;
+
+  std::chrono::steady_clock::time_point mStart;
+  mutable std::mutex mMutex; //rings, outputs and draining
+  std::vector<Ring*> mRings;
+  std::vector<Message> mBatch;
+  unsigned long long mDropped;
+
+  bool mConsole;
+  FILE* mFile;
+  Sink mSink;
+
+  std::thread mWriter;
+  std::atomic<bool> mStop;
+};
+
+#endif
@@ -0,0 +1,174 @@
+#include "ModelLoader.h"
+#include "Logger.h"
+#include "MeshCompactor.h"
+#include "TextureCache.h"
+
+#include <osg/ComputeBoundsVisitor>
+#include <osg/Geode>
+#include <osg/PolygonMode>
+#include <osg/ShapeDrawable>
+#include <osgDB/ReadFile>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+ModelLoader::ModelLoader()
+  : mTextureCache(NULL),
+    mNext(0),
+    mStop(false) {
+}
+
+ModelLoader::~ModelLoader() {
+  stop();
+}
+
+bool ModelLoader::readManifest(const std::string& fileName) {
+  std::ifstream file(fileName.c_str());
+  if (!file)
+    return false;
+
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.empty() || line[0] == '#')
+      continue;
+
+    std::istringstream fields(line);
+    Model model;
+    std::string flag;
+    if (!(fields >> model.file >> model.radius >> model.position[0] >> model.position[1] >> model.position[2])) {
+      LOG_WARNING("Skipping manifest line '%s'", line.c_str());
+      continue;
+    }
+    model.twoSided = (fields >> flag) && flag == "twosided";
+    mModels.push_back(model);
+  }
+  return true;
+}
+
+void ModelLoader::start(osg::Group* parent, unsigned int numThreads) {
+  const unsigned int numModels = mModels.size();
+  mTransforms.resize(numModels);
+  mSwapped.assign(numModels, false);
+  mLoaded.resize(numModels);
+  mMatrices.resize(numModels);
+  mPickObjects.resize(numModels);
+  mDone.assign(numModels, false);
+
+  //one wireframe box shared by the placeholders, scaled by their transforms
+  osg::ref_ptr<osg::Geode> placeholder = new osg::Geode();
+  placeholder->addDrawable(new osg::ShapeDrawable(new osg::Box(osg::Vec3(), 2.0f)));
+  placeholder->getOrCreateStateSet()->setAttributeAndModes(new osg::PolygonMode(osg::PolygonMode::FRONT_AND_BACK, osg::PolygonMode::LINE));
+  placeholder->getOrCreateStateSet()->setMode(GL_LIGHTING, osg::StateAttribute::OFF);
+
+  for (unsigned int i = 0; i < numModels; ++i) {
+    mTransforms[i] = new osg::MatrixTransform(osg::Matrix::scale(mModels[i].radius, mModels[i].radius, mModels[i].radius) *
+                                               osg::Matrix::translate(mModels[i].position));
+    mTransforms[i]->addChild(placeholder.get());
+    parent->addChild(mTransforms[i].get());
+  }
+
+  if (numThreads == 0)
+    numThreads = std::max(1u, std::thread::hardware_concurrency());
+  numThreads = std::min(numThreads, numModels);
+
+  for (unsigned int i = 0; i < numThreads; ++i)
+    mThreads.push_back(std::thread(&ModelLoader::run, this));
+}
+
+void ModelLoader::stop() {
+  mStop = true;
+  for (size_t i = 0; i < mThreads.size(); ++i)
+    mThreads[i].join();
+  mThreads.clear();
+
+  //nothing is coming for the models that were not started
+  std::lock_guard<std::mutex> lock(mMutex);
+  for (size_t i = 0; i < mDone.size(); ++i)
+    mDone[i] = true;
+  mLoadedCondition.notify_all();
+}
+
+void ModelLoader::run() {
+  while (!mStop) {
+    const unsigned int index = mNext++;
+    if (index >= mModels.size())
+      return;
+
+    const Model& model = mModels[index];
+    osg::ref_ptr<osg::Node> node = osgDB::readNodeFile(model.file);
+
+    //center and scale to the requested sphere, then rotate osg coordinates to match sgct
+    osg::Matrix matrix;
+    PickBvh::Object pickObject;
+    if (node.valid()) {
+      //merged, indexed and in vertex cache order, while still on the loader thread
+      MeshCompactor compactor;
+      compactor.compact(node.get(), model.file);
+      std::ostringstream report;
+      compactor.report(report);
+      LOG_INFO("%s", report.str().c_str()); //one line, the newline is dropped
+
+      if (mTextureCache) {
+        std::lock_guard<std::mutex> lock(mTextureMutex);
+        mTextureCache->compressTextures(node.get());
+      }
+
+      osg::ComputeBoundsVisitor cbv;
+      node->accept(cbv);
+      const osg::BoundingBox& bb = cbv.getBoundingBox();
+      const float scale = bb.radius() > 0.0f ? model.radius / bb.radius() : 1.0f;
+
+      matrix = osg::Matrix::translate(-bb.center()) *
+               osg::Matrix::scale(scale, scale, scale) *
+               osg::Matrix::rotate(osg::DegreesToRadians(-90.0f), 1.0f, 0.0f, 0.0f) *
+               osg::Matrix::translate(model.position);
+
+      if (model.twoSided)
+        node->getOrCreateStateSet()->setMode(GL_CULL_FACE, osg::StateAttribute::OFF | osg::StateAttribute::OVERRIDE);
+
+      //in the model's own coordinates, the transform is picked up on refit
+      PickBvh::buildObject(node.get(), pickObject);
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mLoaded[index] = node;
+    mMatrices[index] = matrix;
+    std::swap(mPickObjects[index], pickObject);
+    mDone[index] = true;
+    mLoadedCondition.notify_all();
+  }
+}
+
+bool ModelLoader::isLoaded(unsigned int model) const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mDone[model];
+}
+
+osg::Node* ModelLoader::swap(unsigned int model, PickBvh::Object* pickObject) {
+  std::unique_lock<std::mutex> lock(mMutex);
+  while (!mDone[model])
+    mLoadedCondition.wait(lock);
+
+  osg::ref_ptr<osg::Node> node = mLoaded[model];
+  const osg::Matrix matrix = mMatrices[model];
+  mLoaded[model] = NULL;
+  if (pickObject)
+    std::swap(*pickObject, mPickObjects[model]);
+  mPickObjects[model] = PickBvh::Object();
+  lock.unlock();
+
+  osg::MatrixTransform* transform = mTransforms[model].get();
+  transform->removeChildren(0, transform->getNumChildren());
+  mSwapped[model] = true;
+
+  if (!node.valid()) {
+    LOG_ERROR("Failed to read model '%s'!", mModels[model].file.c_str());
+    return NULL;
+  }
+
+  transform->setMatrix(matrix);
+  transform->addChild(node.get());
+  LOG_INFO("Model '%s' loaded successfully!", mModels[model].file.c_str());
+  return node.get();
+}
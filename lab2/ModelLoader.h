@@ -0,0 +1,89 @@
+#ifndef MODELLOADER_H
+#define MODELLOADER_H
+
+#include <osg/Group>
+#include <osg/MatrixTransform>
+
+#include "PickBvh.h"
+
+class TextureCache;
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Loads the models of a scene in parallel.
+ *
+ * start() hangs a MatrixTransform with a wireframe placeholder box under the
+ * parent for every model and hands the files to worker threads. Nothing in the
+ * scene changes until swap() is called for a model, which replaces its
+ * placeholder with the loaded subgraph. That keeps the scene graph out of the
+ * workers' hands and lets the caller decide on which frame a model shows up.
+ * The workers also compact every model with MeshCompactor, compress its
+ * textures through the TextureCache if there is one and build its pick
+ * hierarchy before it is done, so a swap only moves pointers.
+ */
+class ModelLoader
+{
+public:
+  struct Model {
+    std::string file;
+    float radius;       //the model is scaled to this bounding sphere radius
+    osg::Vec3 position; //and centered here, in sgct coordinates
+    bool twoSided;      //no face culling
+  };
+
+  ModelLoader();
+  ~ModelLoader();
+
+  //one model per line: file radius x y z [twosided], # starts a comment
+  bool readManifest(const std::string& fileName);
+  void addModel(const Model& model) { mModels.push_back(model); }
+  unsigned int getNumModels() const { return mModels.size(); }
+
+  //block compress the textures of the loaded models, the cache must outlive the loading, null leaves them as read
+  void setTextureCache(TextureCache* cache) { mTextureCache = cache; }
+
+  //attach the placeholders and start reading, numThreads 0 picks one per core
+  void start(osg::Group* parent, unsigned int numThreads = 0);
+  //finish the files being read and stop
+  void stop();
+
+  //true once this node has read the model, never blocks
+  bool isLoaded(unsigned int model) const;
+  bool isSwapped(unsigned int model) const { return mSwapped[model]; }
+
+  //replace the placeholder, waits for the worker if the model is not read yet
+  //returns the loaded model or null if it could not be read, the model's pick
+  //hierarchy is handed over through pickObject
+  osg::Node* swap(unsigned int model, PickBvh::Object* pickObject = NULL);
+
+  osg::MatrixTransform* getTransform(unsigned int model) const { return mTransforms[model].get(); }
+
+private:
+  void run();
+
+  std::vector<Model> mModels;
+  TextureCache* mTextureCache;
+  std::mutex mTextureMutex; //the cache runs one image at a time on its own threads
+  std::vector< osg::ref_ptr<osg::MatrixTransform> > mTransforms;
+  std::vector<bool> mSwapped;
+
+  //written by the workers
+  mutable std::mutex mMutex;
+  std::condition_variable mLoadedCondition;
+  std::vector< osg::ref_ptr<osg::Node> > mLoaded;
+  std::vector<osg::Matrix> mMatrices;
+  std::vector<PickBvh::Object> mPickObjects;
+  std::vector<bool> mDone;
+
+  std::atomic<unsigned int> mNext;
+  std::atomic<bool> mStop;
+  std::vector<std::thread> mThreads;
+};
+
+#endif
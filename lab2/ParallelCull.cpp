@@ -0,0 +1,314 @@
+#include "ParallelCull.h"
+
+#include <osg/LightSource>
+#include <osg/Polytope>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace {
+
+//a projection whose frustum contains all the others, in the clip space of the first
+bool coverFrustums(const std::vector<osg::Matrix>& projections, osg::Matrix& cover) {
+  const osg::Matrix& base = projections[0];
+  double lower[3] = { DBL_MAX, DBL_MAX, DBL_MAX };
+  double upper[3] = { -DBL_MAX, -DBL_MAX, -DBL_MAX };
+
+  for (size_t i = 0; i < projections.size(); ++i) {
+    const osg::Matrix inverse = osg::Matrix::inverse(projections[i]);
+    for (int corner = 0; corner < 8; ++corner) {
+      const osg::Vec4d ndc(corner & 1 ? 1.0 : -1.0, corner & 2 ? 1.0 : -1.0, corner & 4 ? 1.0 : -1.0, 1.0);
+      const osg::Vec4d world = ndc * inverse;
+      if (std::fabs(world.w()) < 1e-9)
+        return false; //an infinite far plane
+
+      //every corner has to be in front of the first eye, then the frustums' images are inside the box of their corners
+      const osg::Vec4d clip = osg::Vec4d(world.x() / world.w(), world.y() / world.w(), world.z() / world.w(), 1.0) * base;
+      if (clip.w() < 1e-9)
+        return false;
+      for (int k = 0; k < 3; ++k) {
+        lower[k] = std::min(lower[k], clip[k] / clip.w());
+        upper[k] = std::max(upper[k], clip[k] / clip.w());
+      }
+    }
+  }
+
+  //map the box to the unit cube, with a margin so that what touches a side is kept
+  double scale[3], offset[3];
+  for (int k = 0; k < 3; ++k) {
+    const double margin = 1e-4 * (upper[k] - lower[k]);
+    lower[k] -= margin;
+    upper[k] += margin;
+    scale[k] = 2.0 / (upper[k] - lower[k]);
+    offset[k] = -(upper[k] + lower[k]) / (upper[k] - lower[k]);
+  }
+  cover = base * osg::Matrix(scale[0], 0.0, 0.0, 0.0,
+                             0.0, scale[1], 0.0, 0.0,
+                             0.0, 0.0, scale[2], 0.0,
+                             offset[0], offset[1], offset[2], 1.0);
+  return true;
+}
+
+}
+
+/*
+ * osg draws a render stage once per cull, a shared cull draws it once per eye
+ * and viewport.
+ */
+class ParallelCull::SharedStage : public osgUtil::RenderStage
+{
+public:
+  void rewind() { _stageDrawnThisFrame = false; }
+};
+
+/*
+ * Cull callback on the groups from the root down to the partitioned group.
+ * Visitors that are not from a partition, like the viewer's own, traverse
+ * everything as usual.
+ */
+class ParallelCull::PartitionCallback : public osg::NodeCallback
+{
+public:
+  PartitionCallback(const ParallelCull& owner) : mOwner(owner) {}
+
+  virtual void operator()(osg::Node* node, osg::NodeVisitor* nv) {
+    const int partition = mOwner.findPartition(nv);
+    osg::Group* group = node->asGroup();
+    if (partition < 0 || !group) {
+      traverse(node, nv);
+      return;
+    }
+
+    const unsigned int numPartitions = mOwner.getNumPartitions();
+    const bool partitioned = group == mOwner.mPartitioned.get();
+    for (unsigned int i = 0; i < group->getNumChildren(); ++i) {
+      osg::Node* child = group->getChild(i);
+      bool visit;
+      if (partitioned)
+        visit = i % numPartitions == (unsigned int)partition;
+      else
+        visit = partition == 0 || dynamic_cast<osg::LightSource*>(child) ||
+                std::find(mOwner.mPath.begin(), mOwner.mPath.end(), child) != mOwner.mPath.end();
+      if (visit)
+        child->accept(*nv);
+    }
+  }
+
+private:
+  const ParallelCull& mOwner;
+};
+
+ParallelCull::ParallelCull(ThreadPool& pool, unsigned int numPartitions)
+  : mPool(pool),
+    mPartitions(std::max(1u, numPartitions)),
+    mShared(false),
+    mSharedCulled(false),
+    mDraw(0) {
+}
+
+ParallelCull::~ParallelCull() {
+  for (size_t i = 0; i < mPath.size(); ++i)
+    mPath[i]->removeCullCallback(mCallback.get());
+}
+
+void ParallelCull::setup(osg::Camera* camera, osg::Node* root, osg::Group* partitioned, osg::FrameStamp* frameStamp) {
+  mRoot = root;
+  mPartitioned = partitioned;
+
+  //a partition without a child of its own would still cull and draw everything else for nothing
+  const unsigned int numChildren = partitioned->getNumChildren();
+  mPartitions.resize(std::max(1u, std::min((unsigned int)mPartitions.size(), numChildren)));
+
+  for (size_t i = 0; i < mPartitions.size(); ++i) {
+    osgUtil::SceneView* view = new osgUtil::SceneView();
+    view->setDefaults(osgUtil::SceneView::STANDARD_SETTINGS); //the head light like the viewer
+    view->setState(camera->getGraphicsContext()->getState());
+    view->setSceneData(root);
+    view->setFrameStamp(frameStamp);
+    view->setComputeNearFarMode(camera->getComputeNearFarMode());
+    view->setClearColor(camera->getClearColor());
+    view->getCamera()->setClearMask(i == 0 ? camera->getClearMask() : 0); //the rest draw on top
+    view->setViewMatrix(osg::Matrix::identity());
+    mPartitions[i].stage = new SharedStage();
+    view->setRenderStage(mPartitions[i].stage.get());
+    mPartitions[i].view = view;
+    mPartitions[i].culled = 0;
+  }
+
+  //the callback goes on every group from the partitioned one up to the root
+  mCallback = new PartitionCallback(*this);
+  for (osg::Node* node = partitioned; node; node = node->getNumParents() > 0 ? node->getParent(0) : NULL) {
+    node->addCullCallback(mCallback.get());
+    mPath.push_back(node);
+    if (node == root)
+      break;
+  }
+}
+
+void ParallelCull::collect(osgUtil::RenderBin* bin, const osg::Matrix& projection, Partition& partition) {
+  osgUtil::RenderBin::RenderBinList& bins = bin->getRenderBinList();
+  for (osgUtil::RenderBin::RenderBinList::iterator it = bins.begin(); it != bins.end(); ++it)
+    collect(it->second.get(), projection, partition);
+
+  //depth sorted bins hold their leaves themselves, the others in their state graphs
+  osgUtil::RenderBin::RenderLeafList& sorted = bin->getRenderLeafList();
+  if (!sorted.empty()) {
+    partition.leaves.push_back(SharedLeaves());
+    partition.leaves.back().sorted = &sorted;
+    partition.leaves.back().graph = NULL;
+    for (size_t i = 0; i < sorted.size(); ++i)
+      addLeaf(sorted[i], projection, partition);
+  }
+
+  osgUtil::RenderBin::StateGraphList& graphs = bin->getStateGraphList();
+  for (size_t i = 0; i < graphs.size(); ++i) {
+    partition.leaves.push_back(SharedLeaves());
+    partition.leaves.back().sorted = NULL;
+    partition.leaves.back().graph = &graphs[i]->_leaves;
+    for (size_t j = 0; j < graphs[i]->_leaves.size(); ++j)
+      addLeaf(graphs[i]->_leaves[j].get(), projection, partition);
+  }
+}
+
+void ParallelCull::addLeaf(osgUtil::RenderLeaf* leaf, const osg::Matrix& projection, Partition& partition) {
+  SharedLeaves& shared = partition.leaves.back();
+  shared.leaves.push_back(leaf);
+  shared.bounds.push_back(osg::BoundingSphere());
+
+  //the leaves of nested cameras keep their own projections and are always drawn
+  osg::RefMatrix* matrix = leaf->_projection.get();
+  if (!matrix || *matrix != projection)
+    return;
+  if (std::find(partition.projections.begin(), partition.projections.end(), matrix) == partition.projections.end())
+    partition.projections.push_back(matrix);
+
+  const osg::Drawable* drawable = leaf->_drawable.get();
+  const osg::RefMatrix* modelview = leaf->_modelview.get();
+  if (!drawable || !modelview || !drawable->getBoundingBox().valid())
+    return;
+
+  //the sphere around the box, scaled by the longest axis of the model view
+  const osg::BoundingBox& box = drawable->getBoundingBox();
+  const osg::Matrix& m = *modelview;
+  const double scale2 = std::max(std::max(osg::Vec3d(m(0, 0), m(0, 1), m(0, 2)).length2(),
+                                          osg::Vec3d(m(1, 0), m(1, 1), m(1, 2)).length2()),
+                                 osg::Vec3d(m(2, 0), m(2, 1), m(2, 2)).length2());
+  shared.bounds.back() = osg::BoundingSphere(box.center() * m, box.radius() * std::sqrt(scale2));
+}
+
+int ParallelCull::findPartition(const osg::NodeVisitor* visitor) const {
+  for (size_t i = 0; i < mPartitions.size(); ++i) {
+    if (mPartitions[i].view->getCullVisitor() == visitor)
+      return i;
+  }
+  return -1;
+}
+
+bool ParallelCull::share(const std::vector<osg::Matrix>& projections) {
+  //leaves with a computed near and far get projections of their own
+  mShared = !projections.empty() &&
+            mPartitions[0].view->getComputeNearFarMode() == osgUtil::CullVisitor::DO_NOT_COMPUTE_NEAR_FAR &&
+            coverFrustums(projections, mSharedProjection);
+  mSharedProjections = projections;
+  mSharedCulled = false;
+  return mShared;
+}
+
+bool ParallelCull::isShared(const osg::Matrix& projection) const {
+  //SGCT hands out the same matrices it was asked for, so they compare equal
+  return std::find(mSharedProjections.begin(), mSharedProjections.end(), projection) != mSharedProjections.end();
+}
+
+void ParallelCull::draw(int x, int y, int width, int height, const osg::Matrix& projection) {
+  for (size_t i = 0; i < mPartitions.size(); ++i)
+    mPartitions[i].view->setViewport(x, y, width, height);
+
+  //a view outside the shared set gets a cull of its own
+  const bool shared = mShared && isShared(projection);
+  if (shared && mSharedCulled) {
+    for (unsigned int i = 0; i < mPartitions.size(); ++i)
+      drawPartition(i, projection, true);
+    return;
+  }
+
+  mRoot->getBound();
+  for (size_t i = 0; i < mPartitions.size(); ++i) {
+    //a new cull rebuilds the render graphs, and held leaves could not be reused
+    mPartitions[i].projections.clear();
+    mPartitions[i].leaves.clear();
+    mPartitions[i].view->setProjectionMatrix(shared ? mSharedProjection : projection);
+  }
+
+  unsigned int draw;
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    draw = ++mDraw;
+  }
+  for (unsigned int i = 1; i < mPartitions.size(); ++i)
+    mPool.run([this, i] { cull(i); });
+
+  mPartitions[0].view->cull();
+  drawPartition(0, projection, shared);
+
+  for (unsigned int i = 1; i < mPartitions.size(); ++i) {
+    {
+      std::unique_lock<std::mutex> lock(mMutex);
+      mCulled.wait(lock, [this, i, draw] { return mPartitions[i].culled == draw; });
+    }
+    drawPartition(i, projection, shared);
+  }
+  //an own cull has replaced the render graphs of the shared one
+  mSharedCulled = shared;
+}
+
+void ParallelCull::drawPartition(unsigned int partition, const osg::Matrix& projection, bool shared) {
+  Partition& part = mPartitions[partition];
+  if (!shared) {
+    part.view->draw();
+    return;
+  }
+
+  //the leaves keep pointing to the same matrices, so only their contents change between the draws
+  if (!mSharedCulled)
+    collect(part.stage.get(), mSharedProjection, part);
+  for (size_t i = 0; i < part.projections.size(); ++i)
+    part.projections[i]->set(projection);
+
+  //the shared frustum holds what every eye and viewport sees, this draw only gets the leaves in its own
+  osg::Polytope frustum;
+  frustum.setToUnitFrustum();
+  frustum.transformProvidingInverse(projection);
+  for (size_t i = 0; i < part.leaves.size(); ++i) {
+    SharedLeaves& shared = part.leaves[i];
+    if (shared.sorted)
+      shared.sorted->clear();
+    else
+      shared.graph->clear();
+
+    for (size_t j = 0; j < shared.leaves.size(); ++j) {
+      if (shared.bounds[j].valid() && !frustum.contains(shared.bounds[j]))
+        continue;
+      if (shared.sorted)
+        shared.sorted->push_back(shared.leaves[j].get());
+      else
+        shared.graph->push_back(shared.leaves[j]);
+    }
+  }
+
+  //the state only loads a projection that is not the one it has, by pointer
+  part.view->getState()->applyProjectionMatrix(NULL);
+  part.stage->setViewport(part.view->getCamera()->getViewport());
+  part.stage->rewind();
+  part.view->draw();
+}
+
+void ParallelCull::cull(unsigned int partition) {
+  mPartitions[partition].view->cull();
+
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mPartitions[partition].culled = mDraw;
+  }
+  mCulled.notify_all();
+}
@@ -0,0 +1,113 @@
+#ifndef PARALLELCULL_H
+#define PARALLELCULL_H
+
+#include <osg/BoundingSphere>
+#include <osg/Camera>
+#include <osg/FrameStamp>
+#include <osg/Group>
+#include <osgUtil/RenderStage>
+#include <osgUtil/SceneView>
+
+#include "ThreadPool.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+/*
+ * Culls and draws the scene of one viewport on several threads.
+ *
+ * The children of one group, the models, are dealt round robin into
+ * partitions, no more partitions than the group has children at setup().
+ * Every partition has its own SceneView, so its own cull visitor and render
+ * graph, which culls the whole scene but only its share of that group.
+ * Everything else is drawn by the first partition, except light sources
+ * which every partition culls since their positional state applies to all it
+ * draws. All partitions draw into the calling thread's context with its
+ * osg::State, one after the other, and depth test against each other.
+ *
+ * draw() culls the first partition on the calling thread and the others on
+ * the pool, then draws each partition as soon as its cull is done, so drawing
+ * overlaps with culling the rest. Transparent geometry is only depth sorted
+ * within its partition.
+ *
+ * After share() the scene is culled once for several view projections, the
+ * eyes and viewports of a frame, against a frustum that contains all of
+ * theirs. The first draw() culls, the later ones draw the same render graphs,
+ * sorted bins and all, with only their own projection swapped in. The view
+ * matrix is the identity, so the projection is all that differs between the
+ * draws. Before each of those draws the render leaves whose bounds lie outside
+ * its own frustum are taken out, so a viewport does not draw what only the
+ * others see.
+ * A draw whose view projection is not one of those shared, such as a
+ * sub-viewport or a face of a non-linear projection, culls for itself, and the
+ * next shared draw culls the shared frustum again.
+ *
+ * The scene must not change during draw(). Its bounds are brought up to date
+ * before the culls start, so that none of them computes a bound.
+ */
+class ParallelCull
+{
+public:
+  ParallelCull(ThreadPool& pool, unsigned int numPartitions);
+  ~ParallelCull();
+
+  //the clear mask, clear color and near far mode are taken from camera, the state from its context
+  void setup(osg::Camera* camera, osg::Node* root, osg::Group* partitioned, osg::FrameStamp* frameStamp);
+
+  //cull and draw with the identity view matrix, the projection is the whole view projection
+  void draw(int x, int y, int width, int height, const osg::Matrix& projection);
+
+  //cull once for all the projections, the draws with one of them until the next call reuse that cull
+  //false if they have no common frustum or near and far are computed, then every draw culls
+  bool share(const std::vector<osg::Matrix>& projections);
+
+  unsigned int getNumPartitions() const { return mPartitions.size(); }
+
+private:
+  class PartitionCallback;
+  class SharedStage;
+
+  //the leaves a shared cull left in one depth sorted bin or one state graph
+  struct SharedLeaves {
+    osgUtil::RenderBin::RenderLeafList* sorted; //where they are drawn from, one of the two
+    osgUtil::StateGraph::LeafList* graph;
+    std::vector< osg::ref_ptr<osgUtil::RenderLeaf> > leaves;
+    std::vector<osg::BoundingSphere> bounds; //in view space, invalid for leaves that are always drawn
+  };
+
+  struct Partition {
+    osg::ref_ptr<osgUtil::SceneView> view;
+    osg::ref_ptr<SharedStage> stage;
+    unsigned int culled; //the last draw() whose cull is done
+    std::vector<osg::RefMatrix*> projections; //of the leaves of a shared cull
+    std::vector<SharedLeaves> leaves;
+  };
+
+  //the leaves below bin and the projections of those culled with projection
+  void collect(osgUtil::RenderBin* bin, const osg::Matrix& projection, Partition& partition);
+  void addLeaf(osgUtil::RenderLeaf* leaf, const osg::Matrix& projection, Partition& partition);
+
+  void cull(unsigned int partition);
+  void drawPartition(unsigned int partition, const osg::Matrix& projection, bool shared);
+  bool isShared(const osg::Matrix& projection) const;
+  int findPartition(const osg::NodeVisitor* visitor) const;
+
+  ThreadPool& mPool;
+  std::vector<Partition> mPartitions;
+  osg::ref_ptr<osg::Node> mRoot;
+  osg::ref_ptr<osg::Group> mPartitioned;
+  osg::ref_ptr<PartitionCallback> mCallback;
+  std::vector< osg::ref_ptr<osg::Node> > mPath; //root down to the partitioned group, they carry the callback
+
+  bool mShared;
+  bool mSharedCulled;
+  osg::Matrix mSharedProjection; //contains every shared frustum
+  std::vector<osg::Matrix> mSharedProjections;
+
+  unsigned int mDraw;
+  std::mutex mMutex;
+  std::condition_variable mCulled;
+};
+
+#endif
@@ -0,0 +1,409 @@
+#include "PickBvh.h"
+
+#include <osg/Geode>
+#include <osg/Transform>
+#include <osg/TriangleFunctor>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace {
+
+const unsigned int LEAF_SIZE = 4;
+const unsigned int STACK_SIZE = 64;
+
+struct TriangleSink {
+  std::vector<osg::Vec3>* triangles;
+  osg::Matrix matrix;
+
+  void operator()(const osg::Vec3& v1, const osg::Vec3& v2, const osg::Vec3& v3) {
+    triangles->push_back(v1 * matrix);
+    triangles->push_back(v2 * matrix);
+    triangles->push_back(v3 * matrix);
+  }
+
+  void operator()(const osg::Vec3& v1, const osg::Vec3& v2, const osg::Vec3& v3, bool) {
+    (*this)(v1, v2, v3);
+  }
+};
+
+//gathers the triangles of a subgraph in the coordinate system of its top node
+class TriangleCollector : public osg::NodeVisitor
+{
+public:
+  TriangleCollector(std::vector<osg::Vec3>& triangles)
+    : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN),
+      mTriangles(triangles) {
+    mMatrices.push_back(osg::Matrix::identity());
+  }
+
+  virtual void apply(osg::Transform& transform) {
+    osg::Matrix matrix = mMatrices.back();
+    transform.computeLocalToWorldMatrix(matrix, this);
+    mMatrices.push_back(matrix);
+    traverse(transform);
+    mMatrices.pop_back();
+  }
+
+  virtual void apply(osg::Geode& geode) {
+    for (unsigned int i = 0; i < geode.getNumDrawables(); ++i) {
+      osg::TriangleFunctor<TriangleSink> functor;
+      functor.triangles = &mTriangles;
+      functor.matrix = mMatrices.back();
+      geode.getDrawable(i)->accept(functor);
+    }
+  }
+
+private:
+  std::vector<osg::Vec3>& mTriangles;
+  std::vector<osg::Matrix> mMatrices;
+};
+
+//slab test of start + t * dir against box, for t in [0, tMax]
+bool intersectBox(const osg::BoundingBox& box, const osg::Vec3& start, const osg::Vec3& invDir, float tMax, float& tNear) {
+  float t0 = 0.0f, t1 = tMax;
+  for (int axis = 0; axis < 3; ++axis) {
+    float ta = (box._min[axis] - start[axis]) * invDir[axis];
+    float tb = (box._max[axis] - start[axis]) * invDir[axis];
+    if (ta > tb)
+      std::swap(ta, tb);
+    t0 = std::max(t0, ta);
+    t1 = std::min(t1, tb);
+    if (t0 > t1)
+      return false;
+  }
+  tNear = t0;
+  return true;
+}
+
+//Moller-Trumbore, t is the fraction along dir
+bool intersectTriangle(const osg::Vec3& start, const osg::Vec3& dir,
+                       const osg::Vec3& v0, const osg::Vec3& v1, const osg::Vec3& v2, float& t) {
+  osg::Vec3 e1 = v1 - v0;
+  osg::Vec3 e2 = v2 - v0;
+  osg::Vec3 p = dir ^ e2;
+  float det = e1 * p;
+  if (std::fabs(det) < 1e-12f)
+    return false;
+
+  float invDet = 1.0f / det;
+  osg::Vec3 s = start - v0;
+  float u = (s * p) * invDet;
+  if (u < 0.0f || u > 1.0f)
+    return false;
+
+  osg::Vec3 q = s ^ e1;
+  float v = (dir * q) * invDet;
+  if (v < 0.0f || u + v > 1.0f)
+    return false;
+
+  t = (e2 * q) * invDet;
+  return t >= 0.0f;
+}
+
+osg::Vec3 inverse(const osg::Vec3& dir) {
+  return osg::Vec3(dir.x() != 0.0f ? 1.0f / dir.x() : FLT_MAX,
+                   dir.y() != 0.0f ? 1.0f / dir.y() : FLT_MAX,
+                   dir.z() != 0.0f ? 1.0f / dir.z() : FLT_MAX);
+}
+
+int largestAxis(const osg::BoundingBox& box) {
+  osg::Vec3 extent = box._max - box._min;
+  if (extent.x() >= extent.y() && extent.x() >= extent.z())
+    return 0;
+  return extent.y() >= extent.z() ? 1 : 2;
+}
+
+struct CentroidLess {
+  const std::vector<osg::Vec3>* centroids;
+  int axis;
+  bool operator()(unsigned int a, unsigned int b) const {
+    return (*centroids)[a][axis] < (*centroids)[b][axis];
+  }
+};
+
+}
+
+/***********************************************************************************************************
+*                                     OBJECT LEVEL
+**********************************************************************************************************/
+
+unsigned int PickBvh::addObject(osg::Node* model) {
+  Object object;
+  buildObject(model, object);
+  return addObject(object);
+}
+
+unsigned int PickBvh::addObject(Object& object) {
+  mObjects.push_back(Object());
+  std::swap(mObjects.back(), object);
+
+  //the top level is rebuilt on the next refit
+  mTopNodes.clear();
+  return mObjects.size() - 1;
+}
+
+void PickBvh::buildObject(osg::Node* model, Object& object) {
+  object = Object();
+  object.node = model;
+  object.valid = false;
+
+  std::vector<osg::Vec3> triangles;
+  TriangleCollector collector(triangles);
+  model->accept(collector);
+
+  const unsigned int numTriangles = triangles.size() / 3;
+  if (numTriangles == 0)
+    return;
+
+  std::vector<osg::Vec3> centroids(numTriangles);
+  std::vector<unsigned int> order(numTriangles);
+  for (unsigned int i = 0; i < numTriangles; ++i) {
+    centroids[i] = (triangles[3 * i] + triangles[3 * i + 1] + triangles[3 * i + 2]) / 3.0f;
+    order[i] = i;
+  }
+
+  object.triangles.swap(triangles);
+  object.nodes.reserve(2 * numTriangles / LEAF_SIZE + 1);
+  buildNode(object, order, centroids, 0, numTriangles);
+
+  //store the triangles in leaf order
+  std::vector<osg::Vec3> sorted(object.triangles.size());
+  for (unsigned int i = 0; i < numTriangles; ++i)
+    std::copy(object.triangles.begin() + 3 * order[i], object.triangles.begin() + 3 * order[i] + 3, sorted.begin() + 3 * i);
+  object.triangles.swap(sorted);
+}
+
+unsigned int PickBvh::buildNode(Object& object, std::vector<unsigned int>& order, const std::vector<osg::Vec3>& centroids,
+                                unsigned int first, unsigned int count) {
+  const unsigned int index = object.nodes.size();
+  object.nodes.push_back(BvhNode());
+
+  osg::BoundingBox box, centroidBox;
+  for (unsigned int i = first; i < first + count; ++i) {
+    const unsigned int t = order[i];
+    box.expandBy(object.triangles[3 * t]);
+    box.expandBy(object.triangles[3 * t + 1]);
+    box.expandBy(object.triangles[3 * t + 2]);
+    centroidBox.expandBy(centroids[t]);
+  }
+  object.nodes[index].box = box;
+
+  const int axis = largestAxis(centroidBox);
+  if (count <= LEAF_SIZE || centroidBox._max[axis] <= centroidBox._min[axis]) {
+    object.nodes[index].first = first;
+    object.nodes[index].count = count;
+    return index;
+  }
+
+  //median split along the widest centroid axis
+  CentroidLess less = { &centroids, axis };
+  const unsigned int mid = first + count / 2;
+  std::nth_element(order.begin() + first, order.begin() + mid, order.begin() + first + count, less);
+
+  buildNode(object, order, centroids, first, mid - first);
+  const unsigned int right = buildNode(object, order, centroids, mid, first + count - mid);
+
+  object.nodes[index].first = right;
+  object.nodes[index].count = 0;
+  return index;
+}
+
+bool PickBvh::intersectObject(const Object& object, const osg::Vec3& start, const osg::Vec3& dir, float& t) const {
+  if (object.nodes.empty())
+    return false;
+
+  const osg::Vec3 invDir = inverse(dir);
+  bool found = false;
+
+  unsigned int stack[STACK_SIZE];
+  unsigned int size = 0;
+  stack[size++] = 0;
+
+  while (size > 0) {
+    const unsigned int index = stack[--size];
+    const BvhNode& node = object.nodes[index];
+
+    float tNear;
+    if (!intersectBox(node.box, start, invDir, t, tNear))
+      continue;
+
+    if (node.count > 0) {
+      for (unsigned int i = node.first; i < node.first + node.count; ++i) {
+        float tHit;
+        if (intersectTriangle(start, dir, object.triangles[3 * i], object.triangles[3 * i + 1],
+                              object.triangles[3 * i + 2], tHit) && tHit < t) {
+          t = tHit;
+          found = true;
+        }
+      }
+      continue;
+    }
+
+    //visit the nearer child first
+    const unsigned int left = index + 1;
+    const unsigned int right = node.first;
+    float tLeft, tRight;
+    const bool hitLeft = intersectBox(object.nodes[left].box, start, invDir, t, tLeft);
+    const bool hitRight = intersectBox(object.nodes[right].box, start, invDir, t, tRight);
+
+    if (hitLeft && hitRight && size + 2 <= STACK_SIZE) {
+      stack[size++] = tLeft < tRight ? right : left;
+      stack[size++] = tLeft < tRight ? left : right;
+    }
+    else if (hitLeft && size < STACK_SIZE)
+      stack[size++] = left;
+    else if (hitRight && size < STACK_SIZE)
+      stack[size++] = right;
+  }
+  return found;
+}
+
+/***********************************************************************************************************
+*                                     TOP LEVEL
+**********************************************************************************************************/
+
+void PickBvh::refit() {
+  bool changed = false;
+
+  for (size_t i = 0; i < mObjects.size(); ++i) {
+    Object& object = mObjects[i];
+
+    //walk the first parents up to the root, the model's own transform is already in the triangles
+    mPath.clear();
+    for (osg::Node* node = object.node.get(); node->getNumParents() > 0; ) {
+      node = node->getParent(0);
+      mPath.push_back(node);
+    }
+    std::reverse(mPath.begin(), mPath.end());
+    const osg::Matrix localToWorld = osg::computeLocalToWorld(mPath);
+
+    if (object.valid && localToWorld == object.localToWorld)
+      continue;
+
+    object.localToWorld = localToWorld;
+    object.worldToLocal = osg::Matrix::inverse(localToWorld);
+    object.worldBox.init();
+    if (!object.nodes.empty()) {
+      for (unsigned int c = 0; c < 8; ++c)
+        object.worldBox.expandBy(object.nodes[0].box.corner(c) * localToWorld);
+    }
+    object.valid = true;
+    changed = true;
+  }
+
+  if (mTopNodes.empty())
+    buildTop();
+  else if (changed)
+    refitTopNode(0);
+}
+
+void PickBvh::buildTop() {
+  mTopNodes.clear();
+  mTopOrder.resize(mObjects.size());
+  for (unsigned int i = 0; i < mObjects.size(); ++i)
+    mTopOrder[i] = i;
+
+  if (!mObjects.empty())
+    buildTopNode(0, mObjects.size());
+}
+
+unsigned int PickBvh::buildTopNode(unsigned int first, unsigned int count) {
+  const unsigned int index = mTopNodes.size();
+  mTopNodes.push_back(BvhNode());
+
+  if (count == 1) {
+    mTopNodes[index].box = mObjects[mTopOrder[first]].worldBox;
+    mTopNodes[index].first = first;
+    mTopNodes[index].count = 1;
+    return index;
+  }
+
+  std::vector<osg::Vec3> centroids(mObjects.size());
+  osg::BoundingBox centroidBox;
+  for (unsigned int i = first; i < first + count; ++i) {
+    centroids[mTopOrder[i]] = mObjects[mTopOrder[i]].worldBox.center();
+    centroidBox.expandBy(centroids[mTopOrder[i]]);
+  }
+
+  CentroidLess less = { &centroids, largestAxis(centroidBox) };
+  const unsigned int mid = first + count / 2;
+  std::nth_element(mTopOrder.begin() + first, mTopOrder.begin() + mid, mTopOrder.begin() + first + count, less);
+
+  buildTopNode(first, mid - first);
+  const unsigned int right = buildTopNode(mid, first + count - mid);
+
+  mTopNodes[index].first = right;
+  mTopNodes[index].count = 0;
+  mTopNodes[index].box = mTopNodes[index + 1].box;
+  mTopNodes[index].box.expandBy(mTopNodes[right].box);
+  return index;
+}
+
+void PickBvh::refitTopNode(unsigned int index) {
+  BvhNode& node = mTopNodes[index];
+  if (node.count > 0) {
+    node.box = mObjects[mTopOrder[node.first]].worldBox;
+    return;
+  }
+
+  refitTopNode(index + 1);
+  refitTopNode(node.first);
+  node.box = mTopNodes[index + 1].box;
+  node.box.expandBy(mTopNodes[node.first].box);
+}
+
+bool PickBvh::intersect(const osg::Vec3d& start, const osg::Vec3d& end, Hit& hit) const {
+  if (mTopNodes.empty())
+    return false;
+
+  const osg::Vec3 worldStart = start;
+  const osg::Vec3 worldDir = end - start;
+  const osg::Vec3 invDir = inverse(worldDir);
+
+  //the segment parameter is the same in every affine space
+  float best = 1.0f;
+  int bestObject = -1;
+
+  unsigned int stack[STACK_SIZE];
+  unsigned int size = 0;
+  stack[size++] = 0;
+
+  while (size > 0) {
+    const unsigned int index = stack[--size];
+    const BvhNode& node = mTopNodes[index];
+
+    float tNear;
+    if (!intersectBox(node.box, worldStart, invDir, best, tNear))
+      continue;
+
+    if (node.count > 0) {
+      const unsigned int objectIndex = mTopOrder[node.first];
+      const Object& object = mObjects[objectIndex];
+      const osg::Vec3 localStart = start * object.worldToLocal;
+      const osg::Vec3 localEnd = end * object.worldToLocal;
+
+      float t = best;
+      if (intersectObject(object, localStart, localEnd - localStart, t)) {
+        best = t;
+        bestObject = objectIndex;
+      }
+      continue;
+    }
+
+    if (size + 2 <= STACK_SIZE) {
+      stack[size++] = node.first;
+      stack[size++] = index + 1;
+    }
+  }
+
+  if (bestObject < 0)
+    return false;
+
+  hit.node = mObjects[bestObject].node.get();
+  hit.object = bestObject;
+  hit.ratio = best;
+  hit.point = start + (end - start) * best;
+  return true;
+}
@@ -0,0 +1,78 @@
+#ifndef PICKBVH_H
+#define PICKBVH_H
+
+#include <osg/Node>
+#include <osg/Matrix>
+#include <osg/BoundingBox>
+
+#include <vector>
+
+/*
+ * Bounding volume hierarchy for wand picking.
+ *
+ * Every pickable model gets a triangle hierarchy in its own coordinate system,
+ * built once when it is added. On top of those sits a small hierarchy over the
+ * world space boxes of the models. refit() recomputes the model matrices and
+ * only refits the top level boxes, so moving a model through its
+ * MatrixTransform never touches its triangles.
+ */
+class PickBvh
+{
+public:
+  struct Hit {
+    osg::Node* node;
+    unsigned int object;
+    osg::Vec3d point;
+    double ratio;
+  };
+
+  struct BvhNode {
+    osg::BoundingBox box;
+    unsigned int first; //first triangle (leaf) or right child (inner node)
+    unsigned int count; //number of triangles, 0 for inner nodes
+  };
+
+  //one model's triangle hierarchy, the fields are only used by PickBvh
+  struct Object {
+    osg::ref_ptr<osg::Node> node;
+    std::vector<osg::Vec3> triangles; //three vertices per triangle, in leaf order
+    std::vector<BvhNode> nodes;
+    osg::Matrix localToWorld;
+    osg::Matrix worldToLocal;
+    osg::BoundingBox worldBox;
+    bool valid;
+  };
+
+  //collect the triangles below model and build its hierarchy, touches nothing
+  //but model so it can run on a loader thread
+  static void buildObject(osg::Node* model, Object& object);
+
+  //collect the triangles below model and build its hierarchy, returns the object index
+  unsigned int addObject(osg::Node* model);
+  //take over an object from buildObject(), leaves it empty
+  unsigned int addObject(Object& object);
+  unsigned int getNumObjects() const { return mObjects.size(); }
+  osg::Node* getObject(unsigned int object) const { return mObjects[object].node.get(); }
+
+  //pick up transform changes, call once per frame before intersect()
+  void refit();
+
+  //nearest hit along start->end in root coordinates
+  bool intersect(const osg::Vec3d& start, const osg::Vec3d& end, Hit& hit) const;
+
+private:
+  static unsigned int buildNode(Object& object, std::vector<unsigned int>& order, const std::vector<osg::Vec3>& centroids,
+                         unsigned int first, unsigned int count);
+  bool intersectObject(const Object& object, const osg::Vec3& start, const osg::Vec3& dir, float& t) const;
+
+  void buildTop();
+  unsigned int buildTopNode(unsigned int first, unsigned int count);
+  void refitTopNode(unsigned int index);
+
+  std::vector<Object> mObjects;
+  std::vector<unsigned int> mTopOrder;
+  std::vector<BvhNode> mTopNodes;
+  osg::NodePath mPath; //kept between refits so that they do not allocate
+};
+
+#endif
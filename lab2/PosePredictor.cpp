@@ -0,0 +1,107 @@
+#include "PosePredictor.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+glm::quat rotationOf(const glm::mat4& m) {
+  //the columns are normalized so a scaled pose still gives a unit rotation
+  glm::mat3 r(m);
+  r[0] = glm::normalize(r[0]);
+  r[1] = glm::normalize(r[1]);
+  r[2] = glm::normalize(r[2]);
+  return glm::normalize(glm::quat_cast(r));
+}
+
+//rotation vector taking a to b
+glm::vec3 rotationBetween(const glm::quat& a, const glm::quat& b) {
+  glm::quat d = b * glm::conjugate(a);
+  if (d.w < 0.0f)
+    d = -d; //the short way around
+
+  const glm::vec3 axis(d.x, d.y, d.z);
+  const float s = glm::length(axis);
+  if (s < 1e-6f)
+    return glm::vec3(0.0f);
+  return axis * (2.0f * std::atan2(s, d.w) / s);
+}
+
+glm::quat fromRotationVector(const glm::vec3& v) {
+  const float angle = glm::length(v);
+  if (angle < 1e-6f)
+    return glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+  const glm::vec3 axis = v * (std::sin(angle * 0.5f) / angle);
+  return glm::quat(std::cos(angle * 0.5f), axis.x, axis.y, axis.z);
+}
+
+}
+
+PosePredictor::PosePredictor(unsigned int capacity)
+  : mSamples(std::max(capacity, 2u)),
+    mNewest(0),
+    mCount(0),
+    mWindow(0.05),
+    mSmoothing(0.5f),
+    mMaxExtrapolation(0.1),
+    mLatest(1.0f),
+    mVelocity(0.0f),
+    mAngularVelocity(0.0f) {
+}
+
+const PosePredictor::Sample& PosePredictor::sample(unsigned int age) const {
+  return mSamples[(mNewest + mSamples.size() - age) % mSamples.size()];
+}
+
+bool PosePredictor::addSample(double time, const glm::mat4& pose) {
+  if (mCount > 0 && time <= sample(0).time)
+    return false;
+
+  mNewest = (mNewest + 1) % mSamples.size();
+  mCount = std::min<unsigned int>(mCount + 1, mSamples.size());
+  Sample& newest = mSamples[mNewest];
+  newest.time = time;
+  newest.position = glm::vec3(pose[3]);
+  newest.rotation = rotationOf(pose);
+  mLatest = pose;
+
+  if (mCount < 2)
+    return true;
+
+  //measure against the oldest sample inside the window, at least the previous one
+  unsigned int age = 1;
+  while (age + 1 < mCount && time - sample(age + 1).time <= mWindow)
+    ++age;
+  const Sample& oldest = sample(age);
+  const float dt = static_cast<float>(time - oldest.time);
+
+  const glm::vec3 velocity = (newest.position - oldest.position) / dt;
+  const glm::vec3 angularVelocity = rotationBetween(oldest.rotation, newest.rotation) / dt;
+
+  if (mCount == 2) {
+    mVelocity = velocity;
+    mAngularVelocity = angularVelocity;
+  }
+  else {
+    mVelocity = glm::mix(mVelocity, velocity, mSmoothing);
+    mAngularVelocity = glm::mix(mAngularVelocity, angularVelocity, mSmoothing);
+  }
+  return true;
+}
+
+glm::mat4 PosePredictor::predict(double time) const {
+  if (mCount < 2)
+    return mLatest;
+
+  const float ahead = static_cast<float>(std::max(0.0, std::min(time - sample(0).time, mMaxExtrapolation)));
+  const glm::vec3 position = sample(0).position;
+
+  //turn about the device's own position, then move it
+  const glm::mat4 turn = glm::mat4_cast(fromRotationVector(mAngularVelocity * ahead));
+  const glm::mat4 delta = glm::translate(glm::mat4(1.0f), position + mVelocity * ahead) *
+                          turn *
+                          glm::translate(glm::mat4(1.0f), -position);
+  return delta * mLatest;
+}
@@ -0,0 +1,63 @@
+#ifndef POSEPREDICTOR_H
+#define POSEPREDICTOR_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+
+/*
+ * Predicts where a tracked device will be when the frame reaches the screen.
+ *
+ * Samples are kept with their tracker timestamps in a ring buffer. Every new
+ * sample gives a linear and an angular velocity over the samples in a short
+ * window, which are smoothed with an exponential filter to keep sensor noise
+ * out of the prediction. predict() moves the newest pose forward along both,
+ * by at most the maximum extrapolation so a stalled tracker does not send the
+ * pose off into the distance. Any scale in the pose is kept as it is.
+ */
+class PosePredictor
+{
+public:
+  PosePredictor(unsigned int capacity = 32);
+
+  //seconds of samples the velocities are measured over
+  void setWindow(double seconds) { mWindow = seconds; }
+  //weight of a new velocity against the filtered one, 1 is no filtering
+  void setSmoothing(float alpha) { mSmoothing = alpha; }
+  //longest time a pose is moved forward
+  void setMaxExtrapolation(double seconds) { mMaxExtrapolation = seconds; }
+
+  //false if time is not newer than the last sample, then nothing changes
+  bool addSample(double time, const glm::mat4& pose);
+
+  const glm::mat4& getLatest() const { return mLatest; }
+  const glm::vec3& getVelocity() const { return mVelocity; }
+  const glm::vec3& getAngularVelocity() const { return mAngularVelocity; }
+
+  //the pose at time, from the newest sample and the filtered velocities
+  glm::mat4 predict(double time) const;
+
+private:
+  struct Sample {
+    double time;
+    glm::vec3 position;
+    glm::quat rotation;
+  };
+
+  const Sample& sample(unsigned int age) const;
+
+  std::vector<Sample> mSamples;
+  unsigned int mNewest;
+  unsigned int mCount;
+
+  double mWindow;
+  float mSmoothing;
+  double mMaxExtrapolation;
+
+  glm::mat4 mLatest;
+  glm::vec3 mVelocity;
+  glm::vec3 mAngularVelocity; //axis times radians per second, in world space
+};
+
+#endif
@@ -0,0 +1,256 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+template <class T>
+void append(std::vector<unsigned char>& out, const T& value) {
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+  out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+template <class T>
+bool take(const unsigned char*& data, const unsigned char* end, T& value) {
+  if (end - data < (ptrdiff_t)sizeof(T))
+    return false;
+  std::memcpy(&value, data, sizeof(T));
+  data += sizeof(T);
+  return true;
+}
+
+unsigned int highestBit(uint64_t value) {
+#if defined(__GNUC__)
+  return 63 - __builtin_clzll(value);
+#else
+  unsigned int bit = 0;
+  while (value >>= 1)
+    ++bit;
+  return bit;
+#endif
+}
+
+}
+
+/***********************************************************************************************************
+*                                     PROFILE DATA
+**********************************************************************************************************/
+
+unsigned int ProfileData::bucket(uint64_t nanoseconds) {
+  if (nanoseconds < 8)
+    return nanoseconds;
+
+  //8 linear buckets inside every power of two
+  const unsigned int exponent = highestBit(nanoseconds);
+  const unsigned int index = 8 + (exponent - 3) * 8 + ((nanoseconds >> (exponent - 3)) & 7);
+  return std::min(index, NUM_BUCKETS - 1);
+}
+
+double ProfileData::bucketMiddle(unsigned int bucket) {
+  if (bucket < 8)
+    return bucket + 0.5;
+
+  const unsigned int shift = (bucket - 8) / 8;
+  const double width = double(1ull << shift);
+  return (8 + (bucket - 8) % 8 + 0.5) * width;
+}
+
+double ProfileData::percentile(unsigned int phase, double q) const {
+  const Phase& p = phases[phase];
+  if (p.count == 0)
+    return 0.0;
+
+  const uint64_t rank = std::max<uint64_t>(1, uint64_t(q * p.count + 0.5));
+  uint64_t seen = 0;
+  for (unsigned int i = 0; i < p.buckets.size(); ++i) {
+    seen += p.buckets[i];
+    if (seen >= rank)
+      return std::min(bucketMiddle(i), double(p.max)) * 1e-6;
+  }
+  return p.max * 1e-6;
+}
+
+double ProfileData::mean(unsigned int phase) const {
+  const Phase& p = phases[phase];
+  return p.count > 0 ? double(p.sum) / p.count * 1e-6 : 0.0;
+}
+
+void ProfileData::serialize(std::vector<unsigned char>& out) const {
+  out.clear();
+  append(out, static_cast<uint32_t>(node));
+  append(out, static_cast<uint32_t>(phases.size()));
+
+  for (size_t i = 0; i < phases.size(); ++i) {
+    const Phase& p = phases[i];
+    append(out, static_cast<uint32_t>(p.name.size()));
+    out.insert(out.end(), p.name.begin(), p.name.end());
+    append(out, p.count);
+    append(out, p.sum);
+    append(out, p.max);
+
+    //only the buckets that were hit
+    uint32_t used = 0;
+    for (size_t b = 0; b < p.buckets.size(); ++b)
+      used += p.buckets[b] > 0 ? 1 : 0;
+    append(out, used);
+    for (size_t b = 0; b < p.buckets.size(); ++b) {
+      if (p.buckets[b] > 0) {
+        append(out, static_cast<uint16_t>(b));
+        append(out, p.buckets[b]);
+      }
+    }
+  }
+}
+
+bool ProfileData::deserialize(const unsigned char* data, size_t size) {
+  const unsigned char* end = data + size;
+  uint32_t nodeId, numPhases;
+  if (!take(data, end, nodeId) || !take(data, end, numPhases) || numPhases > Profiler::MAX_PHASES)
+    return false;
+
+  node = nodeId;
+  phases.resize(numPhases);
+  for (uint32_t i = 0; i < numPhases; ++i) {
+    Phase& p = phases[i];
+    uint32_t length, used;
+    if (!take(data, end, length) || uint32_t(end - data) < length)
+      return false;
+    p.name.assign(reinterpret_cast<const char*>(data), length);
+    data += length;
+
+    if (!take(data, end, p.count) || !take(data, end, p.sum) || !take(data, end, p.max) || !take(data, end, used))
+      return false;
+
+    p.buckets.assign(NUM_BUCKETS, 0);
+    for (uint32_t b = 0; b < used; ++b) {
+      uint16_t index;
+      uint64_t count;
+      if (!take(data, end, index) || !take(data, end, count) || index >= NUM_BUCKETS)
+        return false;
+      p.buckets[index] = count;
+    }
+  }
+  return true;
+}
+
+void writeCsv(std::ostream& out, const std::vector<ProfileData>& nodes) {
+  out << "node,phase,count,mean_ms,p50_ms,p90_ms,p99_ms,max_ms\n";
+  for (size_t n = 0; n < nodes.size(); ++n) {
+    const ProfileData& data = nodes[n];
+    for (unsigned int i = 0; i < data.phases.size(); ++i) {
+      out << data.node << ',' << data.phases[i].name << ',' << data.phases[i].count << ','
+          << data.mean(i) << ',' << data.percentile(i, 0.5) << ',' << data.percentile(i, 0.9) << ','
+          << data.percentile(i, 0.99) << ',' << data.phases[i].max * 1e-6 << '\n';
+    }
+  }
+}
+
+void writeJson(std::ostream& out, const std::vector<ProfileData>& nodes) {
+  out << "{\n  \"nodes\": [";
+  for (size_t n = 0; n < nodes.size(); ++n) {
+    const ProfileData& data = nodes[n];
+    out << (n > 0 ? "," : "") << "\n    { \"node\": " << data.node << ", \"phases\": [";
+    for (unsigned int i = 0; i < data.phases.size(); ++i) {
+      out << (i > 0 ? "," : "") << "\n      { \"name\": \"" << data.phases[i].name << "\""
+          << ", \"count\": " << data.phases[i].count
+          << ", \"mean_ms\": " << data.mean(i)
+          << ", \"p50_ms\": " << data.percentile(i, 0.5)
+          << ", \"p90_ms\": " << data.percentile(i, 0.9)
+          << ", \"p99_ms\": " << data.percentile(i, 0.99)
+          << ", \"max_ms\": " << data.phases[i].max * 1e-6 << " }";
+    }
+    out << "\n    ] }";
+  }
+  out << "\n  ]\n}\n";
+}
+
+/***********************************************************************************************************
+*                                     PROFILER
+**********************************************************************************************************/
+
+Profiler& Profiler::instance() {
+  static Profiler profiler;
+  return profiler;
+}
+
+Profiler::Profiler()
+  : mNumPhases(0) {
+}
+
+unsigned int Profiler::addPhase(const std::string& name) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  const unsigned int numPhases = mNumPhases.load();
+  for (unsigned int i = 0; i < numPhases; ++i) {
+    if (mNames[i] == name)
+      return i;
+  }
+
+  //past the limit everything lands in the last phase
+  if (numPhases == MAX_PHASES)
+    return MAX_PHASES - 1;
+
+  mNames[numPhases] = name;
+  mNumPhases.store(numPhases + 1);
+  return numPhases;
+}
+
+Profiler::ThreadData* Profiler::threadData() {
+  //the histograms of a thread live as long as the process, so collect() can always read them
+  static thread_local ThreadData* data = NULL;
+  if (!data) {
+    data = new ThreadData(); //value initialized, all counters start at 0
+    std::lock_guard<std::mutex> lock(mMutex);
+    mThreads.push_back(data);
+  }
+  return data;
+}
+
+void Profiler::record(unsigned int phase, uint64_t nanoseconds) {
+  if (phase >= MAX_PHASES)
+    return;
+
+  //only this thread writes its histograms, the atomics are for collect() on other threads
+  Histogram& h = threadData()->phases[phase];
+  h.count.fetch_add(1, std::memory_order_relaxed);
+  h.sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+  if (nanoseconds > h.max.load(std::memory_order_relaxed))
+    h.max.store(nanoseconds, std::memory_order_relaxed);
+  h.buckets[ProfileData::bucket(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Profiler::collect(ProfileData& data) const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  const unsigned int numPhases = mNumPhases.load();
+
+  data.phases.resize(numPhases);
+  for (unsigned int i = 0; i < numPhases; ++i) {
+    ProfileData::Phase& p = data.phases[i];
+    p.name = mNames[i];
+    p.count = p.sum = p.max = 0;
+    p.buckets.assign(ProfileData::NUM_BUCKETS, 0);
+
+    for (size_t t = 0; t < mThreads.size(); ++t) {
+      const Histogram& h = mThreads[t]->phases[i];
+      p.count += h.count.load(std::memory_order_relaxed);
+      p.sum += h.sum.load(std::memory_order_relaxed);
+      p.max = std::max(p.max, h.max.load(std::memory_order_relaxed));
+      for (unsigned int b = 0; b < ProfileData::NUM_BUCKETS; ++b)
+        p.buckets[b] += h.buckets[b].load(std::memory_order_relaxed);
+    }
+  }
+}
+
+void Profiler::reset() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  for (size_t t = 0; t < mThreads.size(); ++t) {
+    for (unsigned int i = 0; i < MAX_PHASES; ++i) {
+      Histogram& h = mThreads[t]->phases[i];
+      h.count.store(0, std::memory_order_relaxed);
+      h.sum.store(0, std::memory_order_relaxed);
+      h.max.store(0, std::memory_order_relaxed);
+      for (unsigned int b = 0; b < ProfileData::NUM_BUCKETS; ++b)
+        h.buckets[b].store(0, std::memory_order_relaxed);
+    }
+  }
+}
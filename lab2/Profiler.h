@@ -0,0 +1,111 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+ * Frame phase timing.
+ *
+ * Phases are registered by name once and timed with ScopedTimer. Every thread
+ * that records gets its own histograms, so recording is a few relaxed atomic
+ * adds and never takes a lock; only the first record on a new thread does.
+ * The histograms are log-linear, 8 buckets per power of two, which keeps any
+ * percentile within 12.5 % of the true value from nanoseconds to minutes.
+ *
+ * collect() merges all threads into a ProfileData, which can be serialized to
+ * send it to another node and written as CSV or JSON together with the data of
+ * other nodes.
+ */
+struct ProfileData
+{
+  static const unsigned int NUM_BUCKETS = 312;
+
+  struct Phase {
+    std::string name;
+    uint64_t count;
+    uint64_t sum; //nanoseconds
+    uint64_t max;
+    std::vector<uint64_t> buckets;
+  };
+
+  unsigned int node;
+  std::vector<Phase> phases;
+
+  //milliseconds at fraction q of the samples of a phase, 0 if it has none
+  double percentile(unsigned int phase, double q) const;
+  double mean(unsigned int phase) const;
+
+  void serialize(std::vector<unsigned char>& out) const;
+  bool deserialize(const unsigned char* data, size_t size);
+
+  static unsigned int bucket(uint64_t nanoseconds);
+  static double bucketMiddle(unsigned int bucket);
+};
+
+void writeCsv(std::ostream& out, const std::vector<ProfileData>& nodes);
+void writeJson(std::ostream& out, const std::vector<ProfileData>& nodes);
+
+class Profiler
+{
+public:
+  static const unsigned int MAX_PHASES = 32;
+
+  static Profiler& instance();
+
+  //returns the id to time the phase with, the same name gives the same id
+  unsigned int addPhase(const std::string& name);
+  unsigned int getNumPhases() const { return mNumPhases.load(); }
+
+  void record(unsigned int phase, uint64_t nanoseconds);
+  //merge the histograms of every thread, node is left for the caller
+  void collect(ProfileData& data) const;
+  //start over, samples recorded meanwhile may be lost
+  void reset();
+
+private:
+  struct Histogram {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> max;
+    std::atomic<uint64_t> buckets[ProfileData::NUM_BUCKETS];
+  };
+
+  struct ThreadData {
+    Histogram phases[MAX_PHASES];
+  };
+
+  Profiler();
+  ThreadData* threadData();
+
+  std::string mNames[MAX_PHASES];
+  std::atomic<unsigned int> mNumPhases;
+  mutable std::mutex mMutex; //phases and threads are added under it
+  std::vector<ThreadData*> mThreads;
+};
+
+//times its own scope into a phase
+class ScopedTimer
+{
+public:
+  explicit ScopedTimer(unsigned int phase)
+    : mPhase(phase),
+      mStart(std::chrono::steady_clock::now()) {
+  }
+
+  ~ScopedTimer() {
+    const std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - mStart;
+    Profiler::instance().record(mPhase, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+  }
+
+private:
+  unsigned int mPhase;
+  std::chrono::steady_clock::time_point mStart;
+};
+
+#endif
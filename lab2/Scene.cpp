@@ -0,0 +1,50 @@
+#include "Scene.h"
+#include "Logger.h"
+
+#include <osg/Geode>
+
+namespace {
+
+osg::Geode* createWand(Scene& scene) {
+  osg::Geode* geode = new osg::Geode();
+
+  //one line, allocated once and rewritten in place every frame
+  scene.wandLine = new DynamicGeometry(osg::PrimitiveSet::LINES, 2);
+  scene.wandLine->setNumVertices(2);
+  scene.wandLine->setVertex(0, osg::Vec3(0, 0, 0));
+  scene.wandLine->setVertex(1, osg::Vec3(1, 0, 0));
+  scene.wandLine->setColor(osg::Vec4(0.3f,0.7f,0.4f,1.0f));
+
+  osg::Vec3Array* normals = new osg::Vec3Array;
+  normals->push_back(osg::Vec3(0.0f,-1.0f,0.0f));
+  scene.wandLine->setNormalArray(normals, osg::Array::BIND_OVERALL);
+
+  scene.wandLine->commit();
+  geode->addDrawable(scene.wandLine.get());
+
+  return geode;
+}
+
+}
+
+void createScene(osg::Group* root, ModelLoader& loader, const std::string& manifest, Scene& scene) {
+  root->addChild(createWand(scene));
+
+  scene.sgctTrans = new osg::MatrixTransform();
+  scene.sceneTrans = new osg::MatrixTransform();
+
+  root->addChild(scene.sgctTrans.get());
+  scene.sgctTrans->addChild(scene.sceneTrans.get());
+
+  //read the models listed in the manifest on worker threads, placeholders are shown until they are swapped in
+  if (!loader.readManifest(manifest)) {
+    LOG_WARNING("No manifest '%s', loading the default models", manifest.c_str());
+    ModelLoader::Model truck = { "files/dumptruck.osg", 0.1f, osg::Vec3(0.0f, 0.0f, 0.0f), false };
+    ModelLoader::Model airplane = { "files/airplane.ive", 0.2f, osg::Vec3(0.0f, 0.0f, 0.5f), true };
+    loader.addModel(truck);
+    loader.addModel(airplane);
+  }
+
+  LOG_INFO("Loading %u models...", loader.getNumModels());
+  loader.start(scene.sceneTrans.get());
+}
@@ -0,0 +1,31 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <osg/Group>
+#include <osg/MatrixTransform>
+
+#include "DynamicGeometry.h"
+#include "ModelLoader.h"
+
+#include <string>
+
+/*
+ * The scene graph of the application, also built by the benchmark so both
+ * run on the same structure.
+ *
+ * The root holds the wand line and the transform that places the scene as the
+ * SGCT configuration says. Below that the scene transform, which the arrow
+ * keys and the flight modes move, holds a placeholder for every model of the
+ * manifest until the loader has read it and it is swapped in. Without a
+ * manifest the dump truck and the airplane are loaded.
+ */
+struct Scene {
+  osg::ref_ptr<osg::MatrixTransform> sgctTrans;
+  osg::ref_ptr<osg::MatrixTransform> sceneTrans;
+  osg::ref_ptr<DynamicGeometry> wandLine; //rewritten in place every frame
+};
+
+//build the scene under root and start loading its models on the loader's threads
+void createScene(osg::Group* root, ModelLoader& loader, const std::string& manifest, Scene& scene);
+
+#endif
@@ -0,0 +1,20 @@
+#include "SelectableRegistry.h"
+
+unsigned int SelectableRegistry::add(osg::Node* node, osg::MatrixTransform* transform) {
+  PickBvh::Object object;
+  PickBvh::buildObject(node, object);
+  return add(object, transform);
+}
+
+unsigned int SelectableRegistry::add(PickBvh::Object& object, osg::MatrixTransform* transform) {
+  const osg::Node* node = object.node.get();
+  const unsigned int id = mPickBvh.addObject(object);
+  mTransforms.push_back(transform);
+  mIds[node] = id;
+  return id;
+}
+
+unsigned int SelectableRegistry::find(const osg::Node* node) const {
+  std::unordered_map<const osg::Node*, unsigned int>::const_iterator it = mIds.find(node);
+  return it == mIds.end() ? NONE : it->second;
+}
@@ -0,0 +1,46 @@
+#ifndef SELECTABLEREGISTRY_H
+#define SELECTABLEREGISTRY_H
+
+#include <osg/MatrixTransform>
+#include <osg/Node>
+
+#include "PickBvh.h"
+
+#include <unordered_map>
+#include <vector>
+
+/*
+ * The objects the wand can pick and move.
+ *
+ * Any subgraph can be registered along with the transform that grabbing it
+ * moves. Its id is its index in the PickBvh, so the object of a hit is one
+ * array lookup away, and the object of a node one hash lookup. Nothing is
+ * assumed about where the transform sits relative to the node.
+ */
+class SelectableRegistry
+{
+public:
+  static const unsigned int NONE = ~0u;
+
+  //builds the pick hierarchy of node, transform may be null for objects that only highlight
+  unsigned int add(osg::Node* node, osg::MatrixTransform* transform);
+  //the same with a hierarchy from PickBvh::buildObject(), which is left empty
+  unsigned int add(PickBvh::Object& object, osg::MatrixTransform* transform);
+
+  unsigned int getNumObjects() const { return mTransforms.size(); }
+  osg::Node* getNode(unsigned int id) const { return mPickBvh.getObject(id); }
+  osg::MatrixTransform* getTransform(unsigned int id) const { return mTransforms[id].get(); }
+
+  unsigned int resolve(const PickBvh::Hit& hit) const { return hit.object; }
+  //the id of a registered node, NONE for any other
+  unsigned int find(const osg::Node* node) const;
+
+  PickBvh& getPickBvh() { return mPickBvh; }
+
+private:
+  PickBvh mPickBvh;
+  std::vector< osg::ref_ptr<osg::MatrixTransform> > mTransforms;
+  std::unordered_map<const osg::Node*, unsigned int> mIds;
+};
+
+#endif
@@ -0,0 +1,212 @@
+#include "SessionRecord.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char MAGIC[8] = { 'S', 'G', 'C', 'T', 'R', 'E', 'C', '2' }; //bumped whenever the record fields change
+
+struct Header {
+  char magic[8];
+  unsigned int keyframeInterval;
+};
+
+}
+
+/***********************************************************************************************************
+*                                     RECORDER
+**********************************************************************************************************/
+
+SessionRecorder::SessionRecorder()
+  : mFile(NULL),
+    mNumFrames(0),
+    mStop(false) {
+}
+
+SessionRecorder::~SessionRecorder() {
+  close();
+}
+
+bool SessionRecorder::open(const std::string& fileName, unsigned int keyframeInterval) {
+  close();
+
+  mFile = std::fopen(fileName.c_str(), "wb");
+  if (!mFile)
+    return false;
+
+  Header header;
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.keyframeInterval = keyframeInterval;
+  std::fwrite(&header, sizeof(header), 1, mFile);
+
+  mEncoder = DeltaEncoder(keyframeInterval);
+  mNumFrames = 0;
+  mStop = false;
+  mWriter = std::thread(&SessionRecorder::write, this);
+  return true;
+}
+
+void SessionRecorder::close() {
+  if (!mFile)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStop = true;
+  }
+  mWake.notify_one();
+  mWriter.join();
+
+  std::fclose(mFile);
+  mFile = NULL;
+}
+
+DeltaEncoder& SessionRecorder::begin() {
+  mEncoder.begin();
+  return mEncoder;
+}
+
+void SessionRecorder::end() {
+  const std::vector<unsigned char>& frame = mEncoder.end();
+  const unsigned int size = frame.size();
+  const unsigned char* sizeBytes = reinterpret_cast<const unsigned char*>(&size);
+
+  {
+    //the writer swaps the buffer out, so this only ever waits for a swap
+    std::lock_guard<std::mutex> lock(mMutex);
+    mPending.insert(mPending.end(), sizeBytes, sizeBytes + sizeof(size));
+    mPending.insert(mPending.end(), frame.begin(), frame.end());
+  }
+  mWake.notify_one();
+  ++mNumFrames;
+}
+
+void SessionRecorder::write() {
+  std::vector<unsigned char> writing;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mMutex);
+      mWake.wait(lock, [this] { return mStop || !mPending.empty(); });
+      if (mPending.empty())
+        return; //stopped with nothing left
+      writing.swap(mPending);
+    }
+
+    std::fwrite(&writing[0], 1, writing.size(), mFile);
+    std::fflush(mFile);
+    writing.clear();
+  }
+}
+
+/***********************************************************************************************************
+*                                     PLAYER
+**********************************************************************************************************/
+
+SessionPlayer::SessionPlayer()
+  : mData(NULL),
+    mSize(0),
+    mNext(0),
+    mLoop(false),
+#ifdef _WIN32
+    mFileHandle(INVALID_HANDLE_VALUE),
+    mMapping(NULL) {
+#else
+    mFileHandle(-1) {
+#endif
+}
+
+SessionPlayer::~SessionPlayer() {
+  close();
+}
+
+bool SessionPlayer::open(const std::string& fileName) {
+  close();
+
+#ifdef _WIN32
+  mFileHandle = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (mFileHandle == INVALID_HANDLE_VALUE)
+    return false;
+  LARGE_INTEGER size;
+  GetFileSizeEx(mFileHandle, &size);
+  mSize = static_cast<size_t>(size.QuadPart);
+  mMapping = mSize > 0 ? CreateFileMappingA(mFileHandle, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+  if (mMapping)
+    mData = static_cast<const unsigned char*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+#else
+  mFileHandle = ::open(fileName.c_str(), O_RDONLY);
+  if (mFileHandle < 0)
+    return false;
+  struct stat info;
+  mSize = fstat(mFileHandle, &info) == 0 ? info.st_size : 0;
+  if (mSize > 0) {
+    void* data = mmap(NULL, mSize, PROT_READ, MAP_PRIVATE, mFileHandle, 0);
+    if (data != MAP_FAILED) {
+      mData = static_cast<const unsigned char*>(data);
+      madvise(data, mSize, MADV_SEQUENTIAL);
+    }
+  }
+#endif
+
+  if (!mData || mSize < sizeof(Header) || std::memcmp(mData, MAGIC, sizeof(MAGIC)) != 0) {
+    close();
+    return false;
+  }
+
+  //a record cut short ends the recording
+  size_t pos = sizeof(Header);
+  while (pos + sizeof(unsigned int) <= mSize) {
+    unsigned int size;
+    std::memcpy(&size, mData + pos, sizeof(size));
+    if (size > mSize - pos - sizeof(size))
+      break;
+    mFrames.push_back(pos);
+    pos += sizeof(size) + size;
+  }
+  mNext = 0;
+  return true;
+}
+
+void SessionPlayer::close() {
+#ifdef _WIN32
+  if (mData)
+    UnmapViewOfFile(mData);
+  if (mMapping)
+    CloseHandle(mMapping);
+  if (mFileHandle != INVALID_HANDLE_VALUE)
+    CloseHandle(mFileHandle);
+  mMapping = NULL;
+  mFileHandle = INVALID_HANDLE_VALUE;
+#else
+  if (mData)
+    munmap(const_cast<unsigned char*>(mData), mSize);
+  if (mFileHandle >= 0)
+    ::close(mFileHandle);
+  mFileHandle = -1;
+#endif
+  mData = NULL;
+  mSize = 0;
+  mFrames.clear();
+  mNext = 0;
+}
+
+bool SessionPlayer::next(DeltaDecoder& decoder) {
+  if (mNext >= mFrames.size()) {
+    if (!mLoop || mFrames.empty())
+      return false;
+    mNext = 0; //the first record is a keyframe
+  }
+
+  const size_t pos = mFrames[mNext++];
+  unsigned int size;
+  std::memcpy(&size, mData + pos, sizeof(size));
+  return decoder.begin(mData + pos + sizeof(size), size);
+}
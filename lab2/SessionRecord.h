@@ -0,0 +1,102 @@
+#ifndef SESSIONRECORD_H
+#define SESSIONRECORD_H
+
+#include "DeltaSync.h"
+
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Recording and replay of the state the master shares every frame.
+ *
+ * A recording is a header followed by one record per frame, each a 32 bit
+ * length and a delta encoded frame as in DeltaSync, with a keyframe every
+ * keyframe interval. Records are only ever appended, so a recording cut short
+ * by a crash is still readable up to its last whole record.
+ *
+ * The recorder encodes on the frame thread and hands the bytes to a writer
+ * thread, the frame never waits for the disk. If the disk falls behind the
+ * pending frames pile up in memory rather than being dropped, since every
+ * delta depends on the ones before it.
+ *
+ * The player maps the whole file and decodes straight from the mapping. It
+ * finds the records when it is opened and then steps through them, the same
+ * file always gives the same frames.
+ */
+
+//the fields of an application recording, the tracker takes TrackerState::NUM_FIELDS ids from RECORD_TRACKER on
+//the models field holds which models were shown, so a replay swaps them in on the frames they first appeared
+enum RecordField { RECORD_TIME = 0, RECORD_DIST, RECORD_MODELS, RECORD_TRACKER };
+
+class SessionRecorder
+{
+public:
+  SessionRecorder();
+  ~SessionRecorder();
+
+  bool open(const std::string& fileName, unsigned int keyframeInterval = 60);
+  //write what is pending and stop the writer
+  void close();
+  bool isOpen() const { return mFile != NULL; }
+
+  //start a frame, write its fields to the returned encoder and call end()
+  DeltaEncoder& begin();
+  void end();
+
+  unsigned int getNumFrames() const { return mNumFrames; }
+
+private:
+  void write();
+
+  DeltaEncoder mEncoder;
+  FILE* mFile;
+  unsigned int mNumFrames;
+
+  std::thread mWriter;
+  std::mutex mMutex;
+  std::condition_variable mWake;
+  std::vector<unsigned char> mPending; //frames not yet taken by the writer
+  bool mStop;
+};
+
+class SessionPlayer
+{
+public:
+  SessionPlayer();
+  ~SessionPlayer();
+
+  bool open(const std::string& fileName);
+  void close();
+  bool isOpen() const { return mData != NULL; }
+
+  unsigned int getNumFrames() const { return mFrames.size(); }
+  //the frame next() returns next
+  unsigned int getFrame() const { return mNext; }
+
+  //start from the first frame again after the last one
+  void setLoop(bool loop) { mLoop = loop; }
+
+  //start decoding the next frame, false once the recording is over
+  bool next(DeltaDecoder& decoder);
+  void rewind() { mNext = 0; }
+
+private:
+  const unsigned char* mData;
+  size_t mSize;
+  std::vector<size_t> mFrames; //offset of every record
+  unsigned int mNext;
+  bool mLoop;
+
+#ifdef _WIN32
+  void* mFileHandle;
+  void* mMapping;
+#else
+  int mFileHandle;
+#endif
+};
+
+#endif
@@ -0,0 +1,123 @@
+#include "SharedRegistry.h"
+
+/***********************************************************************************************************
+*                                     BITS
+**********************************************************************************************************/
+
+SharedBits::SharedBits(SharedRegistry& registry, const std::string& name, unsigned int numBits, bool trigger)
+  : SharedVariable(name),
+    mRegistry(registry),
+    mWord(0),
+    mShift(0),
+    mMask((uint64_t(1) << numBits) - 1),
+    mTrigger(trigger),
+    mNotified(0) {
+  mRegistry.allocate(numBits, mWord, mShift);
+  if (mTrigger)
+    mRegistry.mTriggerMasks[mWord] |= mMask << mShift;
+}
+
+unsigned int SharedBits::getBits() const {
+  return static_cast<unsigned int>((mRegistry.mWords[mWord] >> mShift) & mMask);
+}
+
+void SharedBits::setBits(unsigned int value) {
+  uint64_t& word = mRegistry.mWords[mWord];
+  word = (word & ~(mMask << mShift)) | ((uint64_t(value) & mMask) << mShift);
+}
+
+void SharedBits::dispatch(bool force) {
+  const unsigned int value = getBits();
+
+  //a trigger is reset here on every node, the master sends the reset with the next frame
+  if (mTrigger) {
+    if (value == 0)
+      return;
+    setBits(0);
+  }
+  else if (!force && value == mNotified) {
+    return;
+  }
+
+  mNotified = mTrigger ? 0 : value;
+  for (size_t i = 0; i < mCallbacks.size(); ++i)
+    mCallbacks[i](value);
+}
+
+/***********************************************************************************************************
+*                                     REGISTRY
+**********************************************************************************************************/
+
+SharedRegistry::SharedRegistry()
+  : mDispatched(false) {
+}
+
+SharedRegistry::~SharedRegistry() {
+  for (size_t i = 0; i < mVariables.size(); ++i)
+    delete mVariables[i];
+}
+
+SharedFlag& SharedRegistry::addFlag(const std::string& name, bool value) {
+  SharedFlag* variable = new SharedFlag(*this, name);
+  variable->set(value);
+  mVariables.push_back(variable);
+  return *variable;
+}
+
+SharedTrigger& SharedRegistry::addTrigger(const std::string& name) {
+  SharedTrigger* variable = new SharedTrigger(*this, name);
+  mVariables.push_back(variable);
+  return *variable;
+}
+
+void SharedRegistry::allocate(unsigned int numBits, unsigned int& word, unsigned int& shift) {
+  for (word = 0; word < mWords.size(); ++word) {
+    if (mWordBits[word] + numBits <= WORD_BITS)
+      break;
+  }
+  if (word == mWords.size()) {
+    mWords.push_back(0);
+    mWordBits.push_back(0);
+    mTriggerMasks.push_back(0);
+    mReceivedWords.push_back(0);
+    mWordReceived.push_back(false);
+  }
+  shift = mWordBits[word];
+  mWordBits[word] += numBits;
+}
+
+void SharedRegistry::encode(DeltaEncoder& encoder, unsigned char field) const {
+  //a trigger fired again before its reset was sent leaves the word as it was last sent, it goes out all the same
+  for (size_t i = 0; i < mWords.size(); ++i)
+    encoder.writeBits(field++, mWords[i], mWordBits[i], (mWords[i] & mTriggerMasks[i]) != 0);
+  for (size_t i = 0; i < mValues.size(); ++i)
+    mValues[i]->encode(encoder, field++);
+}
+
+void SharedRegistry::decode(DeltaDecoder& decoder, unsigned char field) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  for (size_t i = 0; i < mWords.size(); ++i) {
+    if (decoder.readBits(field++, mReceivedWords[i], mWordBits[i]))
+      mWordReceived[i] = true;
+  }
+  for (size_t i = 0; i < mValues.size(); ++i)
+    mValues[i]->decode(decoder, field++);
+}
+
+void SharedRegistry::dispatch() {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (size_t i = 0; i < mWords.size(); ++i) {
+      if (mWordReceived[i])
+        mWords[i] = mReceivedWords[i];
+      mWordReceived[i] = false;
+    }
+    for (size_t i = 0; i < mValues.size(); ++i)
+      mValues[i]->latch();
+  }
+
+  //callbacks may set variables, so they run without the lock
+  for (size_t i = 0; i < mVariables.size(); ++i)
+    mVariables[i]->dispatch(!mDispatched);
+  mDispatched = true;
+}
@@ -0,0 +1,275 @@
+#ifndef SHAREDREGISTRY_H
+#define SHAREDREGISTRY_H
+
+#include "DeltaSync.h"
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class SharedRegistry;
+
+/*
+ * Base of the variables of a SharedRegistry.
+ */
+class SharedVariable
+{
+public:
+  virtual ~SharedVariable() {}
+
+  const std::string& getName() const { return mName; }
+
+protected:
+  friend class SharedRegistry;
+
+  SharedVariable(const std::string& name) : mName(name) {}
+
+  //only variables with a field of their own, the packed ones are written by the registry
+  virtual void encode(DeltaEncoder& /*encoder*/, unsigned char /*field*/) const {}
+  virtual void decode(DeltaDecoder& /*decoder*/, unsigned char /*field*/) {}
+  virtual void latch() {}
+  //run the callbacks if the value differs from the one they saw last, or always if forced
+  virtual void dispatch(bool force) = 0;
+
+  std::string mName;
+};
+
+//the delta encoder call for each type of value
+namespace SharedCodec {
+inline void write(DeltaEncoder& encoder, unsigned char field, double value) { encoder.writeDouble(field, value); }
+inline void write(DeltaEncoder& encoder, unsigned char field, const std::string& value) { encoder.writeString(field, value); }
+inline void write(DeltaEncoder& encoder, unsigned char field, const std::vector<bool>& value) { encoder.writeBools(field, value); }
+inline void write(DeltaEncoder& encoder, unsigned char field, const std::vector<float>& value) { encoder.writeFloats(field, value); }
+inline bool read(DeltaDecoder& decoder, unsigned char field, double& value) { return decoder.readDouble(field, value); }
+inline bool read(DeltaDecoder& decoder, unsigned char field, std::string& value) { return decoder.readString(field, value); }
+inline bool read(DeltaDecoder& decoder, unsigned char field, std::vector<bool>& value) { return decoder.readBools(field, value); }
+inline bool read(DeltaDecoder& decoder, unsigned char field, std::vector<float>& value) { return decoder.readFloats(field, value); }
+}
+
+/*
+ * A double, string or vector of bools or floats, sent in a field of its own.
+ */
+template <class T>
+class SharedValue : public SharedVariable
+{
+public:
+  typedef std::function<void(const T&)> Callback;
+
+  const T& get() const { return mValue; }
+  //master
+  void set(const T& value) { mValue = value; }
+
+  void onChange(const Callback& callback) { mCallbacks.push_back(callback); }
+
+protected:
+  friend class SharedRegistry;
+
+  SharedValue(const std::string& name, const T& value)
+    : SharedVariable(name),
+      mValue(value),
+      mReceived(value),
+      mNotified(value),
+      mHasReceived(false) {
+  }
+
+  virtual void encode(DeltaEncoder& encoder, unsigned char field) const {
+    SharedCodec::write(encoder, field, mValue);
+  }
+
+  virtual void decode(DeltaDecoder& decoder, unsigned char field) {
+    if (SharedCodec::read(decoder, field, mReceived))
+      mHasReceived = true;
+  }
+
+  virtual void latch() {
+    if (mHasReceived)
+      mValue = mReceived;
+    mHasReceived = false;
+  }
+
+  virtual void dispatch(bool force) {
+    if (!force && mValue == mNotified)
+      return;
+    mNotified = mValue;
+    for (size_t i = 0; i < mCallbacks.size(); ++i)
+      mCallbacks[i](mValue);
+  }
+
+  T mValue;
+  T mReceived;
+  T mNotified;
+  bool mHasReceived;
+  std::vector<Callback> mCallbacks;
+};
+
+/*
+ * A few bits in one of the registry's words, the base of flags, triggers and
+ * enums. A trigger goes back to zero once its callbacks have run.
+ */
+class SharedBits : public SharedVariable
+{
+public:
+  typedef std::function<void(unsigned int)> Callback;
+
+  unsigned int getBits() const;
+  //master
+  void setBits(unsigned int value);
+
+protected:
+  friend class SharedRegistry;
+
+  SharedBits(SharedRegistry& registry, const std::string& name, unsigned int numBits, bool trigger);
+
+  void addCallback(const Callback& callback) { mCallbacks.push_back(callback); }
+  virtual void dispatch(bool force);
+
+  SharedRegistry& mRegistry;
+  unsigned int mWord;
+  unsigned int mShift;
+  uint64_t mMask;
+  bool mTrigger;
+  unsigned int mNotified;
+  std::vector<Callback> mCallbacks;
+};
+
+class SharedFlag : public SharedBits
+{
+public:
+  bool get() const { return getBits() != 0; }
+  //master
+  void set(bool value) { setBits(value ? 1 : 0); }
+  void toggle() { set(!get()); }
+
+  void onChange(const std::function<void(bool)>& callback) {
+    addCallback([callback](unsigned int bits) { callback(bits != 0); });
+  }
+
+protected:
+  friend class SharedRegistry;
+
+  SharedFlag(SharedRegistry& registry, const std::string& name) : SharedBits(registry, name, 1, false) {}
+};
+
+class SharedTrigger : public SharedBits
+{
+public:
+  bool isFired() const { return getBits() != 0; }
+  //master, the callbacks run once on every node in the frame this is sent
+  void fire() { setBits(1); }
+
+  void onFire(const std::function<void()>& callback) {
+    addCallback([callback](unsigned int) { callback(); });
+  }
+
+protected:
+  friend class SharedRegistry;
+
+  SharedTrigger(SharedRegistry& registry, const std::string& name) : SharedBits(registry, name, 1, true) {}
+};
+
+//an enum with values that fit in the bits given
+template <class E>
+class SharedEnum : public SharedBits
+{
+public:
+  E get() const { return static_cast<E>(getBits()); }
+  //master
+  void set(E value) { setBits(static_cast<unsigned int>(value)); }
+
+  void onChange(const std::function<void(E)>& callback) {
+    addCallback([callback](unsigned int bits) { callback(static_cast<E>(bits)); });
+  }
+
+protected:
+  friend class SharedRegistry;
+
+  SharedEnum(SharedRegistry& registry, const std::string& name, unsigned int numBits)
+    : SharedBits(registry, name, numBits, false) {
+  }
+};
+
+/*
+ * The variables the master shares with the cluster, each declared once.
+ *
+ * A variable's place in the delta encoded frame follows from the order it was
+ * added in, so every node has to add the same variables in the same order.
+ * Flags, triggers and enums are packed into 64 bit words. Each word is one
+ * field and is only resent when one of its bits changed or a trigger in it is
+ * set, so a trigger fired in two frames in a row reaches every node twice. Every other value has
+ * a field of its own. The words come first, then the values, from the field
+ * given to encode() and decode() on.
+ *
+ * Values are set on the master and read everywhere. dispatch() makes the
+ * decoded values current and runs the callbacks of the variables whose value
+ * differs from the one their callbacks saw last. This happens once per frame
+ * on every node, so state follows a variable without being reapplied every
+ * frame. The first dispatch runs every callback. Decoding may happen on the
+ * network thread, so nothing decoded is visible before dispatch().
+ */
+class SharedRegistry
+{
+public:
+  static const unsigned int WORD_BITS = 64;
+
+  SharedRegistry();
+  ~SharedRegistry();
+
+  template <class T>
+  SharedValue<T>& addValue(const std::string& name, const T& value);
+  SharedFlag& addFlag(const std::string& name, bool value = false);
+  SharedTrigger& addTrigger(const std::string& name);
+  //numBits up to 32
+  template <class E>
+  SharedEnum<E>& addEnum(const std::string& name, E value, unsigned int numBits);
+
+  //fields taken from the first one on
+  unsigned int getNumFields() const { return mWords.size() + mValues.size(); }
+
+  //master
+  void encode(DeltaEncoder& encoder, unsigned char field) const;
+  //the other nodes, on any thread
+  void decode(DeltaDecoder& decoder, unsigned char field);
+  //every node, once per frame
+  void dispatch();
+
+private:
+  friend class SharedBits;
+
+  SharedRegistry(const SharedRegistry&);
+  SharedRegistry& operator=(const SharedRegistry&);
+
+  //the first word with numBits free, a new one if none has
+  void allocate(unsigned int numBits, unsigned int& word, unsigned int& shift);
+
+  std::vector<SharedVariable*> mVariables; //all, in the order they were added
+  std::vector<SharedVariable*> mValues;    //the ones with fields of their own
+
+  std::vector<uint64_t> mWords;
+  std::vector<unsigned int> mWordBits; //bits used in each word
+  std::vector<uint64_t> mTriggerMasks; //the bits of the triggers in each word
+  std::vector<uint64_t> mReceivedWords;
+  std::vector<bool> mWordReceived;
+
+  std::mutex mMutex; //what was decoded but not yet dispatched
+  bool mDispatched;
+};
+
+template <class T>
+SharedValue<T>& SharedRegistry::addValue(const std::string& name, const T& value) {
+  SharedValue<T>* variable = new SharedValue<T>(name, value);
+  mVariables.push_back(variable);
+  mValues.push_back(variable);
+  return *variable;
+}
+
+template <class E>
+SharedEnum<E>& SharedRegistry::addEnum(const std::string& name, E value, unsigned int numBits) {
+  SharedEnum<E>* variable = new SharedEnum<E>(*this, name, numBits);
+  variable->set(value);
+  mVariables.push_back(variable);
+  return *variable;
+}
+
+#endif
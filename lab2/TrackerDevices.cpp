@@ -0,0 +1,71 @@
+#include <sgct.h>
+
+#include "TrackerState.h"
+
+//the master side of TrackerState, the only part that talks to SGCT
+
+void TrackerState::setup() {
+  mCurrent = State();
+  mPredictors.clear();
+
+  sgct::SGCTTrackingManager* manager = sgct::Engine::getTrackingManager();
+  //null when the configuration has no head tracker
+  const sgct::SGCTTrackingDevice* headPtr = manager->getHeadDevicePtr();
+  for (size_t i = 0; i < manager->getNumberOfTrackers(); i++) {
+    sgct::SGCTTracker* trackerPtr = manager->getTrackerPtr(i);
+
+    for (size_t j = 0; j < trackerPtr->getNumberOfDevices(); j++) {
+      sgct::SGCTTrackingDevice* devicePtr = trackerPtr->getDevicePtr(j);
+
+      const unsigned int numButtons = devicePtr->hasButtons() ? devicePtr->getNumberOfButtons() : 0;
+      const unsigned int numAxes = devicePtr->hasAnalogs() ? devicePtr->getNumberOfAxes() : 0;
+      mCurrent.layout.push_back(i);
+      mCurrent.layout.push_back(devicePtr->hasSensor() ? (devicePtr == headPtr ? SENSOR_HEAD : SENSOR) : 0);
+      mCurrent.layout.push_back(numButtons);
+      mCurrent.layout.push_back(numAxes);
+
+      if (devicePtr->hasSensor()) {
+        mCurrent.poses.push_back(glm::mat4(1.0f));
+        mPredictors.push_back(PosePredictor());
+      }
+      mCurrent.buttons.resize(mCurrent.buttons.size() + numButtons, false);
+      mCurrent.axes.resize(mCurrent.axes.size() + numAxes, 0.0f);
+    }
+  }
+}
+
+void TrackerState::sample() {
+  //same order as setup(), the arrays never change size
+  unsigned int pose = 0, button = 0, axis = 0;
+  const double now = sgct::Engine::getTime();
+
+  sgct::SGCTTrackingManager* manager = sgct::Engine::getTrackingManager();
+  for (size_t i = 0; i < manager->getNumberOfTrackers(); i++) {
+    sgct::SGCTTracker* trackerPtr = manager->getTrackerPtr(i);
+
+    for (size_t j = 0; j < trackerPtr->getNumberOfDevices(); j++) {
+      sgct::SGCTTrackingDevice* devicePtr = trackerPtr->getDevicePtr(j);
+
+      if (devicePtr->hasSensor() && pose < mCurrent.poses.size()) {
+        //a sample only counts when the tracker has sent a new one, devices without timestamps are sampled now
+        PosePredictor& predictor = mPredictors[pose];
+        const double stamp = devicePtr->getTrackerTimeStamp();
+        predictor.addSample(stamp > 0.0 ? stamp : now, devicePtr->getWorldTransform());
+        mCurrent.poses[pose++] = mHorizon > 0.0 ? predictor.predict(now + mHorizon) : predictor.getLatest();
+      }
+
+      //sgct counts in int, the same conversion as in setup()
+      if (devicePtr->hasButtons()) {
+        const unsigned int numButtons = devicePtr->getNumberOfButtons();
+        for (unsigned int idx = 0; idx < numButtons && button < mCurrent.buttons.size(); ++idx)
+          mCurrent.buttons[button++] = devicePtr->getButton(idx);
+      }
+
+      if (devicePtr->hasAnalogs()) {
+        const unsigned int numAxes = devicePtr->getNumberOfAxes();
+        for (unsigned int idx = 0; idx < numAxes && axis < mCurrent.axes.size(); ++idx)
+          mCurrent.axes[axis++] = static_cast<float>(devicePtr->getAnalog(idx));
+      }
+    }
+  }
+}
@@ -0,0 +1,103 @@
+#include "TrackerState.h"
+#include "DeltaSync.h"
+
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstdio>
+
+TrackerState::TrackerState()
+  : mHorizon(0.0),
+    mChanged(false) {
+}
+
+void TrackerState::encode(DeltaEncoder& encoder, unsigned char field) const {
+  //the layout is only written on keyframes or when it changes
+  encoder.writeBytes(field, mCurrent.layout);
+  encoder.writePoses(field + 1, mCurrent.poses);
+  encoder.writeBools(field + 2, mCurrent.buttons);
+  encoder.writeFloats(field + 3, mCurrent.axes);
+}
+
+void TrackerState::decode(DeltaDecoder& decoder, unsigned char field) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  //all four are read whatever the others returned, they are in the frame in this order
+  bool changed = decoder.readBytes(field, mReceived.layout);
+  changed = decoder.readPoses(field + 1, mReceived.poses) || changed;
+  changed = decoder.readBools(field + 2, mReceived.buttons) || changed;
+  changed = decoder.readFloats(field + 3, mReceived.axes) || changed;
+  mChanged = mChanged || changed;
+}
+
+void TrackerState::loopback(DeltaDecoder& decoder, unsigned char field) {
+  decode(decoder, field);
+
+  //fields left out of the frame still hold what was decoded before, not the new samples
+  std::lock_guard<std::mutex> lock(mMutex);
+  mChanged = true;
+}
+
+void TrackerState::latch() {
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (!mChanged)
+    return;
+
+  //same sizes from frame to frame, so the copies reuse the storage
+  mCurrent.layout = mReceived.layout;
+  mCurrent.poses = mReceived.poses;
+  mCurrent.buttons = mReceived.buttons;
+  mCurrent.axes = mReceived.axes;
+  mChanged = false;
+}
+
+unsigned int TrackerState::getHeadPose() const {
+  unsigned int pose = 0;
+  for (size_t d = 0; d + LAYOUT_STRIDE <= mCurrent.layout.size(); d += LAYOUT_STRIDE) {
+    if (mCurrent.layout[d + 1] == SENSOR_HEAD)
+      return pose < mCurrent.poses.size() ? pose : NO_POSE;
+    if (mCurrent.layout[d + 1])
+      ++pose;
+  }
+  return NO_POSE;
+}
+
+void TrackerState::format(std::string& text) const {
+  text.clear();
+
+  char line[128];
+  unsigned int pose = 0, button = 0, axis = 0;
+  unsigned int lastTracker = 0, device = 0;
+  for (size_t d = 0; d + LAYOUT_STRIDE <= mCurrent.layout.size(); d += LAYOUT_STRIDE) {
+    const unsigned int tracker = mCurrent.layout[d];
+    device = (d == 0 || tracker != lastTracker) ? 0 : device + 1;
+    lastTracker = tracker;
+
+    std::snprintf(line, sizeof(line), "Device %u on tracker %u\n", device, tracker);
+    text += line;
+
+    if (mCurrent.layout[d + 1] && pose < mCurrent.poses.size()) {
+      const glm::mat4& m = mCurrent.poses[pose++];
+      const glm::vec3 angles = glm::degrees(glm::eulerAngles(glm::quat_cast(glm::mat3(m))));
+      std::snprintf(line, sizeof(line), "Position:\n  %.3f, %.3f, %.3f\nEuler angles:\n  %.1f, %.1f, %.1f\n",
+                    m[3][0], m[3][1], m[3][2], angles.x, angles.y, angles.z);
+      text += line;
+    }
+
+    const unsigned int numButtons = mCurrent.layout[d + 2];
+    if (numButtons > 0) {
+      text += "Buttons:\n  ";
+      for (unsigned int b = 0; b < numButtons && button < mCurrent.buttons.size(); ++b)
+        text += mCurrent.buttons[button++] ? '1' : '0';
+      text += '\n';
+    }
+
+    const unsigned int numAxes = mCurrent.layout[d + 3];
+    if (numAxes > 0) {
+      text += "Analogs:\n";
+      for (unsigned int a = 0; a < numAxes && axis < mCurrent.axes.size(); ++a) {
+        std::snprintf(line, sizeof(line), "  %.3f\n", mCurrent.axes[axis++]);
+        text += line;
+      }
+    }
+    text += '\n';
+  }
+}
@@ -0,0 +1,97 @@
+#ifndef TRACKERSTATE_H
+#define TRACKERSTATE_H
+
+#include <glm/glm.hpp>
+
+#include "PosePredictor.h"
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+class DeltaEncoder;
+class DeltaDecoder;
+
+/*
+ * The state of every tracking device, shared with the cluster.
+ *
+ * The master reads all devices into fixed layout arrays once per frame: one
+ * pose per device with a sensor, then the buttons and analog axes of all
+ * devices after each other in device order. The layout itself, which device
+ * has what and which one SGCT's configuration uses as the head, is synced
+ * along with the arrays so any node can make sense of them. Nothing is formatted unless someone asks for the debug text.
+ *
+ * The poses the master shares are not the last samples but predictions for
+ * when the frame will be on screen, the prediction horizon after sampling.
+ * Every node shows the same predicted pose, and the pose of the head device
+ * also drives the head tracked projection. The master reads its own frame back with
+ * loopback() so that it goes on from the quantized poses the others decode
+ * rather than from its full precision ones.
+ *
+ * Decoding may happen on the network thread, so decoded state only becomes
+ * visible through the getters after latch(). Only setup() and sample() use
+ * SGCT, they are in TrackerDevices.cpp so that tools replaying a recording
+ * build without it.
+ */
+class TrackerState
+{
+public:
+  //the field ids used in the sync frame are field to field + NUM_FIELDS - 1
+  static const unsigned char NUM_FIELDS = 4;
+
+  TrackerState();
+
+  //master: find the devices of all trackers
+  void setup();
+  //master: read every device
+  void sample();
+
+  //seconds from sampling to the frame being shown, 0 shares the newest samples as they are
+  void setPredictionHorizon(double seconds) { mHorizon = seconds; }
+  double getPredictionHorizon() const { return mHorizon; }
+  //master: the predictor of a pose, for its filter settings
+  PosePredictor& getPredictor(unsigned int pose) { return mPredictors[pose]; }
+
+  void encode(DeltaEncoder& encoder, unsigned char field) const;
+  void decode(DeltaDecoder& decoder, unsigned char field);
+  //master: decode the frame it has just encoded, replacing what sample() wrote at latch()
+  void loopback(DeltaDecoder& decoder, unsigned char field);
+  //make the last decoded state current, call once per frame before the getters
+  void latch();
+
+  static const unsigned int NO_POSE = ~0u;
+
+  unsigned int getNumPoses() const { return mCurrent.poses.size(); }
+  //the pose of the device SGCT's configuration uses as the head, NO_POSE without one
+  unsigned int getHeadPose() const;
+  const glm::mat4& getPose(unsigned int pose) const { return mCurrent.poses[pose]; }
+  unsigned int getNumButtons() const { return mCurrent.buttons.size(); }
+  bool getButton(unsigned int button) const { return mCurrent.buttons[button]; }
+  unsigned int getNumAxes() const { return mCurrent.axes.size(); }
+  float getAxis(unsigned int axis) const { return mCurrent.axes[axis]; }
+
+  //the debug overlay, per device
+  void format(std::string& text) const;
+
+private:
+  //per device: tracker index, sensor, number of buttons, number of axes
+  static const unsigned int LAYOUT_STRIDE = 4;
+  //the sensor byte of a device, 0 without one
+  enum { SENSOR = 1, SENSOR_HEAD = 2 };
+
+  struct State {
+    std::vector<unsigned char> layout;
+    std::vector<glm::mat4> poses;
+    std::vector<bool> buttons;
+    std::vector<float> axes;
+  };
+
+  State mCurrent;
+  State mReceived;
+  std::vector<PosePredictor> mPredictors; //master only, one per pose
+  double mHorizon;
+  bool mChanged;
+  std::mutex mMutex;
+};
+
+#endif
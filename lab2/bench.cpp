@@ -0,0 +1,290 @@
+#include <osg/Group>
+#include <osg/MatrixTransform>
+
+#include "Interaction.h"
+#include "ModelLoader.h"
+#include "Profiler.h"
+#include "Scene.h"
+#include "SelectableRegistry.h"
+#include "SessionRecord.h"
+#include "TextureCache.h"
+#include "TrackerState.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+/*
+ * Headless benchmark of the wand interaction.
+ *
+ * Builds the scene of the application with createScene() and swaps its
+ * models in as soon as they are read. For every scene size the models are
+ * copied until there are that many of each in a grid in front of the user,
+ * and Interaction is driven with a scripted wand: it sweeps across the grid
+ * and cycles through hovering, grabbing, scaling and both flight modes, which
+ * move the scene transform from frame to frame as in the application. No
+ * window, GL context or SGCT is needed, so it runs on build machines.
+ *
+ * With --replay the wand, head and buttons come from a recording made with
+ * solution --record instead, played from the start for every size and
+ * repeated until the frames are done.
+ *
+ *   bench [--frames n] [--sizes 1,4,16,64] [--manifest file] [--replay file] [--csv file] [--json file]
+ */
+
+namespace {
+
+const double PI = 3.14159265358979323846;
+const float SPACING = 0.5f;  //between copies in the grid
+const float DEPTH = -0.7f;   //grid distance in front of the wand, the wand ray is a meter long
+const unsigned int WAND_POSE = 0; //sensors as in the application
+const unsigned int HEAD_POSE = 1;
+
+struct Options {
+  unsigned int frames;
+  std::vector<unsigned int> sizes;
+  std::string manifest;
+  std::string replay;
+  std::string csv;
+  std::string json;
+};
+
+bool parse(int argc, char* argv[], Options& options) {
+  options.frames = 2000;
+  options.manifest = "files/models.txt";
+
+  for (int i = 1; i < argc; ++i) {
+    const bool hasValue = i + 1 < argc;
+    if (!std::strcmp(argv[i], "--frames") && hasValue) {
+      options.frames = std::atoi(argv[++i]);
+    }
+    else if (!std::strcmp(argv[i], "--sizes") && hasValue) {
+      std::stringstream list(argv[++i]);
+      std::string size;
+      while (std::getline(list, size, ','))
+        options.sizes.push_back(std::atoi(size.c_str()));
+    }
+    else if (!std::strcmp(argv[i], "--manifest") && hasValue) {
+      options.manifest = argv[++i];
+    }
+    else if (!std::strcmp(argv[i], "--replay") && hasValue) {
+      options.replay = argv[++i];
+    }
+    else if (!std::strcmp(argv[i], "--csv") && hasValue) {
+      options.csv = argv[++i];
+    }
+    else if (!std::strcmp(argv[i], "--json") && hasValue) {
+      options.json = argv[++i];
+    }
+    else {
+      return false;
+    }
+  }
+
+  if (options.sizes.empty()) {
+    options.sizes.push_back(1);
+    options.sizes.push_back(4);
+    options.sizes.push_back(16);
+    options.sizes.push_back(64);
+  }
+  return options.frames > 0;
+}
+
+//the scripted user, a 240 frame cycle of button modes while the wand sweeps the grid
+void scriptInput(unsigned int frame, float extent, Interaction::Input& input) {
+  const double t = frame / 60.0;
+  const float yaw = std::atan2(extent, -DEPTH) * std::sin(2.0 * PI * 0.13 * t);
+  const float pitch = std::atan2(extent, -DEPTH) * std::sin(2.0 * PI * 0.07 * t);
+
+  input.hasWand = true;
+  input.hasHead = true;
+  input.head = glm::mat4(1.0f);
+  input.head[3] = glm::vec4(0.0f, 0.3f, 0.3f, 1.0f);
+
+  //yaw about y, then pitch about x, from the origin
+  const float cy = std::cos(yaw), sy = std::sin(yaw), cp = std::cos(pitch), sp = std::sin(pitch);
+  input.wand = glm::mat4(1.0f);
+  input.wand[0] = glm::vec4(cy, 0.0f, -sy, 0.0f);
+  input.wand[1] = glm::vec4(sy * sp, cp, cy * sp, 0.0f);
+  input.wand[2] = glm::vec4(sy * cp, -sp, cy * cp, 0.0f);
+
+  input.numButtons = 6;
+  for (unsigned int i = 0; i < input.numButtons; ++i)
+    input.buttons[i] = false;
+
+  const unsigned int step = frame % 240;
+  if (step >= 60 && step < 120)
+    input.buttons[2] = true;                          //grab and turn
+  else if (step >= 120 && step < 150)
+    input.buttons[2] = input.buttons[4] = true;       //grab and scale
+  else if (step >= 150 && step < 180)
+    input.buttons[1] = true;                          //fly along the wand
+  else if (step >= 180 && step < 210)
+    input.buttons[0] = true;                          //fly along head to wand
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  Options options;
+  if (!parse(argc, argv, options)) {
+    std::fprintf(stderr, "usage: %s [--frames n] [--sizes 1,4,16,64] [--manifest file] [--replay file] [--csv file] [--json file]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  //the application's scene, waiting for every model instead of showing placeholders
+  osg::ref_ptr<osg::Group> root = new osg::Group();
+  Scene scene;
+  TextureCache textureCache;
+  ModelLoader loader;
+  loader.setTextureCache(&textureCache);
+  createScene(root.get(), loader, options.manifest, scene);
+
+  //the copies share each model's subgraph, so every copy, the first too, is selected through a group of its own
+  //that carries the highlight rather than the shared model
+  std::vector< osg::ref_ptr<osg::Node> > models;
+  std::vector< osg::ref_ptr<osg::Group> > firstCopies;
+  std::vector< osg::ref_ptr<osg::MatrixTransform> > transforms;
+  std::vector<osg::Matrix> placements;
+  for (unsigned int i = 0; i < loader.getNumModels(); ++i) {
+    osg::Node* model = loader.swap(i);
+    if (model) {
+      osg::ref_ptr<osg::Group> copy = new osg::Group();
+      copy->addChild(model);
+      loader.getTransform(i)->replaceChild(model, copy.get());
+      models.push_back(model);
+      firstCopies.push_back(copy);
+      transforms.push_back(loader.getTransform(i));
+      placements.push_back(loader.getTransform(i)->getMatrix());
+    }
+  }
+  loader.stop();
+  const unsigned int numLoaded = scene.sceneTrans->getNumChildren();
+
+  if (models.empty()) {
+    std::fprintf(stderr, "no models could be read\n");
+    return EXIT_FAILURE;
+  }
+
+  SessionPlayer player;
+  if (!options.replay.empty()) {
+    if (!player.open(options.replay) || player.getNumFrames() == 0) {
+      std::fprintf(stderr, "could not read the recording '%s'\n", options.replay.c_str());
+      return EXIT_FAILURE;
+    }
+    player.setLoop(true);
+  }
+
+  Profiler& profiler = Profiler::instance();
+  const unsigned int PHASE_INPUT = profiler.addPhase("input");
+  const unsigned int PHASE_PICK = profiler.addPhase("pick");
+  const unsigned int PHASE_MANIPULATE = profiler.addPhase("manipulate");
+  const unsigned int PHASE_FRAME = profiler.addPhase("frame");
+
+  std::printf("%8s %8s %10s %12s %12s %12s %12s %12s %12s\n", "copies", "objects", "frames/s",
+              "input p50", "input p99", "pick p50", "pick p99", "manip p50", "manip p99");
+
+  std::vector<ProfileData> results;
+  for (size_t s = 0; s < options.sizes.size(); ++s) {
+    const unsigned int copies = std::max(1u, options.sizes[s]);
+
+    //back to where the scene started, the copies of the last size go
+    scene.sceneTrans->setMatrix(osg::Matrix::translate(0.0, 0.0, DEPTH));
+    scene.sceneTrans->removeChildren(numLoaded, scene.sceneTrans->getNumChildren() - numLoaded);
+
+    //the loaded models are the first copy, the others get their own transform so they can be grabbed
+    SelectableRegistry selectables;
+    const unsigned int side = (unsigned int)std::ceil(std::sqrt(float(copies)));
+    const float extent = 0.5f * (side - 1) * SPACING + SPACING;
+    for (unsigned int c = 0; c < copies; ++c) {
+      const osg::Vec3 offset(((c % side) - 0.5f * (side - 1)) * SPACING, ((c / side) - 0.5f * (side - 1)) * SPACING, 0.0f);
+      for (size_t m = 0; m < models.size(); ++m) {
+        if (c == 0) {
+          transforms[m]->setMatrix(placements[m] * osg::Matrix::translate(offset));
+          selectables.add(firstCopies[m].get(), transforms[m].get());
+          continue;
+        }
+        osg::ref_ptr<osg::MatrixTransform> transform = new osg::MatrixTransform(placements[m] * osg::Matrix::translate(offset));
+        osg::ref_ptr<osg::Group> copy = new osg::Group();
+        copy->addChild(models[m].get());
+        transform->addChild(copy.get());
+        scene.sceneTrans->addChild(transform.get());
+        selectables.add(copy.get(), transform.get());
+      }
+    }
+
+    Interaction interaction(selectables);
+    interaction.setSceneTransform(scene.sceneTrans.get());
+
+    TrackerState tracker;
+    DeltaDecoder decoder;
+    double depth = DEPTH;
+    player.rewind();
+
+    profiler.reset();
+    Interaction::Input input;
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (unsigned int frame = 0; frame < options.frames; ++frame) {
+      ScopedTimer frameTimer(PHASE_FRAME);
+      if (player.isOpen()) {
+        //fields in the order they were written
+        double value;
+        player.next(decoder);
+        decoder.readDouble(RECORD_TIME, value);
+        if (decoder.readDouble(RECORD_DIST, value) && value != depth) {
+          //like the arrow key distance in the application, on top of where the flight modes went
+          scene.sceneTrans->postMult(osg::Matrix::translate(0.0, 0.0, value - depth));
+          depth = value;
+        }
+        //every model is in from the start here, the shown models are only read to get to the tracker
+        std::vector<bool> shown;
+        decoder.readBools(RECORD_MODELS, shown);
+        tracker.decode(decoder, RECORD_TRACKER);
+        tracker.latch();
+        Interaction::readInput(tracker, WAND_POSE, HEAD_POSE, input);
+      }
+      else {
+        scriptInput(frame, extent, input);
+      }
+
+      {
+        ScopedTimer timer(PHASE_INPUT);
+        interaction.update(input);
+        scene.wandLine->setVertex(0, interaction.getWandStart());
+        scene.wandLine->setVertex(1, interaction.getWandEnd());
+        scene.wandLine->commit();
+      }
+
+      ScopedTimer timer(interaction.isTouched() && interaction.getSelected() ? PHASE_MANIPULATE : PHASE_PICK);
+      interaction.intersect();
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    ProfileData data;
+    profiler.collect(data);
+    data.node = copies; //one row per scene size in the exports
+    results.push_back(data);
+
+    std::printf("%8u %8u %10.0f %10.4fms %10.4fms %10.4fms %10.4fms %10.4fms %10.4fms\n", copies, selectables.getNumObjects(),
+                options.frames / seconds,
+                data.percentile(PHASE_INPUT, 0.5), data.percentile(PHASE_INPUT, 0.99),
+                data.percentile(PHASE_PICK, 0.5), data.percentile(PHASE_PICK, 0.99),
+                data.percentile(PHASE_MANIPULATE, 0.5), data.percentile(PHASE_MANIPULATE, 0.99));
+  }
+
+  if (!options.csv.empty()) {
+    std::ofstream csv(options.csv.c_str());
+    writeCsv(csv, results);
+  }
+  if (!options.json.empty()) {
+    std::ofstream json(options.json.c_str());
+    writeJson(json, results);
+  }
+  return EXIT_SUCCESS;
+}
@@ -19,6 +19,26 @@
 #include <osg/CopyOp>
 #include <osgUtil/IntersectVisitor>
 
+#include "DeltaSync.h"
+#include "Interaction.h"
+#include "Logger.h"
+#include "ModelLoader.h"
+#include "ParallelCull.h"
+#include "Scene.h"
+#include "ThreadPool.h"
+#include "TrackerState.h"
+#include "SelectableRegistry.h"
+#include "Profiler.h"
+#include "SessionRecord.h"
+#include "SharedRegistry.h"
+#include "TextureCache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
 sgct::Engine * gEngine;
 
 #define WAND_SENSOR_IDX 0
@@ -27,20 +47,19 @@ sgct::Engine * gEngine;
 // OSG stuff
 osgViewer::Viewer * mViewer;
 osg::ref_ptr<osg::Group> mRootNode;
-osg::ref_ptr<osg::MatrixTransform> mSGCTTrans;
-osg::ref_ptr<osg::MatrixTransform> mSceneTrans;
+Scene mScene; //the wand, the sgct and navigation transforms and the models
 osg::ref_ptr<osg::FrameStamp> mFrameStamp; //to sync osg animations across cluster
-osg::ref_ptr<osg::Geometry> linesGeom;
 
-osg::ref_ptr<osgUtil::LineSegmentIntersector> wandLine;
-osg::ref_ptr<osg::Node> intersectedNode = nullptr;
+SelectableRegistry mSelectables; //pickable models and the transforms that move them
+Interaction mInteraction(mSelectables); //buttons, wand picking and navigation
 
-osg::Vec3d wand_start(0,-1,0);
-osg::Vec3d wand_end(0,0,0);
-glm::mat4 wand_matrix;
-glm::mat4 head_matrix;
-glm::vec3 wand_startPos;
-glm::mat4 wand_startMat;
+//--cull-threads <n> culls every viewport in up to n partitions at once, one per model at most,
+//1 without a shared cull goes through the viewer as before
+unsigned int mCullThreads = std::max(1u, std::min(8u, std::thread::hardware_concurrency() / 2));
+ThreadPool* mWorkers = NULL; //the cull partitions and the wand pick
+ParallelCull* mParallelCull = NULL;
+//--shared-cull off culls again for every eye and viewport, on culls once per frame for all of them
+bool mSharedCull = true;
 
 // callbacks
 void myInitOGLFun();
@@ -51,24 +70,31 @@ void myEncodeFun();
 void myDecodeFun();
 void myCleanUpFun();
 void keyCallback(int key, int action);
+void myDataTransferDecoder(void* data, int length, int packageId, int clientIndex);
 
 // other functions
 void initOSG();
 void createOSGScene();
 void setupLightSource();
-osg::Geode* createWand();
-void IntersectionsCheck();
+void exportNodeProfile();
+void storeProfile(const ProfileData& data);
+void writeProfile(const std::string& name, const std::vector<ProfileData>& nodes);
+void recordFrame();
+void replayFrame();
+void setupSharedCallbacks();
+void logToSgct(LogLevel level, const char* message);
+void shareCull();
+void swapReadyModels();
+void reportLoadedModels();
+void storeLoadedModels(const unsigned char* data, int length);
+bool isLoadedEverywhere(unsigned int model);
 
 osg::ref_ptr<osg::Texture2D> addTexture();
 
 
-osg::ref_ptr<osg::Node>            mModel;
-osg::ref_ptr<osg::Node>            mNewModel;
-
-bool isTouched = false;
-bool isIntersected = false;
-int scalene = 0;
-bool isMoving = false;
+const char* MANIFEST_FILE = "files/models.txt";
+ModelLoader mLoader;
+TextureCache* mTextureCache = NULL; //block compressed model textures, made once OSG is set up
 
 //OSG support functions
 osg::AnimationPath::ControlPoint createPoint(osg::Vec3 position, osg::Vec3 scale);
@@ -81,18 +107,60 @@ void addPathTo( osg::ref_ptr<osg::PositionAttitudeTransform> nodeTransform);
 void addPoints( osg::ref_ptr<osg::AnimationPath> path );
 
 
-//variables to share across cluster
-sgct::SharedDouble curr_time(0.0);
-sgct::SharedDouble dist(-2.0);
-sgct::SharedVector<glm::mat4> sharedTransforms;
-sgct::SharedString sharedText;
-sgct::SharedVector<bool> theButtons;
-
-sgct::SharedBool wireframe(false);
-sgct::SharedBool info(false);
-sgct::SharedBool stats(false);
-sgct::SharedBool takeScreenshot(false);
-sgct::SharedBool light(true);
+//variables to share across cluster, encoded and decoded by the registry, see setupSharedCallbacks
+SharedRegistry mShared;
+SharedValue<double>& curr_time = mShared.addValue("time", 0.0);
+SharedValue<double>& dist = mShared.addValue("dist", -2.0);
+SharedValue< std::vector<bool> >& modelsReady = mShared.addValue("models", std::vector<bool>()); //set by the master once every node has loaded a model
+TrackerState mTracker; //poses, buttons and axes of every tracking device
+const double PREDICTION_HORIZON = 0.035; //sync, draw and swap, about two frames at 60 Hz
+
+//packed into one word of bits
+SharedFlag& wireframe = mShared.addFlag("wireframe");
+SharedFlag& info = mShared.addFlag("info");
+SharedFlag& stats = mShared.addFlag("stats");
+SharedTrigger& takeScreenshot = mShared.addTrigger("screenshot");
+SharedFlag& light = mShared.addFlag("light", true);
+SharedFlag& trackerInfo = mShared.addFlag("tracker info"); //tracker debug overlay
+SharedTrigger& exportProfile = mShared.addTrigger("export profile"); //every node writes its frame phase timings
+std::string mTrackerText;
+
+//the variables above only travel inside a delta encoded frame, see myEncodeFun
+enum SyncField { SYNC_TRACKER = 0, SYNC_SHARED = SYNC_TRACKER + TrackerState::NUM_FIELDS };
+sgct::SharedVector<unsigned char> syncFrame;
+DeltaEncoder mSyncEncoder(60); //everything is resent once a second at 60 Hz
+DeltaDecoder mSyncDecoder;
+
+//frame phases, exported with 'E' and at shutdown
+const unsigned int PHASE_FRAME = Profiler::instance().addPhase("frame");
+const unsigned int PHASE_PRESYNC = Profiler::instance().addPhase("presync");
+const unsigned int PHASE_ENCODE = Profiler::instance().addPhase("encode");
+const unsigned int PHASE_DECODE = Profiler::instance().addPhase("decode");
+const unsigned int PHASE_POSTSYNC = Profiler::instance().addPhase("postsync");
+const unsigned int PHASE_EVENT = Profiler::instance().addPhase("event");
+const unsigned int PHASE_UPDATE = Profiler::instance().addPhase("update");
+const unsigned int PHASE_INTERSECT = Profiler::instance().addPhase("intersect");
+const unsigned int PHASE_DRAW = Profiler::instance().addPhase("draw");
+const unsigned int PHASE_PICK = Profiler::instance().addPhase("pick");
+const int PROFILE_PACKAGE = 0;
+const int MODELS_PACKAGE = 1;
+const unsigned int MODELS_RESEND_FRAMES = 60;
+
+//the master gathers the profiles of all nodes here before writing them together
+std::vector<ProfileData> mClusterProfile;
+std::vector<bool> mClusterProfileReceived;
+std::mutex mClusterProfileMutex;
+
+//the models each slave has read, indexed by node, so the master shows a model only once all of them can swap it in
+std::vector< std::vector<bool> > mClusterModels;
+std::mutex mClusterModelsMutex;
+
+//--record <file> saves what the master shares every frame, --replay <file> plays it back in place of the devices
+std::string mRecordFile;
+std::string mReplayFile;
+SessionRecorder mRecorder;
+SessionPlayer mPlayer;
+DeltaDecoder mReplayDecoder;
 
 // Simple initial navigation based on arrow buttons
 bool arrowButtons[4];
@@ -102,7 +170,37 @@ const double navigation_speed = 1.0;
 
 
 int main( int argc, char* argv[] ) {
-  gEngine = new sgct::Engine( argc, argv );
+  //log through SGCT, written by the logger's thread so the frame never waits for the console
+  Logger::instance().setConsole(false);
+  Logger::instance().setSink(logToSgct);
+
+  //our own arguments are taken out before SGCT sees the rest
+  std::vector<char*> args;
+  for(int i = 0; i < argc; i++) {
+    LogLevel level;
+    if( i + 1 < argc && strcmp(argv[i], "--record") == 0 )
+      mRecordFile = argv[++i];
+    else if( i + 1 < argc && strcmp(argv[i], "--replay") == 0 )
+      mReplayFile = argv[++i];
+    else if( i + 1 < argc && strcmp(argv[i], "--log-level") == 0 ) {
+      if( Logger::parseLevel(argv[++i], level) )
+        Logger::setLevel(level);
+      else
+        LOG_WARNING("Unknown log level '%s', use error, warning, info or debug", argv[i]);
+    }
+    else if( i + 1 < argc && strcmp(argv[i], "--log-file") == 0 )
+      Logger::instance().setFile(argv[++i]);
+    else if( i + 1 < argc && strcmp(argv[i], "--cull-threads") == 0 )
+      mCullThreads = std::max(1, atoi(argv[++i]));
+    else if( i + 1 < argc && strcmp(argv[i], "--shared-cull") == 0 )
+      mSharedCull = strcmp(argv[++i], "off") != 0;
+    else
+      args.push_back(argv[i]);
+  }
+  int sgctArgc = static_cast<int>(args.size());
+  char** sgctArgv = &args[0];
+
+  gEngine = new sgct::Engine( sgctArgc, sgctArgv );
 
   gEngine->setInitOGLFunction( myInitOGLFun );
   gEngine->setPreSyncFunction( myPreSyncFun );
@@ -110,6 +208,8 @@ int main( int argc, char* argv[] ) {
   gEngine->setDrawFunction( myDrawFun );
   gEngine->setCleanUpFunction( myCleanUpFun );
   gEngine->setKeyboardCallbackFunction( keyCallback );
+  //needs a dataTransferPort on every node in the cluster configuration
+  gEngine->setDataTransferCallback( myDataTransferDecoder );
 
   //fix incompability with warping and OSG
   sgct_core::ClusterManager::instance()->setMeshImplementation( sgct_core::ClusterManager::DISPLAY_LIST );
@@ -140,27 +240,33 @@ void myInitOGLFun() {
   createOSGScene();
   setupLightSource();
 
+  //the models under the scene transform are shared out between the cull threads
+  mWorkers = new ThreadPool(mCullThreads);
+  if( mCullThreads > 1 || mSharedCull ) {
+    mParallelCull = new ParallelCull(*mWorkers, mCullThreads);
+    mParallelCull->setup(mViewer->getCamera(), mRootNode.get(), mScene.sceneTrans.get(), mFrameStamp.get());
+  }
+
+  setupSharedCallbacks();
+
   //only store the tracking data on the master node
   if( !gEngine->isMaster() ) return;
 
-  for(size_t i = 0; i < sgct::Engine::getTrackingManager()->getNumberOfTrackers(); i++){
-    sgct::SGCTTracker * trackerPtr = sgct::Engine::getTrackingManager()->getTrackerPtr(i);
-
-    for(size_t j=0; j<trackerPtr->getNumberOfDevices(); j++){
-      sgct::SGCTTrackingDevice * devicePtr = trackerPtr->getDevicePtr(j);
+  modelsReady.set( std::vector<bool>(mLoader.getNumModels(), false) );
 
-      if (devicePtr->hasSensor())
-        sharedTransforms.addVal( glm::mat4(1.0f) );
-      
-      if( devicePtr->hasButtons() ){
-        for( int id = 0 ; id < devicePtr->getNumberOfButtons() ; ++id ) {
-            theButtons.addVal(0); // id or 0 ?
-        }
-          
-      }
-    }
+  if( !mReplayFile.empty() ) {
+    if( mPlayer.open(mReplayFile) )
+      LOG_INFO("Replaying %u frames from '%s'", mPlayer.getNumFrames(), mReplayFile.c_str());
+    else
+      LOG_ERROR("Could not read the recording '%s', using the devices", mReplayFile.c_str());
+  }
+  if( !mPlayer.isOpen() ) {
+    mTracker.setup();
+    mTracker.setPredictionHorizon(PREDICTION_HORIZON);
   }
-  sharedText.setVal(" "); //< Space since SGCT hangs otherwise
+
+  if( !mRecordFile.empty() && !mRecorder.open(mRecordFile) )
+    LOG_ERROR("Could not write the recording '%s'", mRecordFile.c_str());
 }
 
 /*
@@ -178,417 +284,192 @@ void myInitOGLFun() {
  */
 
 void createOSGScene() {
+  mTextureCache = new TextureCache();
+  mLoader.setTextureCache( mTextureCache );
 
-  mRootNode->addChild(createWand() );
-
-  
-  osg::ref_ptr<osg::MatrixTransform> mModelTrans;
-  osg::ref_ptr<osg::MatrixTransform> mNewModelTrans;
-
-  mSGCTTrans         = new osg::MatrixTransform();
-  mSceneTrans        = new osg::MatrixTransform();
-  mModelTrans        = new osg::MatrixTransform();
-  mNewModelTrans     = new osg::MatrixTransform();
-
-  //rotate osg coordinate system to match sgct
-  mModelTrans->preMult(osg::Matrix::rotate(glm::radians(-90.0f), 1.0f, 0.0f, 0.0f));
-  mNewModelTrans->preMult(osg::Matrix::rotate(glm::radians(-90.0f), 1.0f, 0.0f, 0.0f));
-  
-  
-  mRootNode->addChild( mSGCTTrans.get() );
-  mSGCTTrans->addChild( mSceneTrans.get() );
-  mSceneTrans->addChild( mModelTrans.get() );
-  mSceneTrans->addChild( mNewModelTrans.get() );
-  
-  
-  
-  //loading our selected object
-  sgct::MessageHandler::instance()->print("Loading model 'godtycklig.file'...\n");
-  mNewModel = osgDB::readNodeFile("files/dumptruck.osg");
-
-  if (!mNewModel.valid()) {
-    sgct::MessageHandler::instance()->print("Failed to read model!\n");
-    return;
-  }
-
-  sgct::MessageHandler::instance()->print("Model loaded successfully!\n");
-  mNewModelTrans->addChild(mNewModel.get());
-  
-  
-  
-  //loading airplane object
-  sgct::MessageHandler::instance()->print("Loading model 'airplane.ive'...\n");
-  mModel = osgDB::readNodeFile("files/airplane.ive");
-
-  if (!mModel.valid()) {
-    sgct::MessageHandler::instance()->print("Failed to read model!\n");
-    return;
-  }
-
-  sgct::MessageHandler::instance()->print("Model loaded successfully!\n");
-  mModelTrans->addChild(mModel.get());
-
-  //get the bounding box
-  osg::ComputeBoundsVisitor cbv;
-  osg::BoundingBox &bb(cbv.getBoundingBox());
-  
-  //add boundingboxes to model
-  mModel->accept( cbv );
-  mNewModel->accept( cbv );
-
-  osg::Vec3f tmpVec;
-  tmpVec = bb.center();
-  osg::Vec3f planeTranslVec(0.0,0.0,50.0);
-  //planeTranslVec = (0.0f,0.0f,10.0f);
-
-  // translate model center to origin
-  mModelTrans->postMult(osg::Matrix::translate( -tmpVec ) );
-  mModelTrans->postMult(osg::Matrix::translate( planeTranslVec ) );
-  
-  mNewModelTrans->postMult(osg::Matrix::translate( -tmpVec ) );
-  
-  // scale model to a manageable size
-  double scale = 0.1 / bb.radius();
-  mModelTrans->postMult(osg::Matrix::scale(2*scale, 2*scale, 2*scale));
-  mNewModelTrans->postMult(osg::Matrix::scale(scale, scale, scale));
-  
-  sgct::MessageHandler::instance()->print("Model bounding sphere center:\tx=%f\ty=%f\tz=%f\n", tmpVec[0], tmpVec[1], tmpVec[2] );
-  sgct::MessageHandler::instance()->print("Model bounding sphere radius:\t%f\n", bb.radius() );
-
-  //disable face culling
-  mModel->getOrCreateStateSet()->setMode( GL_CULL_FACE,
-                                          osg::StateAttribute::OFF | osg::StateAttribute::OVERRIDE);
+  //the models are swapped in once every node has them loaded, see swapReadyModels
+  createScene( mRootNode.get(), mLoader, MANIFEST_FILE, mScene );
+  mInteraction.setSceneTransform( mScene.sceneTrans.get() );
 }
 
 void myPreSyncFun() {
-  if (!gEngine->isMaster())
+  ScopedTimer timer(PHASE_PRESYNC);
+  if (!gEngine->isMaster()) {
+    reportLoadedModels();
     return;
+  }
 
-  curr_time.setVal( sgct::Engine::getTime() );
-
-  if( arrowButtons[FORWARD] )
-    dist.setVal( dist.getVal() + (navigation_speed * gEngine->getDt()));
-
-  if( arrowButtons[BACKWARD] )
-    dist.setVal( dist.getVal() - (navigation_speed * gEngine->getDt()));
+  if( mPlayer.isOpen() ) {
+    replayFrame();
+  }
+  else {
+    //a model is shown once every node has read it, so all of them swap it in on the same frame
+    std::vector<bool> ready = modelsReady.get();
+    bool changed = false;
+    for(unsigned int i = 0; i < ready.size(); i++) {
+      if( !ready[i] && isLoadedEverywhere(i) ) {
+        ready[i] = true;
+        changed = true;
+      }
+    }
+    if( changed )
+      modelsReady.set(ready);
 
-  std::stringstream message;
+    curr_time.set( sgct::Engine::getTime() );
 
-  size_t index = 0;
-  for(size_t i = 0; i < sgct::Engine::getTrackingManager()->getNumberOfTrackers(); i++){
-    sgct::SGCTTracker * trackerPtr = sgct::Engine::getTrackingManager()->getTrackerPtr(i);
+    if( arrowButtons[FORWARD] )
+      dist.set( dist.get() + (navigation_speed * gEngine->getDt()));
 
-    for(size_t j = 0; j < trackerPtr->getNumberOfDevices(); j++){
-      sgct::SGCTTrackingDevice * devicePtr = trackerPtr->getDevicePtr(j);
+    if( arrowButtons[BACKWARD] )
+      dist.set( dist.get() - (navigation_speed * gEngine->getDt()));
 
-      message << "Device " << i << " on tracker " << j << std::endl;
+    //the devices go out as fixed layout arrays, the text is only made where it is shown
+    mTracker.sample();
+  }
 
-      if( devicePtr->hasSensor() ){
-        sharedTransforms.setValAt( index, devicePtr->getWorldTransform() );
-        message << "Position:" << std::endl << "  "
-                << devicePtr->getPosition().x << ", "
-                << devicePtr->getPosition().y << ", "
-                << devicePtr->getPosition().z << std::endl;
-        message << "Euler angles:" << std::endl << "  "
-                << devicePtr->getEulerAngles().x << ", "
-                << devicePtr->getEulerAngles().y << ", "
-                << devicePtr->getEulerAngles().z << std::endl;
-        index++;
-      }
+  if( mRecorder.isOpen() )
+    recordFrame();
+}
 
-      if( devicePtr->hasButtons() ){
-        message << "Buttons:" << std::endl << "  ";
-        for( int idx = 0 ; idx < devicePtr->getNumberOfButtons() ; ++idx ){
-          message << devicePtr->getButton(idx) ? "1" : "0";
-          std::cout << devicePtr->getButton(idx) ? "1" : "0" ;
-          theButtons.setValAt(idx, devicePtr->getButton(idx));
-        }
-        message << std::endl;
-      }
+void recordFrame() {
+  //encoded here, written to disk on the recorder's thread
+  DeltaEncoder& encoder = mRecorder.begin();
+  encoder.writeDouble( RECORD_TIME, curr_time.get() );
+  encoder.writeDouble( RECORD_DIST, dist.get() );
+  encoder.writeBools( RECORD_MODELS, modelsReady.get() );
+  mTracker.encode( encoder, RECORD_TRACKER );
+  mRecorder.end();
+}
 
-      if( devicePtr->hasAnalogs() ){
-        message << "Analogs:" << std::endl << "  ";
-        for( int idx = 0 ; idx < devicePtr->getNumberOfAxes() ; ++idx ){
-          message << "  " << devicePtr->getAnalog(idx) << std::endl;
-        }
-      }
-      message << std::endl;
+void replayFrame() {
+  if( !mPlayer.next(mReplayDecoder) ) {
+    //the last frame stays until the engine has stopped
+    static bool finished = false;
+    if( !finished ) {
+      LOG_INFO("Replay finished after %u frames", mPlayer.getNumFrames());
+      gEngine->terminate();
+      finished = true;
     }
+    return;
   }
 
-  if (message.str().size() < 2)
-    message << " "; //< Space postMultsince SGCT hangs otherwise
-  sharedText.setVal(message.str());
+  //the recorded time drives the animations, so a replay looks the same every time
+  double value;
+  if( mReplayDecoder.readDouble(RECORD_TIME, value) )
+    curr_time.set(value);
+  if( mReplayDecoder.readDouble(RECORD_DIST, value) )
+    dist.set(value);
+
+  //models show up on the recorded frames rather than when this run has read them, the swap waits for a slow node
+  std::vector<bool> ready;
+  if( mReplayDecoder.readBools(RECORD_MODELS, ready) && ready.size() == modelsReady.get().size() )
+    modelsReady.set(ready);
+
+  //the master's tracker state is set as if it had been sampled, then shared as usual
+  mTracker.decode( mReplayDecoder, RECORD_TRACKER );
+  mTracker.latch();
 }
 
 void myPostSyncPreDrawFun() {
-  gEngine->setWireframe(wireframe.getVal());
-  gEngine->setDisplayInfoVisibility(info.getVal());
-  gEngine->setStatsGraphVisibility(stats.getVal());
-  
-  bool point = false;
-  bool crosshair = false;
-  
-  //Update position if button is pressed
-  if(theButtons.getSize()) {
-    if(theButtons.getValAt(1)){
-       //point mode
-       point = true;
-       isMoving = true;
-       //isTouched = true; //for testing
-    }
-    else if(theButtons.getValAt(0)){
-       //crosshair mode
-       crosshair = true;
-       isMoving = true;
-       
-       
-    }
-    else if(theButtons.getValAt(2)) {
-      //Selection of model
-      isTouched = true;
-        if (theButtons.getValAt(4)) {
-            //scaling of model
-            scalene = 1;
-        }
-        else if (theButtons.getValAt(5)) {
-            //scaling of model
-            scalene = -1;
-        }
-        else {
-            scalene = 0;
-      }
-    }
-    else {
-        scalene = 0;
-        isTouched = false;
-        isMoving = false;
-    }
+  //whole frames, from one post sync to the next
+  static std::chrono::steady_clock::time_point lastFrame;
+  const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if( lastFrame.time_since_epoch().count() != 0 )
+    Profiler::instance().record(PHASE_FRAME, std::chrono::duration_cast<std::chrono::nanoseconds>(now - lastFrame).count());
+  lastFrame = now;
+
+  ScopedTimer timer(PHASE_POSTSYNC);
+  {
+    //the pick ran on a worker while the last frame was drawn, nothing in the scene changes before it is done
+    ScopedTimer intersectTimer(PHASE_INTERSECT);
+    mWorkers->wait();
+    mInteraction.apply();
   }
 
-  if (takeScreenshot.getVal()) {
-    gEngine->takeScreenshot();
-    takeScreenshot.setVal(false);
-  }
+  //only the variables that changed call back, see setupSharedCallbacks
+  mShared.dispatch();
 
-  if (light.getVal())
-    mRootNode->getOrCreateStateSet()->setMode( GL_LIGHTING,
-                                               osg::StateAttribute::ON |
-                                               osg::StateAttribute::OVERRIDE);
-  else
-    mRootNode->getOrCreateStateSet()->setMode( GL_LIGHTING,
-                                               osg::StateAttribute::OFF |
-                                               osg::StateAttribute::OVERRIDE);
+  mTracker.latch();
+  if( trackerInfo.get() )
+    mTracker.format(mTrackerText);
+
+  //the head tracked projections use the synced prediction instead of the raw head sample,
+  //which only the master has, so the CAVE walls lag the head no more than the wand;
+  //only for the device the configuration names as the head, SGCT's user is left alone without one
+  const unsigned int headPose = mTracker.getHeadPose();
+  if( headPose != TrackerState::NO_POSE )
+    gEngine->getDefaultUserPtr()->setTransform( mTracker.getPose(headPose) );
 
   // Simple initial navigation based on arrow buttons
-  mSceneTrans->setMatrix(osg::Matrix::translate(0.0, 0.0, dist.getVal()));
+  mScene.sceneTrans->setMatrix(osg::Matrix::translate(0.0, 0.0, dist.get()));
 
   // SGCT internal transformation from configuration file
-  mSGCTTrans->setMatrix(osg::Matrix(glm::value_ptr(gEngine->getModelMatrix())));
+  mScene.sgctTrans->setMatrix(osg::Matrix(glm::value_ptr(gEngine->getModelMatrix())));
 
   //update the frame stamp in the viewer to sync all
   //time based events in osg
   mFrameStamp->setFrameNumber( gEngine->getCurrentFrameNumber() );
-  mFrameStamp->setReferenceTime( curr_time.getVal() );
-  mFrameStamp->setSimulationTime( curr_time.getVal() );
+  mFrameStamp->setReferenceTime( curr_time.get() );
+  mFrameStamp->setSimulationTime( curr_time.get() );
   mViewer->setFrameStamp( mFrameStamp.get() );
-  mViewer->advance( curr_time.getVal() ); //update
-
-
-  // Update wand in OSG
-  if( sharedTransforms.getSize() > WAND_SENSOR_IDX ){   
-    glm::mat4 wand_matrix = sharedTransforms.getValAt(WAND_SENSOR_IDX);
-
-    glm::vec3 wand_position = glm::vec3(wand_matrix*glm::vec4(0,0,0,1));
-    //glm::quat wand_orientation = glm::quat_cast(wand_matrix);
-    glm::mat3 wand_orientation = glm::mat3(wand_matrix);
-
-    glm::vec3 start = wand_position;
-    glm::vec3 end = wand_position + wand_orientation * glm::vec3(0,0,-1);
-    osg::Vec3d wand_start = osg::Vec3(start.x, start.y, start.z);
-    osg::Vec3d wand_end = osg::Vec3(end.x, end.y, end.z);
+  mViewer->advance( curr_time.get() ); //update
 
-    osg::Vec3Array* vertices = new osg::Vec3Array();
-    vertices->push_back(wand_start);
-    vertices->push_back(wand_end);
-    linesGeom->setVertexArray(vertices);
-    wandLine->setStart(wand_start);
-    wandLine->setEnd(wand_end);
-  }
-  else{
-    //Debug drawing for wand even if there is no VRPN server
-    osg::Vec3Array* vertices = new osg::Vec3Array();
-    vertices->push_back(wand_start);
-    vertices->push_back(wand_end);
-    linesGeom->setVertexArray(vertices);
-    wandLine->setStart(wand_start);
-    wandLine->setEnd(wand_end);
-  }
 
-  
-  
-  
-  std::cout << "Testing sharedTransforms > HEAD_SENSOR_IDX" << std::endl;
-  //movement - only if we have a head to move ;)
-  if( sharedTransforms.getSize() > HEAD_SENSOR_IDX ) {
-      
-      std::cout << "sharedTransgorm > HEAD_SENSOR_IDX" << std::endl;
-      
-    if (!isMoving) {
-        //store initial position of wand for deadzone calculation
-        wand_startPos = glm::vec3( wand_matrix * glm::vec4(0, 0, 0, 1) ); 
-    }
+  //buttons, wand ray and navigation from the synced tracker state
+  Interaction::Input input;
+  Interaction::readInput(mTracker, WAND_SENSOR_IDX, HEAD_SENSOR_IDX, input);
+  mInteraction.update(input);
 
-    wand_matrix = sharedTransforms.getValAt(WAND_SENSOR_IDX);
-    
-    glm::vec3 wand_position = glm::vec3( wand_matrix*glm::vec4(0,0,0,1) );
-    glm::mat3 wand_orientation = glm::mat3(wand_matrix);
+  //the wand is drawn even if there is no VRPN server, the line is updated in place
+  mScene.wandLine->setVertex(0, mInteraction.getWandStart());
+  mScene.wandLine->setVertex(1, mInteraction.getWandEnd());
+  mScene.wandLine->commit();
 
-    head_matrix = sharedTransforms.getValAt(HEAD_SENSOR_IDX);
-    glm::vec3 head_position = glm::vec3( head_matrix*glm::vec4(0,0,0,1) );
-    
-    //intial static speed factor
-    float speedFactor = 0.1*gEngine->getDt();
-    
-    //user sets speed, deadzone is 10 cm from original position
-    speedFactor = ( length(wand_startPos - wand_position) < 0.1 ? 0 : length(wand_startPos - wand_position)/50 );
-    
-    //if we pull the control towards us it should go backwards
-    int direction = ( length(wand_startPos - head_position) > length(wand_position - head_position) ) ? -1 : 1;
-                        speedFactor *= direction;
-    //Move the world in the opposite direction for the movement effect 
-    if(point) {
-        glm::vec3 translation = ( glm::mat3(wand_matrix) * glm::vec3(0, 0, -1)*speedFactor );
-        
-        std::cout << "In point mode!" << std::endl;
-        
-        mSceneTrans->postMult(osg::Matrix::translate(
-                -osg::Vec3(translation.x, translation.y, translation.z)));
-    
-        std::cout << "Translation done." << std::endl;
-        
-    }
-    
-    
-    else if (crosshair) {
-      glm::vec3 translation = normalize(head_position - wand_position)*speedFactor;
-      
-      std::cout << "In crosshair mode!" << std::endl;
-      
-      mSceneTrans->postMult(osg::Matrix::translate(
-      osg::Vec3(translation.x, translation.y, translation.z)));
-      
-      std::cout << "Crosshair translation done." << std::endl;
-      std::cout << "Translated - x: " << translation.x << " y: " 
-      << translation.y << " z: " << translation.z <<   std::endl;
-    }
-  }
-  if (!isTouched) {
-       //Save wand matrix for manipulation
-       wand_startMat = wand_matrix;
-  }
-  
   //traverse if there are any tasks to do
   if (!mViewer->done()) {
-    mViewer->eventTraversal();
-    //update travelsal needed for pagelod object like terrain data etc.
-    mViewer->updateTraversal();
-    IntersectionsCheck();
-  }
-}
-
-void IntersectionsCheck() {
-    
-    
-    //std::cout << "start of IntersectionsCheck" << std::endl;
-    //check all nodes for intesection
-    osgUtil::IntersectionVisitor visitor;
-    visitor.setIntersector(wandLine);
-    
-    //std::cout << "Start" << std::endl;
-    mRootNode->accept(visitor);
-    //7std::cout << "accepted" << std::endl;
-    
-    if( !intersectedNode && wandLine->containsIntersections() ) {
-        //get intersection, store it and do something with the object
-        //std::cout << "Get intersectionpoint" << std::endl;    
-        osgUtil::LineSegmentIntersector::Intersection intersectInfo = 
-        wandLine->getFirstIntersection();
-        //std::cout << "Found wandLine!" << std::endl;
-        osg::NodePath nPath = intersectInfo.nodePath;
-        
-        isIntersected = true;
-        for( osg::NodePath::iterator it = nPath.begin() ; it != nPath.end(); ++it ) {
-            //std::cout << "intersection loop" << std::endl;
-            if((*it) == mNewModel || (*it) == mModel) {
-                intersectedNode = (*it);
-            }
-        }
-        
-        osg::ref_ptr<osg::Material> material = (osg::Material*)intersectedNode
-        ->getOrCreateStateSet()->getAttribute(osg::StateAttribute::MATERIAL);
-        
-        if(!material) {
-            material = new osg::Material();
-        }
-        material->setAmbient (osg::Material::FRONT_AND_BACK, osg::Vec4(1, 1, 0, 1.0));
-        material->setDiffuse (osg::Material::FRONT_AND_BACK, osg::Vec4(1, 1, 0, 1.0));
-        
-        intersectedNode->getOrCreateStateSet()->setAttributeAndModes(material.get(), osg::StateAttribute::OVERRIDE);
-
+    {
+      ScopedTimer eventTimer(PHASE_EVENT);
+      mViewer->eventTraversal();
     }
-    //std::cout << "First check passed" << std::endl;
-    else if ( isTouched && intersectedNode ) {
-        //std::cout << "else if 1" << std::endl;
-        //object is touched -> highlight it
-        osg::ref_ptr<osg::Material> material = (osg::Material*) intersectedNode
-        ->getOrCreateStateSet()->getAttribute(osg::StateAttribute::MATERIAL);
-        material->setAmbient(osg::Material::FRONT_AND_BACK, osg::Vec4(0, 1, 0, 1.0));
-        material->setDiffuse(osg::Material::FRONT_AND_BACK, osg::Vec4(0, 1, 0, 1.0));
-        intersectedNode->getOrCreateStateSet()->setAttributeAndModes(material.get(), osg::StateAttribute::OVERRIDE);
-    
-        //difference between starting wand orientation and current pos to determine the transformation
-        glm::mat4 diff = wand_startMat;
-        glm::mat4 diffInv = inverse(wand_matrix);
-
-        osg::ref_ptr<osg::MatrixTransform> parent = intersectedNode->getParent(0)->asTransform()->asMatrixTransform();
-        
-        if(scalene != 0) {
-            float scaleVal =0.05f;
-            float scale = 1- (scaleVal*scalene);
-        
-            parent->postMult(osg::Matrix::scale(scale,scale,scale));
-        }
-        else {    
-            parent->postMult(osg::Matrix(glm::value_ptr(inverse(diff*diffInv))));
-        }
-        wand_startMat = wand_matrix;
+    {
+      //update travelsal needed for pagelod object like terrain data etc.
+      ScopedTimer updateTimer(PHASE_UPDATE);
+      mViewer->updateTraversal();
     }
-    //std::cout << "Second check passed" << std::endl;
-    else if(!wandLine->containsIntersections()) {
-        //std::cout << "Else if 2" << std::endl;
-        mModel->getOrCreateStateSet()->removeAttribute(osg::StateAttribute::MATERIAL);
-        mNewModel->getOrCreateStateSet()->removeAttribute(osg::StateAttribute::MATERIAL);
-        intersectedNode = NULL;
-    } 
-    //std::cout << "End" << std::endl;
-        wandLine->reset();
-       
-    
-}
-
 
+    //up to date bounds, so the pick and the cull threads only read the scene from here on
+    mRootNode->getBound();
+    mWorkers->run([] {
+      ScopedTimer pickTimer(PHASE_PICK);
+      mInteraction.pick();
+    });
+  }
+}
 
 void myDrawFun() {
   glLineWidth(2.0f);
 
   const int * curr_vp = gEngine->getCurrentViewportPixelCoords();
-  mViewer->getCamera()->setViewport(curr_vp[0], curr_vp[1], curr_vp[2], curr_vp[3]);
-  mViewer->getCamera()->setProjectionMatrix( osg::Matrix( glm::value_ptr(gEngine->getCurrentViewProjectionMatrix() ) ));
+  const osg::Matrix projection( glm::value_ptr(gEngine->getCurrentViewProjectionMatrix() ) );
+
+  {
+    ScopedTimer timer(PHASE_DRAW);
+    if( mParallelCull ) {
+      if( mSharedCull )
+        shareCull();
+      mParallelCull->draw(curr_vp[0], curr_vp[1], curr_vp[2], curr_vp[3], projection);
+    }
+    else {
+      mViewer->getCamera()->setViewport(curr_vp[0], curr_vp[1], curr_vp[2], curr_vp[3]);
+      mViewer->getCamera()->setProjectionMatrix( projection );
+      mViewer->renderingTraversals();
+    }
+  }
 
-  mViewer->renderingTraversals();
+	// draw the tracker overlay with OpenGL, formatted once per frame in myPostSyncPreDrawFun
+	if( !trackerInfo.get() )
+		return;
 
-	// draw text with OpenGL
 	float textVerticalPos = static_cast<float>(gEngine->getCurrentWindowPtr()->getYResolution()) - 100.0f;
 	int fontSize = 12;
 
@@ -596,35 +477,257 @@ void myDrawFun() {
 	sgct_text::print(sgct_text::FontManager::instance()->getFont( "SGCTFont", fontSize ),
 		sgct_text::TextAlignMode::TOP_LEFT,
 		120.0f, textVerticalPos,
-		sharedText.getVal().c_str() );
+		mTrackerText.c_str() );
+}
+
+void shareCull() {
+  //the first draw of a frame culls for every eye of every viewport of the node, SGCT has set up all their frustums by then,
+  //the views of non-linear projections are not among them and ParallelCull culls those one by one
+  static unsigned int sharedFrame = 0;
+  static bool first = true;
+  const unsigned int frame = gEngine->getCurrentFrameNumber();
+  if( !first && frame == sharedFrame )
+    return;
+  first = false;
+  sharedFrame = frame;
+
+  static std::vector<osg::Matrix> projections;
+  projections.clear();
+  for(std::size_t i = 0; i < gEngine->getNumberOfWindows(); i++) {
+    sgct::SGCTWindow* window = gEngine->getWindowPtr(i);
+    for(std::size_t j = 0; j < window->getNumberOfViewports(); j++) {
+      sgct_core::Viewport* viewport = window->getViewport(j);
+      if( !viewport->isEnabled() )
+        continue;
+      if( window->isStereo() ) {
+        projections.push_back( osg::Matrix(glm::value_ptr(viewport->getProjection(sgct_core::Frustum::StereoLeftEye)->getViewProjectionMatrix())) );
+        projections.push_back( osg::Matrix(glm::value_ptr(viewport->getProjection(sgct_core::Frustum::StereoRightEye)->getViewProjectionMatrix())) );
+      }
+      else {
+        projections.push_back( osg::Matrix(glm::value_ptr(viewport->getProjection(sgct_core::Frustum::MonoEye)->getViewProjectionMatrix())) );
+      }
+    }
+  }
+
+  //without a frustum around them all, every draw culls for itself
+  if( !mParallelCull->share(projections) )
+    LOG_DEBUG("No common frustum for the %u views of frame %u", (unsigned int)projections.size(), frame);
 }
 
 void myEncodeFun() {
-  sgct::SharedData::instance()->writeDouble( &curr_time );
-  sgct::SharedData::instance()->writeVector( &sharedTransforms );
-	sgct::SharedData::instance()->writeString( &sharedText );
-  sgct::SharedData::instance()->writeBool( &wireframe );
-  sgct::SharedData::instance()->writeBool( &info );
-  sgct::SharedData::instance()->writeBool( &stats );
-  sgct::SharedData::instance()->writeBool( &takeScreenshot );
-  sgct::SharedData::instance()->writeBool( &light );
+  ScopedTimer timer(PHASE_ENCODE);
+
+  //only what changed since the last frame is written, with a full frame every keyframe interval
+  mSyncEncoder.begin();
+  mTracker.encode( mSyncEncoder, SYNC_TRACKER );
+  mShared.encode( mSyncEncoder, SYNC_SHARED );
+  const std::vector<unsigned char>& frame = mSyncEncoder.end();
+  syncFrame.setVal( frame );
+
+  sgct::SharedData::instance()->writeVector( &syncFrame );
+
+  //navigation and manipulation add up the poses every frame, so the master has to use
+  //the same quantized ones as the other nodes or they drift apart for good
+  if( mSyncDecoder.begin(frame) )
+    mTracker.loopback( mSyncDecoder, SYNC_TRACKER );
 }
 
 void myDecodeFun() {
-  sgct::SharedData::instance()->readDouble( &curr_time );
-  sgct::SharedData::instance()->readVector( &sharedTransforms );
-  sgct::SharedData::instance()->readString( &sharedText );
-  sgct::SharedData::instance()->readBool( &wireframe );
-  sgct::SharedData::instance()->readBool( &info );
-  sgct::SharedData::instance()->readBool( &stats );
-  sgct::SharedData::instance()->readBool( &takeScreenshot );
-  sgct::SharedData::instance()->readBool( &light );
+  ScopedTimer timer(PHASE_DECODE);
+
+  sgct::SharedData::instance()->readVector( &syncFrame );
+
+  //fields missing from the frame keep their value
+  const std::vector<unsigned char> frame = syncFrame.getVal();
+  if( !mSyncDecoder.begin(frame) )
+    return;
+
+  mTracker.decode( mSyncDecoder, SYNC_TRACKER );
+  mShared.decode( mSyncDecoder, SYNC_SHARED );
+}
+
+void setupSharedCallbacks() {
+  //engine and scene state is set on the frames a variable changes, and once at the start
+  wireframe.onChange([](bool on) { gEngine->setWireframe(on); });
+  info.onChange([](bool on) { gEngine->setDisplayInfoVisibility(on); });
+  stats.onChange([](bool on) { gEngine->setStatsGraphVisibility(on); });
+  light.onChange([](bool on) {
+    mRootNode->getOrCreateStateSet()->setMode( GL_LIGHTING,
+                                               (on ? osg::StateAttribute::ON : osg::StateAttribute::OFF) |
+                                               osg::StateAttribute::OVERRIDE);
+  });
+
+  takeScreenshot.onFire([] { gEngine->takeScreenshot(); });
+  exportProfile.onFire(exportNodeProfile);
+
+  //outside a replay every node has read these models already, so none of them waits on the swap
+  modelsReady.onChange([](const std::vector<bool>&) { swapReadyModels(); });
+}
+
+void swapReadyModels() {
+  //the pick hierarchy was built with the model, only pointers change hands here
+  const std::vector<bool>& ready = modelsReady.get();
+  for(unsigned int i = 0; i < ready.size(); i++) {
+    if( ready[i] && !mLoader.isSwapped(i) ) {
+      PickBvh::Object pickObject;
+      osg::Node* model = mLoader.swap(i, &pickObject);
+      if( model )
+        mSelectables.add(pickObject, mLoader.getTransform(i));
+    }
+  }
+}
+
+void reportLoadedModels() {
+  //sent when another model has been read, and again now and then until all are shown in case the master missed it
+  static std::vector<unsigned char> sent;
+  static unsigned int framesSinceSent = 0;
+  framesSinceSent++;
+
+  const unsigned int node = sgct_core::ClusterManager::instance()->getThisNodeId();
+  std::vector<unsigned char> bytes(sizeof(node) + mLoader.getNumModels());
+  memcpy(&bytes[0], &node, sizeof(node));
+  for(unsigned int i = 0; i < mLoader.getNumModels(); i++)
+    bytes[sizeof(node) + i] = mLoader.isLoaded(i) ? 1 : 0;
+
+  const std::vector<bool>& ready = modelsReady.get();
+  const bool allShown = std::find(ready.begin(), ready.end(), false) == ready.end();
+  if( bytes == sent && (allShown || framesSinceSent < MODELS_RESEND_FRAMES) )
+    return;
+
+  gEngine->transferDataBetweenNodes(&bytes[0], bytes.size(), MODELS_PACKAGE);
+  sent.swap(bytes);
+  framesSinceSent = 0;
+}
+
+void storeLoadedModels(const unsigned char* data, int length) {
+  unsigned int node;
+  if( length < static_cast<int>(sizeof(node)) )
+    return;
+  memcpy(&node, data, sizeof(node));
+
+  //called from the network thread
+  std::lock_guard<std::mutex> lock(mClusterModelsMutex);
+  const unsigned int numNodes = sgct_core::ClusterManager::instance()->getNumberOfNodes();
+  if( mClusterModels.size() != numNodes )
+    mClusterModels.resize(numNodes);
+  if( node >= numNodes )
+    return;
+
+  std::vector<bool>& loaded = mClusterModels[node];
+  loaded.assign(length - sizeof(node), false);
+  for(unsigned int i = 0; i < loaded.size(); i++)
+    loaded[i] = data[sizeof(node) + i] != 0;
+}
+
+bool isLoadedEverywhere(unsigned int model) {
+  if( !mLoader.isLoaded(model) )
+    return false;
+
+  std::lock_guard<std::mutex> lock(mClusterModelsMutex);
+  const unsigned int numNodes = sgct_core::ClusterManager::instance()->getNumberOfNodes();
+  const unsigned int master = sgct_core::ClusterManager::instance()->getThisNodeId();
+  for(unsigned int node = 0; node < numNodes; node++) {
+    if( node == master )
+      continue;
+    if( node >= mClusterModels.size() || model >= mClusterModels[node].size() || !mClusterModels[node][model] )
+      return false;
+  }
+  return true;
 }
 
 void myCleanUpFun() {
-  sgct::MessageHandler::instance()->print("Cleaning up osg data...\n");
+  LOG_INFO("Cleaning up osg data...");
+  mLoader.stop();
+  delete mTextureCache;
+  mTextureCache = NULL;
+  mRecorder.close();
+  mWorkers->wait();
+  delete mParallelCull;
+  mParallelCull = NULL;
+  delete mWorkers;
+  mWorkers = NULL;
   delete mViewer;
   mViewer = NULL;
+
+  //the network may already be gone, so only this node's own file
+  ProfileData data;
+  Profiler::instance().collect(data);
+  data.node = sgct_core::ClusterManager::instance()->getThisNodeId();
+  std::stringstream name;
+  name << "profile_node" << data.node;
+  writeProfile(name.str(), std::vector<ProfileData>(1, data));
+
+  //SGCT goes away with the engine, anything logged after this goes to the console
+  Logger::instance().stop();
+  Logger::instance().setSink(NULL);
+  Logger::instance().setConsole(true);
+}
+
+void logToSgct(LogLevel level, const char* message) {
+  //the logger has filtered by level already and SGCT's notify level would filter again, so the level is written in front
+  sgct::MessageHandler::instance()->print("%s: %s\n", Logger::levelName(level), message);
+}
+
+void exportNodeProfile() {
+  ProfileData data;
+  Profiler::instance().collect(data);
+  data.node = sgct_core::ClusterManager::instance()->getThisNodeId();
+
+  std::stringstream name;
+  name << "profile_node" << data.node;
+  writeProfile(name.str(), std::vector<ProfileData>(1, data));
+
+  //the slaves send theirs to the master, which writes them all once it has every node
+  if( gEngine->isMaster() ) {
+    storeProfile(data);
+  }
+  else {
+    std::vector<unsigned char> bytes;
+    data.serialize(bytes);
+    gEngine->transferDataBetweenNodes(&bytes[0], bytes.size(), PROFILE_PACKAGE);
+  }
+}
+
+void myDataTransferDecoder(void* data, int length, int packageId, int clientIndex) {
+  if( packageId == MODELS_PACKAGE ) {
+    if( gEngine->isMaster() )
+      storeLoadedModels(static_cast<const unsigned char*>(data), length);
+    return;
+  }
+  if( packageId != PROFILE_PACKAGE )
+    return;
+
+  ProfileData profile;
+  if( profile.deserialize(static_cast<const unsigned char*>(data), length) )
+    storeProfile(profile);
+}
+
+void storeProfile(const ProfileData& data) {
+  //called from the network thread for the slaves
+  std::lock_guard<std::mutex> lock(mClusterProfileMutex);
+  const unsigned int numNodes = sgct_core::ClusterManager::instance()->getNumberOfNodes();
+  if( mClusterProfile.size() != numNodes ) {
+    mClusterProfile.assign(numNodes, ProfileData());
+    mClusterProfileReceived.assign(numNodes, false);
+  }
+  if( data.node >= numNodes )
+    return;
+
+  mClusterProfile[data.node] = data;
+  mClusterProfileReceived[data.node] = true;
+  if( std::find(mClusterProfileReceived.begin(), mClusterProfileReceived.end(), false) != mClusterProfileReceived.end() )
+    return;
+
+  writeProfile("profile_cluster", mClusterProfile);
+  mClusterProfileReceived.assign(numNodes, false);
+}
+
+void writeProfile(const std::string& name, const std::vector<ProfileData>& nodes) {
+  std::ofstream csv((name + ".csv").c_str());
+  writeCsv(csv, nodes);
+  std::ofstream json((name + ".json").c_str());
+  writeJson(json, nodes);
+  LOG_INFO("Frame timings written to %s.csv and %s.json", name.c_str(), name.c_str());
 }
 
 void keyCallback(int key, int action) {
@@ -652,6 +755,16 @@ void keyCallback(int key, int action) {
       wireframe.toggle();
     break;
 
+  case 'T':
+    if(action == SGCT_PRESS)
+      trackerInfo.toggle();
+    break;
+
+  case 'E':
+    if(action == SGCT_PRESS)
+      exportProfile.fire();
+    break;
+
   case 'Q':
     if(action == SGCT_PRESS)
       gEngine->terminate();
@@ -660,7 +773,7 @@ void keyCallback(int key, int action) {
   case 'P':
   case SGCT_KEY_F10:
     if(action == SGCT_PRESS)
-      takeScreenshot.setVal( true );
+      takeScreenshot.fire();
     break;
 
   case SGCT_KEY_UP:
@@ -672,10 +785,10 @@ void keyCallback(int key, int action) {
     break;
     
   case SGCT_KEY_Y:
-      isTouched = true;
+      mInteraction.setTouched(true);
       break;
   case SGCT_KEY_U:
-      isTouched = false;
+      mInteraction.setTouched(false);
       break;
   }
 }
@@ -701,11 +814,7 @@ void initOSG() {
     new osgViewer::GraphicsWindowEmbedded(traits);
 
   mViewer->getCamera()->setGraphicsContext(graphicsWindow.get());
-  
-  
-  wandLine = new osgUtil::LineSegmentIntersector(wand_start, wand_end);
-  
-  
+
 
   //SGCT will handle the near and far planes
   mViewer->getCamera()->setComputeNearFarMode(osgUtil::CullVisitor::DO_NOT_COMPUTE_NEAR_FAR);
@@ -750,28 +859,3 @@ void setupLightSource() {
   mRootNode->addChild( lightSource0 );
   mRootNode->addChild( lightSource1 );
 }
-
-osg::Geode* createWand() {
-
-  osg::Geode* geode = new osg::Geode();
-
-  linesGeom = new osg::Geometry();
-
-  osg::Vec3Array* vertices = new osg::Vec3Array();
-  vertices->push_back(osg::Vec3(0, 0, 0));
-  vertices->push_back(osg::Vec3(1, 0, 0));
-  linesGeom->setVertexArray(vertices);
-
-  osg::Vec4Array* colors = new osg::Vec4Array;
-  colors->push_back(osg::Vec4(0.3f,0.7f,0.4f,1.0f));
-  linesGeom->setColorArray(colors, osg::Array::BIND_OVERALL);
-
-  osg::Vec3Array* normals = new osg::Vec3Array;
-  normals->push_back(osg::Vec3(0.0f,-1.0f,0.0f));
-  linesGeom->setNormalArray(normals, osg::Array::BIND_OVERALL);
-
-  linesGeom->addPrimitiveSet(new osg::DrawArrays(osg::PrimitiveSet::LINES,0,2));
-  geode->addDrawable(linesGeom);
-
-  return geode;
-}